@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+
+# Build the packed voice library sysex/voice.pack from the .syx files in
+# sysex/voice/, so that MiniDexed does not need to open every bank file
+# on boot. See src/voicepack.h for the format.
+#
+# MiniDexed falls back to scanning sysex/voice/, when .syx files have been
+# added, removed, renamed or modified after the pack has been built. Run this
+# script again in this case. The file sizes and modification times are
+# compared, so run it on the SD card or on a copy, which keeps the times.
+#
+# Usage: python3 packsysex.py [--headerless] [sysex/voice [sysex/voice.pack]]
+
+import os
+import re
+import struct
+import sys
+import time
+
+MAGIC = 0x4C56444D	# "MDVL"
+VERSION = 2
+HEADER_FORMAT = "<IHHIIIIII"
+INDEX_FORMAT = "<HHI"
+BANK_SIZE = 4104
+VOICE_DATA_SIZE = 4096
+MAX_BANK_ID = 16383
+MAX_SUB_DIRS = 3
+
+
+def fnv1a(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def hash_file(directory, relname):
+    """Hash the name, size and FAT date and time like CVoicePack::HashFile()."""
+    info = os.stat(os.path.join(directory, relname))
+    t = time.localtime(info.st_mtime)
+    fdate = (t.tm_year - 1980) << 9 | t.tm_mon << 5 | t.tm_mday
+    ftime = t.tm_hour << 11 | t.tm_min << 5 | t.tm_sec // 2
+    return fnv1a(relname.encode("utf-8")
+                 + struct.pack("<IHH", info.st_size & 0xFFFFFFFF, fdate, ftime))
+
+
+def scan(directory, reldir="", depth=0):
+    """Yield the relative names of all .syx files like the loader does."""
+    for name in sorted(os.listdir(os.path.join(directory, reldir))):
+        relname = reldir + name
+        if os.path.isdir(os.path.join(directory, relname)):
+            if depth < MAX_SUB_DIRS:
+                yield from scan(directory, relname + "/", depth + 1)
+        elif name.lower().endswith(".syx"):
+            yield relname
+
+
+def read_bank(path, headerless):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if (len(data) >= BANK_SIZE and data[0] == 0xF0 and data[1] == 0x43
+            and data[3] == 0x09 and data[BANK_SIZE - 1] == 0xF7):
+        return data[:BANK_SIZE]
+
+    if headerless and len(data) >= VOICE_DATA_SIZE:
+        return (bytes([0xF0, 0x43, 0x00, 0x09, 0x20, 0x00])
+                + data[:VOICE_DATA_SIZE] + bytes([0x00, 0xF7]))
+
+    return None
+
+
+def main(args):
+    headerless = "--headerless" in args
+    args = [arg for arg in args if arg != "--headerless"]
+
+    directory = args[0] if len(args) > 0 else "sysex/voice"
+    output = args[1] if len(args) > 1 else directory.rstrip("/") + ".pack"
+
+    files = 0
+    files_hash = 0
+    banks = {}
+
+    for relname in scan(directory):
+        files += 1
+        files_hash = (files_hash + hash_file(directory, relname)) & 0xFFFFFFFF
+
+        name = os.path.basename(relname)
+        match = re.match(r"(\d+)", name)
+        if len(name) < 5 or not match:
+            print("%s: Invalid filename format" % relname)
+            continue
+
+        bank_id = int(match.group(1)) - 1
+        if not 0 <= bank_id <= MAX_BANK_ID:
+            print("%s: Bank #%d is not supported" % (relname, bank_id + 1))
+            continue
+
+        if bank_id in banks:
+            print("%s: Bank #%d already loaded" % (relname, bank_id + 1))
+            continue
+
+        data = read_bank(os.path.join(directory, relname), headerless)
+        if data is None:
+            print("%s: Invalid size or format" % relname)
+            continue
+
+        banks[bank_id] = (relname, data)
+
+    index = b""
+    names = b""
+    bank_data = b""
+    for bank_id in sorted(banks):
+        relname, data = banks[bank_id]
+        index += struct.pack(INDEX_FORMAT, bank_id, 0, len(names))
+        names += relname.encode("utf-8") + b"\0"
+        bank_data += data
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    names_offset = header_size + len(index)
+    header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, header_size, len(banks),
+                         files, files_hash, names_offset, len(names),
+                         names_offset + len(names))
+
+    with open(output, "wb") as f:
+        f.write(header + index + names + bank_data)
+
+    print("%d banks from %d files written to %s" % (len(banks), files, output))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
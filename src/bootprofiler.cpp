@@ -0,0 +1,77 @@
+//
+// bootprofiler.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "bootprofiler.h"
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <assert.h>
+
+LOGMODULE ("boot");
+
+CBootProfiler *CBootProfiler::s_pThis = 0;
+
+CBootProfiler::CBootProfiler (void)
+:	m_nPhases (0),
+	m_nLastTicks (CTimer::GetClockTicks ())
+{
+	assert (!s_pThis);
+	s_pThis = this;
+
+	// the system timer runs since power-on, this is the firmware and startup time
+	PhaseDone ("Startup");
+}
+
+CBootProfiler::~CBootProfiler (void)
+{
+	s_pThis = 0;
+}
+
+void CBootProfiler::PhaseDone (const char *pPhase)
+{
+	assert (pPhase);
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+
+	if (m_nPhases < MaxPhases)
+	{
+		m_Phase[m_nPhases].pName = pPhase;
+		m_Phase[m_nPhases].nTicks = m_nPhases == 0 ? nTicks : nTicks - m_nLastTicks;
+		m_nPhases++;
+	}
+
+	m_nLastTicks = nTicks;
+}
+
+void CBootProfiler::Dump (void)
+{
+	for (unsigned i = 0; i < m_nPhases; i++)
+	{
+		LOGNOTE ("%-20s %6u ms", m_Phase[i].pName, m_Phase[i].nTicks / (CLOCKHZ / 1000));
+	}
+
+	LOGNOTE ("%-20s %6u ms", "Since power-on", m_nLastTicks / (CLOCKHZ / 1000));
+
+	m_nPhases = 0;
+}
+
+CBootProfiler *CBootProfiler::Get (void)
+{
+	assert (s_pThis);
+	return s_pThis;
+}
@@ -0,0 +1,58 @@
+//
+// bootprofiler.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _bootprofiler_h
+#define _bootprofiler_h
+
+#include <circle/types.h>
+
+// Records the duration of the boot phases in CKernel::Initialize() and
+// CMiniDexed::Initialize(). A phase starts, when the previous one is done.
+// Only used from core 0.
+class CBootProfiler
+{
+public:
+	static const unsigned MaxPhases = 24;
+
+public:
+	CBootProfiler (void);
+	~CBootProfiler (void);
+
+	void PhaseDone (const char *pPhase);		// pPhase must be a string constant
+
+	void Dump (void);				// logs and clears the recorded phases
+
+	static CBootProfiler *Get (void);
+
+private:
+	struct TPhase
+	{
+		const char *pName;
+		unsigned nTicks;
+	};
+
+	TPhase m_Phase[MaxPhases];
+	unsigned m_nPhases;
+
+	unsigned m_nLastTicks;
+
+	static CBootProfiler *s_pThis;
+};
+
+#endif
@@ -85,6 +85,11 @@ void CConfig::Load (void)
 	m_bMIDIAutoVoiceDumpOnPC = m_Properties.GetNumber ("MIDIAutoVoiceDumpOnPC", 1) != 0;
 	m_bHeaderlessSysExVoices = m_Properties.GetNumber ("HeaderlessSysExVoices", 0) != 0;
 	m_bExpandPCAcrossBanks = m_Properties.GetNumber ("ExpandPCAcrossBanks", 1) != 0;
+	m_nProgramChangeFadeTime = m_Properties.GetNumber ("ProgramChangeFadeTime", 0);
+
+	m_MIDIFilePlayerFile = m_Properties.GetString ("MIDIFilePlayerFile", "");
+	m_bMIDIFilePlayerLoop = m_Properties.GetNumber ("MIDIFilePlayerLoop", 1) != 0;
+	m_nMIDIFilePlayerSpeed = m_Properties.GetNumber ("MIDIFilePlayerSpeed", 100);
 
 	m_bLCDEnabled = m_Properties.GetNumber ("LCDEnabled", 0) != 0;
 	m_nLCDPinEnable = m_Properties.GetNumber ("LCDPinEnable", 4);
@@ -150,8 +155,14 @@ void CConfig::Load (void)
 
 	m_bMIDIDumpEnabled  = m_Properties.GetNumber ("MIDIDumpEnabled", 0) != 0;
 	m_bProfileEnabled = m_Properties.GetNumber ("ProfileEnabled", 0) != 0;
+	m_bLatencyMeterEnabled = m_Properties.GetNumber ("LatencyMeterEnabled", 0) != 0;
+	m_nLatencyTestInterval = m_Properties.GetNumber ("LatencyTestInterval", 0);
 	m_bPerformanceSelectToLoad = m_Properties.GetNumber ("PerformanceSelectToLoad", 1) != 0;
 	m_bPerformanceSelectChannel = m_Properties.GetNumber ("PerformanceSelectChannel", 0);
+	m_bFastStart = m_Properties.GetNumber ("FastStart", 0) != 0;
+	m_bPerformanceVoiceBlob = m_Properties.GetNumber ("PerformanceVoiceBlob", 0) != 0;
+	m_nMorphController = m_Properties.GetNumber ("MorphController", 0);
+	m_nMorphRampTime = m_Properties.GetNumber ("MorphRampTime", 50);
 }
 
 bool CConfig::GetUSBGadgetMode (void) const
@@ -229,6 +240,26 @@ bool CConfig::GetExpandPCAcrossBanks (void) const
 	return m_bExpandPCAcrossBanks;
 }
 
+unsigned CConfig::GetProgramChangeFadeTime (void) const
+{
+	return m_nProgramChangeFadeTime;
+}
+
+const char *CConfig::GetMIDIFilePlayerFile (void) const
+{
+	return m_MIDIFilePlayerFile.c_str ();
+}
+
+bool CConfig::GetMIDIFilePlayerLoop (void) const
+{
+	return m_bMIDIFilePlayerLoop;
+}
+
+unsigned CConfig::GetMIDIFilePlayerSpeed (void) const
+{
+	return m_nMIDIFilePlayerSpeed;
+}
+
 bool CConfig::GetLCDEnabled (void) const
 {
 	return m_bLCDEnabled;
@@ -494,6 +525,16 @@ bool CConfig::GetProfileEnabled (void) const
 	return m_bProfileEnabled;
 }
 
+bool CConfig::GetLatencyMeterEnabled (void) const
+{
+	return m_bLatencyMeterEnabled;
+}
+
+unsigned CConfig::GetLatencyTestInterval (void) const
+{
+	return m_nLatencyTestInterval;
+}
+
 bool CConfig::GetPerformanceSelectToLoad (void) const
 {
 	return m_bPerformanceSelectToLoad;
@@ -503,3 +544,23 @@ unsigned CConfig::GetPerformanceSelectChannel (void) const
 {
 	return m_bPerformanceSelectChannel;
 }
+
+bool CConfig::GetFastStart (void) const
+{
+	return m_bFastStart;
+}
+
+bool CConfig::GetPerformanceVoiceBlob (void) const
+{
+	return m_bPerformanceVoiceBlob;
+}
+
+unsigned CConfig::GetMorphController (void) const
+{
+	return m_nMorphController;
+}
+
+unsigned CConfig::GetMorphRampTime (void) const
+{
+	return m_nMorphRampTime;
+}
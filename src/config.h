@@ -83,6 +83,12 @@ public:
 	bool GetMIDIAutoVoiceDumpOnPC (void) const; // true if not specified
 	bool GetHeaderlessSysExVoices (void) const; // false if not specified
 	bool GetExpandPCAcrossBanks (void) const; // true if not specified
+	unsigned GetProgramChangeFadeTime (void) const;	// milliseconds, 0 if not specified
+
+	// MIDI file player
+	const char *GetMIDIFilePlayerFile (void) const;	// "" if not specified
+	bool GetMIDIFilePlayerLoop (void) const;
+	unsigned GetMIDIFilePlayerSpeed (void) const;	// percent
 
 	// HD44780 LCD
 	// GPIO pin numbers are chip numbers, not header positions
@@ -163,11 +169,23 @@ public:
 	// Debug
 	bool GetMIDIDumpEnabled (void) const;
 	bool GetProfileEnabled (void) const;
+	bool GetLatencyMeterEnabled (void) const;
+	unsigned GetLatencyTestInterval (void) const;	// milliseconds, 0 to disable
 	
 	// Load performance mode. 0 for load just rotating encoder, 1 load just when Select is pushed
 	bool GetPerformanceSelectToLoad (void) const;
 	unsigned GetPerformanceSelectChannel (void) const;
 
+	// Start the sound with the performance first, load the rest afterwards
+	bool GetFastStart (void) const;
+
+	// Save the voice data of performances as base64 blob instead of hex
+	bool GetPerformanceVoiceBlob (void) const;
+
+	// Morph between two performances (see CMiniDexed::SetMorphPerformances())
+	unsigned GetMorphController (void) const;	// CC number, 0 to disable
+	unsigned GetMorphRampTime (void) const;		// milliseconds
+
 private:
 	CPropertiesFatFsFile m_Properties;
 	
@@ -188,6 +206,11 @@ private:
 	bool m_bMIDIAutoVoiceDumpOnPC;
 	bool m_bHeaderlessSysExVoices;
 	bool m_bExpandPCAcrossBanks;
+	unsigned m_nProgramChangeFadeTime;
+
+	std::string m_MIDIFilePlayerFile;
+	bool m_bMIDIFilePlayerLoop;
+	unsigned m_nMIDIFilePlayerSpeed;
 
 	bool m_bLCDEnabled;
 	unsigned m_nLCDPinEnable;
@@ -250,8 +273,14 @@ private:
 
 	bool m_bMIDIDumpEnabled;
 	bool m_bProfileEnabled;
+	bool m_bLatencyMeterEnabled;
+	unsigned m_nLatencyTestInterval;
 	bool m_bPerformanceSelectToLoad;
 	unsigned m_bPerformanceSelectChannel;
+	bool m_bFastStart;
+	bool m_bPerformanceVoiceBlob;
+	unsigned m_nMorphController;
+	unsigned m_nMorphRampTime;
 };
 
 #endif
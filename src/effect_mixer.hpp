@@ -15,6 +15,9 @@
 #define MAX_PANORAMA 1.0f
 #define MIN_PANORAMA 0.0f
 
+// Changes of gain and panorama are ramped linearly over the next block,
+// so that they do not produce zipper noise. The ramp and the mix are done in
+// one loop with a multiply-add per sample, which the compiler vectorizes.
 template <int NN> class AudioMixer
 {
 public:
@@ -22,26 +25,32 @@ public:
 	{
 		buffer_length=len;
 		for (uint8_t i=0; i<NN; i++)
+		{
 			multiplier[i] = UNITY_GAIN;
+			coefficient[i] = UNITY_GAIN;
+		}
 
 		sumbufL=new float32_t[buffer_length];
 		arm_fill_f32(0.0f, sumbufL, len);
+
+		ramp=new float32_t[buffer_length];
+		for (uint16_t i=0; i<buffer_length; i++)
+			ramp[i] = (float32_t) (i+1) / buffer_length;
 	}
 
 	~AudioMixer()
 	{
 		delete [] sumbufL;
+		delete [] ramp;
 	}
 
         void doAddMix(uint8_t channel, float32_t* in)
 	{
-		float32_t tmp[buffer_length];
-
 		assert(in);
 
-		if(multiplier[channel]!=UNITY_GAIN)
-			arm_scale_f32(in,multiplier[channel],tmp,buffer_length);
-		arm_add_f32(sumbufL, tmp, sumbufL, buffer_length);
+		float32_t target = multiplier[channel];
+		mixRamp(sumbufL, in, coefficient[channel], target);
+		coefficient[channel] = target;
 	}
 
 	void gain(uint8_t channel, float32_t gain)
@@ -78,8 +87,30 @@ public:
 	}
 
 protected:
+	// sum[i] += in[i] * coefficient, where the coefficient goes from "from"
+	// (exclusive) to "to" within the block
+	void mixRamp(float32_t* sum, const float32_t* in, float32_t from, float32_t to)
+	{
+		if (from == to)
+		{
+			if (to == 0.0f)
+				return;
+
+			for (uint16_t i=0; i<buffer_length; i++)
+				sum[i] += in[i] * to;
+		}
+		else
+		{
+			float32_t delta = to - from;
+			for (uint16_t i=0; i<buffer_length; i++)
+				sum[i] += in[i] * (from + delta * ramp[i]);
+		}
+	}
+
 	float32_t multiplier[NN];
+	float32_t coefficient[NN];		// of the last block
 	float32_t* sumbufL;
+	float32_t* ramp;			// 1/len .. 1
 	uint16_t buffer_length;
 };
 
@@ -92,6 +123,8 @@ public:
 		{
 			panorama[i][0] = UNITY_PANORAMA;
 			panorama[i][1] = UNITY_PANORAMA;
+			coefficientLR[i][0] = UNITY_GAIN;
+			coefficientLR[i][1] = UNITY_GAIN;
 		}
 
 		sumbufR=new float32_t[buffer_length];
@@ -119,37 +152,31 @@ public:
 
 	void doAddMix(uint8_t channel, float32_t* in)
 	{
-		float32_t tmp[buffer_length];
-
 		assert(in);
 
 		// left
-		arm_scale_f32(in, panorama[channel][0], tmp, buffer_length);
-		if(multiplier[channel]!=UNITY_GAIN)
-			arm_scale_f32(tmp,multiplier[channel],tmp,buffer_length);
-		arm_add_f32(sumbufL, tmp, sumbufL, buffer_length);
+		float32_t target = multiplier[channel] * panorama[channel][0];
+		this->mixRamp(sumbufL, in, coefficientLR[channel][0], target);
+		coefficientLR[channel][0] = target;
 		// right
-		arm_scale_f32(in, panorama[channel][1], tmp, buffer_length);
-		if(multiplier[channel]!=UNITY_GAIN)
-			arm_scale_f32(tmp,multiplier[channel],tmp,buffer_length);
-		arm_add_f32(sumbufR, tmp, sumbufR, buffer_length);
+		target = multiplier[channel] * panorama[channel][1];
+		this->mixRamp(sumbufR, in, coefficientLR[channel][1], target);
+		coefficientLR[channel][1] = target;
 	}
 
 	void doAddMix(uint8_t channel, float32_t* inL, float32_t* inR)
 	{
-		float32_t tmp[buffer_length];
-
 		assert(inL);
 		assert(inR);
 
+		float32_t target = multiplier[channel];
+
 		// left
-		if(multiplier[channel]!=UNITY_GAIN)
-			arm_scale_f32(inL,multiplier[channel],tmp,buffer_length);
-		arm_add_f32(sumbufL, tmp, sumbufL, buffer_length);
+		this->mixRamp(sumbufL, inL, coefficientLR[channel][0], target);
+		coefficientLR[channel][0] = target;
 		// right
-		if(multiplier[channel]!=UNITY_GAIN)
-			arm_scale_f32(inR,multiplier[channel],tmp,buffer_length);
-		arm_add_f32(sumbufR, tmp, sumbufR, buffer_length);
+		this->mixRamp(sumbufR, inR, coefficientLR[channel][1], target);
+		coefficientLR[channel][1] = target;
 	}
 
 	void getMix(float32_t* bufferL, float32_t* bufferR)
@@ -173,6 +200,7 @@ protected:
 	using AudioMixer<NN>::multiplier;
 	using AudioMixer<NN>::buffer_length;
 	float32_t panorama[NN][2];
+	float32_t coefficientLR[NN][2];		// of the last block
 	float32_t* sumbufR;
 };
 
@@ -54,6 +54,8 @@ bool CKernel::Initialize (void)
 
 	mLogger.RegisterPanicHandler (PanicHandler);
 
+	m_BootProfiler.PhaseDone ("Circle");
+
 	if (!m_GPIOManager.Initialize ())
 	{
 		return FALSE;
@@ -65,6 +67,8 @@ bool CKernel::Initialize (void)
 	}
 
 	m_Config.Load ();
+
+	m_BootProfiler.PhaseDone ("Config");
 	
 	if (m_Config.GetUSBGadgetMode())
 	{
@@ -81,16 +85,22 @@ bool CKernel::Initialize (void)
     {
 		return FALSE;
     }
+
+	m_BootProfiler.PhaseDone ("USB");
 	
 	m_pDexed = new CMiniDexed (&m_Config, &mInterrupt, &m_GPIOManager, &m_I2CMaster,
 				   &mFileSystem);
 	assert (m_pDexed);
 
+	m_BootProfiler.PhaseDone ("Synthesizer");
+
 	if (!m_pDexed->Initialize ())
 	{
 		return FALSE;
 	}
 
+	m_BootProfiler.Dump ();
+
 	return TRUE;
 }
 
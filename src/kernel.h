@@ -27,6 +27,7 @@
 #include <circle/usb/usbcontroller.h>
 #include "config.h"
 #include "minidexed.h"
+#include "bootprofiler.h"
 
 enum TShutdownMode
 {
@@ -50,6 +51,7 @@ private:
 
 private:
 	// do not change this order
+	CBootProfiler	m_BootProfiler;
 	CConfig		m_Config;
 	CCPUThrottle	m_CPUThrottle;
 	CGPIOManager	m_GPIOManager;
@@ -0,0 +1,297 @@
+//
+// latencymeter.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "latencymeter.h"
+#include "minidexed.h"
+#include <circle/logger.h>
+#include <math.h>
+#include <assert.h>
+
+LOGMODULE ("latency");
+
+CLatencyMeter *CLatencyMeter::s_pThis = 0;
+
+CLatencyMeter::CLatencyMeter (CMiniDexed *pSynthesizer, bool bEnabled,
+			      unsigned nTestIntervalMillis, unsigned nSampleRate)
+:	m_pSynthesizer (pSynthesizer),
+	m_bEnabled (bEnabled),
+	m_nTestIntervalTicks (nTestIntervalMillis * (CLOCKHZ / 1000)),
+	m_nSampleRate (nSampleRate),
+	m_nState (StateIdle),
+	m_pDevice (0),
+	m_nTG (0),
+	m_nStartTicks (0),
+	m_nResultMicros (0),
+	m_nTimeouts (0),
+	m_bTestNoteOn (false),
+	m_nLastTestTicks (0),
+	m_nLastDumpTicks (0),
+	m_nLastDumpCount (0),
+	m_nDevices (0)
+{
+	assert (m_nSampleRate > 0);
+
+	assert (!s_pThis);
+	s_pThis = this;
+}
+
+bool CLatencyMeter::IsEnabled (void) const
+{
+	return m_bEnabled;
+}
+
+void CLatencyMeter::NoteOn (const char *pDevice, unsigned nTG)
+{
+	if (!m_bEnabled)
+	{
+		return;
+	}
+
+	unsigned nExpected = StateIdle;
+	if (!__atomic_compare_exchange_n (&m_nState, &nExpected, StateArming, false,
+					  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+		return;			// another measurement is in progress
+	}
+
+	m_pDevice = pDevice;
+	m_nTG = nTG;
+	m_nStartTicks = CTimer::GetClockTicks ();
+
+	__atomic_store_n (&m_nState, StateArmed, __ATOMIC_RELEASE);
+}
+
+int CLatencyMeter::GetArmedTG (void) const
+{
+	if (__atomic_load_n (&m_nState, __ATOMIC_ACQUIRE) != StateArmed)
+	{
+		return -1;
+	}
+
+	return m_nTG;
+}
+
+void CLatencyMeter::ProcessChunk (const float32_t *pBuffer, unsigned nFrames, unsigned nQueuedFrames)
+{
+	assert (pBuffer);
+
+	if (__atomic_load_n (&m_nState, __ATOMIC_ACQUIRE) != StateArmed)
+	{
+		return;
+	}
+
+	for (unsigned i = 0; i < nFrames; i++)
+	{
+		if (fabsf (pBuffer[i]) > Threshold)
+		{
+			unsigned nTicks = CTimer::GetClockTicks ();
+			unsigned nMicros = (nTicks - m_nStartTicks) / (CLOCKHZ / 1000000);
+
+			// the sample leaves the queue after all frames ahead of it
+			nMicros += (unsigned) ((unsigned long long) (nQueuedFrames + i) * 1000000U
+					       / m_nSampleRate);
+
+			m_nResultMicros = nMicros;
+
+			__atomic_store_n (&m_nState, StateDone, __ATOMIC_RELEASE);
+
+			return;
+		}
+	}
+}
+
+void CLatencyMeter::Process (void)
+{
+	if (!m_bEnabled)
+	{
+		return;
+	}
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+
+	unsigned nState = __atomic_load_n (&m_nState, __ATOMIC_ACQUIRE);
+	if (nState == StateDone)
+	{
+		AddResult (m_pDevice, m_nResultMicros);
+
+		__atomic_store_n (&m_nState, StateIdle, __ATOMIC_RELEASE);
+	}
+	else if (   nState == StateArmed
+		 && (nTicks - m_nStartTicks) / (CLOCKHZ / 1000000) > TimeoutMicros)
+	{
+		// note was filtered or is inaudible, give up
+		unsigned nExpected = StateArmed;
+		if (__atomic_compare_exchange_n (&m_nState, &nExpected, StateIdle, false,
+						 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		{
+			m_nTimeouts++;
+		}
+	}
+
+	// test mode: play a note periodically, hold it for half the interval
+	if (m_nTestIntervalTicks > 0)
+	{
+		assert (m_pSynthesizer);
+
+		if (m_bTestNoteOn)
+		{
+			if (nTicks - m_nLastTestTicks >= m_nTestIntervalTicks/2)
+			{
+				m_pSynthesizer->keyup (TestNote, TestTG);
+
+				m_bTestNoteOn = false;
+			}
+		}
+		else if (nTicks - m_nLastTestTicks >= m_nTestIntervalTicks)
+		{
+			m_nLastTestTicks = nTicks;
+
+			NoteOn ("test", TestTG);
+			m_pSynthesizer->keydown (TestNote, TestVelocity, TestTG);
+
+			m_bTestNoteOn = true;
+		}
+	}
+}
+
+void CLatencyMeter::Dump (unsigned nIntervalTicks)
+{
+	if (!m_bEnabled)
+	{
+		return;
+	}
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+	if (nTicks - m_nLastDumpTicks < nIntervalTicks)
+	{
+		return;
+	}
+	m_nLastDumpTicks = nTicks;
+
+	unsigned nCount = m_nTimeouts;
+	for (unsigned i = 0; i < m_nDevices; i++)
+	{
+		nCount += m_Stats[i].nCount;
+	}
+
+	if (nCount == m_nLastDumpCount)
+	{
+		return;
+	}
+	m_nLastDumpCount = nCount;
+
+	for (unsigned i = 0; i < m_nDevices; i++)
+	{
+		const TDeviceStats &rStats = m_Stats[i];
+		assert (rStats.nCount > 0);
+
+		LOGNOTE ("%s: %u notes, min %u, mean %u, p99 %u, max %u us",
+			 rStats.Name.c_str (), rStats.nCount, rStats.nMinMicros,
+			 (unsigned) (rStats.nSumMicros / rStats.nCount),
+			 GetPercentile (rStats, 99), rStats.nMaxMicros);
+	}
+
+	if (m_nTimeouts > 0)
+	{
+		LOGNOTE ("%u notes without audible output", m_nTimeouts);
+	}
+}
+
+CLatencyMeter *CLatencyMeter::Get (void)
+{
+	assert (s_pThis);
+	return s_pThis;
+}
+
+void CLatencyMeter::AddResult (const char *pDevice, unsigned nMicros)
+{
+	if (!pDevice)
+	{
+		pDevice = "";
+	}
+
+	unsigned nDevice;
+	for (nDevice = 0; nDevice < m_nDevices; nDevice++)
+	{
+		if (m_Stats[nDevice].Name.compare (pDevice) == 0)
+		{
+			break;
+		}
+	}
+
+	if (nDevice == m_nDevices)
+	{
+		if (m_nDevices >= MaxDevices)
+		{
+			return;
+		}
+
+		TDeviceStats &rStats = m_Stats[m_nDevices++];
+		rStats.Name = pDevice;
+		rStats.nCount = 0;
+		rStats.nMinMicros = (unsigned) -1;
+		rStats.nMaxMicros = 0;
+		rStats.nSumMicros = 0;
+		for (unsigned i = 0; i < Buckets; i++)
+		{
+			rStats.nHistogram[i] = 0;
+		}
+	}
+
+	TDeviceStats &rStats = m_Stats[nDevice];
+
+	rStats.nCount++;
+	rStats.nSumMicros += nMicros;
+
+	if (nMicros < rStats.nMinMicros)
+	{
+		rStats.nMinMicros = nMicros;
+	}
+
+	if (nMicros > rStats.nMaxMicros)
+	{
+		rStats.nMaxMicros = nMicros;
+	}
+
+	unsigned nBucket = nMicros / BucketMicros;
+	if (nBucket >= Buckets)
+	{
+		nBucket = Buckets-1;
+	}
+
+	rStats.nHistogram[nBucket]++;
+}
+
+// returns the upper bound of the histogram bucket, which contains the percentile
+unsigned CLatencyMeter::GetPercentile (const TDeviceStats &rStats, unsigned nPercent) const
+{
+	unsigned nTarget = (rStats.nCount * nPercent + 99) / 100;
+	unsigned nSum = 0;
+
+	for (unsigned i = 0; i < Buckets; i++)
+	{
+		nSum += rStats.nHistogram[i];
+		if (nSum >= nTarget)
+		{
+			return (i+1) * BucketMicros;
+		}
+	}
+
+	return Buckets * BucketMicros;
+}
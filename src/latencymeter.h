@@ -0,0 +1,114 @@
+//
+// latencymeter.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _latencymeter_h
+#define _latencymeter_h
+
+#include <circle/timer.h>
+#include <arm_math.h>
+#include <string>
+
+class CMiniDexed;
+
+// Measures the time from the arrival of a MIDI note-on until the first sample
+// of the addressed TG above Threshold will leave the sound queue. Only one note
+// is measured at a time, further notes are ignored until it is complete.
+class CLatencyMeter
+{
+public:
+	static const unsigned MaxDevices = 8;
+	static const unsigned BucketMicros = 100;
+	static const unsigned Buckets = 500;			// up to 50ms
+	static const unsigned TimeoutMicros = 1000000;
+	static constexpr float32_t Threshold = 0.001f;		// -60 dBFS
+
+	static const unsigned TestNote = 69;			// A4
+	static const unsigned TestVelocity = 100;
+	static const unsigned TestTG = 0;
+
+public:
+	CLatencyMeter (CMiniDexed *pSynthesizer, bool bEnabled, unsigned nTestIntervalMillis,
+		       unsigned nSampleRate);
+
+	bool IsEnabled (void) const;
+
+	// may be called from any context
+	void NoteOn (const char *pDevice, unsigned nTG);
+
+	// called from ProcessSound(), returns -1 if no measurement is in progress
+	int GetArmedTG (void) const;
+	// pBuffer: output of the armed TG for this chunk,
+	// nQueuedFrames: frames in the sound queue ahead of this chunk
+	void ProcessChunk (const float32_t *pBuffer, unsigned nFrames, unsigned nQueuedFrames);
+
+	// called from the main loop only
+	void Process (void);
+	void Dump (unsigned nIntervalTicks = 10*CLOCKHZ);
+
+	static CLatencyMeter *Get (void);
+
+private:
+	enum TState
+	{
+		StateIdle,
+		StateArming,
+		StateArmed,
+		StateDone
+	};
+
+	struct TDeviceStats
+	{
+		std::string Name;
+		unsigned nCount;
+		unsigned nMinMicros;
+		unsigned nMaxMicros;
+		unsigned long long nSumMicros;
+		unsigned nHistogram[Buckets];
+	};
+
+	void AddResult (const char *pDevice, unsigned nMicros);
+	unsigned GetPercentile (const TDeviceStats &rStats, unsigned nPercent) const;
+
+private:
+	CMiniDexed *m_pSynthesizer;
+	bool m_bEnabled;
+	unsigned m_nTestIntervalTicks;
+	unsigned m_nSampleRate;
+
+	// measurement in progress, handed over between cores via m_nState
+	unsigned m_nState;
+	const char *m_pDevice;
+	unsigned m_nTG;
+	unsigned m_nStartTicks;
+	unsigned m_nResultMicros;
+
+	unsigned m_nTimeouts;
+
+	bool m_bTestNoteOn;
+	unsigned m_nLastTestTicks;
+	unsigned m_nLastDumpTicks;
+	unsigned m_nLastDumpCount;
+
+	unsigned m_nDevices;
+	TDeviceStats m_Stats[MaxDevices];
+
+	static CLatencyMeter *s_pThis;
+};
+
+#endif
@@ -25,6 +25,7 @@
 #include "mididevice.h"
 #include "minidexed.h"
 #include "config.h"
+#include "miditrace.h"
 #include <stdio.h>
 #include <assert.h>
 #include "userinterface.h"
@@ -55,6 +56,11 @@ LOGMODULE ("mididevice");
 
 #define MIDI_SYSTEM_EXCLUSIVE_BEGIN	0xF0
 #define MIDI_SYSTEM_EXCLUSIVE_END	0xF7
+#define MIDI_SYSEX_NON_COMMERCIAL	0x7D
+#define MIDI_SYSEX_VOICE_SEARCH		0x01
+#define MIDI_SYSEX_SNAPSHOT_REQUEST	0x03
+#define MIDI_SYSEX_SNAPSHOT_DUMP	0x04
+#define MIDI_SYSEX_MORPH		0x05
 #define MIDI_TIMING_CLOCK	0xF8
 #define MIDI_ACTIVE_SENSING	0xFE
 
@@ -63,7 +69,9 @@ CMIDIDevice::TDeviceMap CMIDIDevice::s_DeviceMap;
 CMIDIDevice::CMIDIDevice (CMiniDexed *pSynthesizer, CConfig *pConfig, CUserInterface *pUI)
 :	m_pSynthesizer (pSynthesizer),
 	m_pConfig (pConfig),
-	m_pUI (pUI)
+	m_pUI (pUI),
+	m_bBankDumpReceived (false),
+	m_nBankDumpTG (0)
 {
 	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
 	{
@@ -95,43 +103,13 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 
 	if (m_pConfig->GetMIDIDumpEnabled ())
 	{
-		switch (nLength)
+		// formatted and printed later from the main loop
+		if (   nLength != 1
+		    || (   pMessage[0] != MIDI_TIMING_CLOCK
+			&& pMessage[0] != MIDI_ACTIVE_SENSING))
 		{
-		case 1:
-			if (   pMessage[0] != MIDI_TIMING_CLOCK
-			    && pMessage[0] != MIDI_ACTIVE_SENSING)
-			{
-				printf ("MIDI%u: %02X\n", nCable, (unsigned) pMessage[0]);
-			}
-			break;
-
-		case 2:
-			printf ("MIDI%u: %02X %02X\n", nCable,
-				(unsigned) pMessage[0], (unsigned) pMessage[1]);
-			break;
-
-		case 3:
-			printf ("MIDI%u: %02X %02X %02X\n", nCable,
-				(unsigned) pMessage[0], (unsigned) pMessage[1],
-				(unsigned) pMessage[2]);
-			break;
-		default:
-			switch(pMessage[0])
-			{
-				case MIDI_SYSTEM_EXCLUSIVE_BEGIN:
-					printf("MIDI%u: SysEx data length: [%d]:",nCable, uint16_t(nLength));
-					for (uint16_t i = 0; i < nLength; i++)
-					{
-						if((i % 16) == 0)
-							printf("\n%04d:",i);
-						printf(" 0x%02x",pMessage[i]);
-					}
-					printf("\n");
-					break;
-				default:
-					printf("MIDI%u: Unhandled MIDI event type %0x02x\n",nCable,pMessage[0]);
-			}
-			break;
+			CMIDITrace::Get ()->Write (CMIDITrace::RecordMessage, m_DeviceName.c_str (),
+						   nCable, pMessage, nLength);
 		}
 	}
 
@@ -175,7 +153,29 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 	u8 ucType    = ucStatus >> 4;
 
 	// GLOBAL MIDI SYSEX
-	if (pMessage[0] == MIDI_SYSTEM_EXCLUSIVE_BEGIN && pMessage[3] == 0x04 &&  pMessage[4] == 0x01 && pMessage[nLength-1] == MIDI_SYSTEM_EXCLUSIVE_END) // MASTER VOLUME
+	if (   pMessage[0] == MIDI_SYSTEM_EXCLUSIVE_BEGIN
+	    && nLength >= 3
+	    && pMessage[1] == MIDI_SYSEX_NON_COMMERCIAL
+	    && pMessage[2] == MIDI_SYSEX_VOICE_SEARCH)
+	{
+		m_pSynthesizer->VoiceSearchRequest (pMessage, nLength, this, nCable);
+	}
+	else if (   pMessage[0] == MIDI_SYSTEM_EXCLUSIVE_BEGIN
+		 && nLength >= 3
+		 && pMessage[1] == MIDI_SYSEX_NON_COMMERCIAL
+		 && (   pMessage[2] == MIDI_SYSEX_SNAPSHOT_REQUEST
+		     || pMessage[2] == MIDI_SYSEX_SNAPSHOT_DUMP))
+	{
+		m_pSynthesizer->SnapshotSysEx (pMessage, nLength, this, nCable);
+	}
+	else if (   pMessage[0] == MIDI_SYSTEM_EXCLUSIVE_BEGIN
+		 && nLength >= 3
+		 && pMessage[1] == MIDI_SYSEX_NON_COMMERCIAL
+		 && pMessage[2] == MIDI_SYSEX_MORPH)
+	{
+		m_pSynthesizer->MorphSysEx (pMessage, nLength);
+	}
+	else if (pMessage[0] == MIDI_SYSTEM_EXCLUSIVE_BEGIN && pMessage[3] == 0x04 &&  pMessage[4] == 0x01 && pMessage[nLength-1] == MIDI_SYSTEM_EXCLUSIVE_END) // MASTER VOLUME
 	{
 		float32_t nMasterVolume=((pMessage[5] & 0x7c) & ((pMessage[6] & 0x7c) <<7))/(1<<14);
 		LOGNOTE("Master volume: %f",nMasterVolume);
@@ -194,6 +194,38 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 				break;
 			}
 			m_pUI->UIMIDICmdHandler (ucChannel, ucStatus & 0xF0, pMessage[1], pMessage[2]);
+
+			// Bank Select on the Performance Select Channel selects the performance bank
+			if (   ucType == MIDI_CONTROL_CHANGE
+			    && m_pConfig->GetMIDIRXProgramChange() )
+			{
+				unsigned nPerfCh = m_pSynthesizer->GetPerformanceSelectChannel();
+				if (   nPerfCh != Disabled
+				    && (ucChannel == nPerfCh || nPerfCh == OmniMode))
+				{
+					if (pMessage[1] == MIDI_CC_BANK_SELECT_MSB)
+					{
+						m_pSynthesizer->PerformanceBankSelectMSB (pMessage[2]);
+					}
+					else if (pMessage[1] == MIDI_CC_BANK_SELECT_LSB)
+					{
+						m_pSynthesizer->PerformanceBankSelectLSB (pMessage[2]);
+					}
+				}
+			}
+
+			// the Morph Controller on the Performance Select Channel morphs between two performances
+			if (   ucType == MIDI_CONTROL_CHANGE
+			    && m_pConfig->GetMorphController () != 0
+			    && pMessage[1] == m_pConfig->GetMorphController ())
+			{
+				unsigned nPerfCh = m_pSynthesizer->GetPerformanceSelectChannel();
+				if (   nPerfCh != Disabled
+				    && (ucChannel == nPerfCh || nPerfCh == OmniMode))
+				{
+					m_pSynthesizer->SetMorphPosition (pMessage[2]);
+				}
+			}
 			break;
 		case MIDI_PROGRAM_CHANGE:
 			// Check for performance PC messages
@@ -212,6 +244,14 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 			break;
 		}
 
+		m_bBankDumpReceived = false;
+
+		// a SysEx message may change the same parameter of several TGs
+		if (ucStatus == MIDI_SYSTEM_EXCLUSIVE_BEGIN)
+		{
+			m_pSynthesizer->BeginParameterUpdate ();
+		}
+
 		// Process MIDI for each Tone Generator
 		for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
 		{
@@ -221,7 +261,11 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 				uint8_t ucSysExChannel = (pMessage[2] & 0x0F);
 				if (m_ChannelMap[nTG] == ucSysExChannel || m_ChannelMap[nTG] == OmniMode)
 				{
-					LOGNOTE("MIDI-SYSEX: channel: %u, len: %u, TG: %u",m_ChannelMap[nTG],nLength,nTG);
+					if (m_pConfig->GetMIDIDumpEnabled ())
+					{
+						CMIDITrace::Get ()->Write (CMIDITrace::RecordSysEx, m_DeviceName.c_str (),
+									   nCable, 0, nLength, m_ChannelMap[nTG], nTG);
+					}
 					HandleSystemExclusive(pMessage, nLength, nCable, nTG);
 				}
 			}
@@ -242,6 +286,7 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 						{
 							if (pMessage[2] <= 127)
 							{
+								CLatencyMeter::Get ()->NoteOn (m_DeviceName.c_str (), nTG);
 								m_pSynthesizer->keydown (pMessage[1],
 											 pMessage[2], nTG);
 							}
@@ -377,10 +422,85 @@ void CMIDIDevice::MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsign
 				}
 			}
 		}
+
+		if (ucStatus == MIDI_SYSTEM_EXCLUSIVE_BEGIN)
+		{
+			m_pSynthesizer->EndParameterUpdate ();
+		}
 	}
 	m_MIDISpinLock.Release ();
 }
 
+bool CMIDIDevice::BankDumpBegin (const u8 *pHeader, unsigned nCable)
+{
+	assert (pHeader);
+
+	if (   pHeader[0] != MIDI_SYSTEM_EXCLUSIVE_BEGIN
+	    || pHeader[1] != 0x43			// Yamaha
+	    || (pHeader[2] & 0xF0) != 0x00		// bulk dump
+	    || pHeader[3] != 0x09			// 32 voices
+	    || pHeader[4] != 0x20
+	    || pHeader[5] != 0x00)
+	{
+		return false;
+	}
+
+	// MIDI Thru needs the complete message
+	if (m_DeviceName.compare (m_pConfig->GetMIDIThruIn ()) == 0)
+	{
+		return false;
+	}
+
+	// the bank is selected on the first TG, which listens on the channel
+	u8 ucSysExChannel = pHeader[2] & 0x0F;
+	unsigned nTG;
+	for (nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		if (   m_ChannelMap[nTG] == ucSysExChannel
+		    || m_ChannelMap[nTG] == OmniMode)
+		{
+			break;
+		}
+	}
+
+	if (   nTG >= CConfig::ToneGenerators
+	    || !m_pSynthesizer->BankDumpStart ())
+	{
+		return false;
+	}
+
+	if (m_pConfig->GetMIDIDumpEnabled ())
+	{
+		CMIDITrace::Get ()->Write (CMIDITrace::RecordMessage, m_DeviceName.c_str (),
+					   nCable, pHeader, BankDumpHeaderLength);
+	}
+
+	m_nBankDumpTG = nTG;
+
+	m_pSynthesizer->BankDumpWrite (pHeader, BankDumpHeaderLength);
+
+	return true;
+}
+
+void CMIDIDevice::BankDumpData (const u8 *pData, size_t nLength)
+{
+	m_pSynthesizer->BankDumpWrite (pData, nLength);
+}
+
+void CMIDIDevice::BankDumpEnd (void)
+{
+	m_MIDISpinLock.Acquire ();
+
+	m_pSynthesizer->BankDumpEnd (m_nBankDumpTG);
+
+	m_MIDISpinLock.Release ();
+}
+
+void CMIDIDevice::BankDumpAbort (void)
+{
+	m_pSynthesizer->BankDumpAbort ();
+}
+
 void CMIDIDevice::AddDevice (const char *pDeviceName)
 {
 	assert (pDeviceName);
@@ -397,7 +517,11 @@ void CMIDIDevice::HandleSystemExclusive(const uint8_t* pMessage, const size_t nL
   int16_t sysex_return;
 
   sysex_return = m_pSynthesizer->checkSystemExclusive(pMessage, nLength, nTG);
-  LOGDBG("SYSEX handler return value: %d", sysex_return);
+  if (m_pConfig->GetMIDIDumpEnabled ())
+  {
+    CMIDITrace::Get ()->Write (CMIDITrace::RecordSysExResult, m_DeviceName.c_str (),
+                               nCable, pMessage, nLength, sysex_return, nTG);
+  }
 
   switch (sysex_return)
   {
@@ -434,75 +558,62 @@ void CMIDIDevice::HandleSystemExclusive(const uint8_t* pMessage, const size_t nL
       LOGERR("Unknown SysEx message.");
       break;
     case 64:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setMonoMode(pMessage[5],nTG);
       break;
     case 65:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setPitchbendRange(pMessage[5],nTG);
       break;
     case 66:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setPitchbendStep(pMessage[5],nTG);
       break;
     case 67:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setPortamentoMode(pMessage[5],nTG);
       break;
     case 68:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setPortamentoGlissando(pMessage[5],nTG);
       break;
     case 69:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setPortamentoTime(pMessage[5],nTG);
       break;
     case 70:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setModWheelRange(pMessage[5],nTG);
       break;
     case 71:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setModWheelTarget(pMessage[5],nTG);
       break;
     case 72:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setFootControllerRange(pMessage[5],nTG);
       break;
     case 73:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setFootControllerTarget(pMessage[5],nTG);
       break;
     case 74:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setBreathControllerRange(pMessage[5],nTG);
       break;
     case 75:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setBreathControllerTarget(pMessage[5],nTG);
       break;
     case 76:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setAftertouchRange(pMessage[5],nTG);
       break;
     case 77:
-      LOGDBG("SysEx Function parameter change: %d Value %d",pMessage[4],pMessage[5]);
       m_pSynthesizer->setAftertouchTarget(pMessage[5],nTG);
       break;
     case 100:
       // load sysex-data into voice memory
-      LOGDBG("One Voice bulk upload");
       m_pSynthesizer->loadVoiceParameters(pMessage,nTG);
       break;
     case 200:
-      LOGDBG("Bank bulk upload.");
-      //TODO: add code for storing a bank bulk upload
-      LOGNOTE("Currently code  for storing a bulk bank upload is missing!");
+      // store the bank only once, even if several TGs listen on its channel
+      if (!m_bBankDumpReceived)
+      {
+        m_bBankDumpReceived = true;
+        m_pSynthesizer->BankBulkDump(pMessage, nLength, nTG);
+      }
       break;
     default:
       if(sysex_return >= 300 && sysex_return < 500)
       {
-        LOGDBG("SysEx voice parameter change: Parameter %d value: %d",pMessage[4] + ((pMessage[3] & 0x03) * 128), pMessage[5]);
         m_pSynthesizer->setVoiceDataElement(pMessage[4] + ((pMessage[3] & 0x03) * 128), pMessage[5],nTG);
         switch(pMessage[4] + ((pMessage[3] & 0x03) * 128))
         {
@@ -513,7 +624,6 @@ void CMIDIDevice::HandleSystemExclusive(const uint8_t* pMessage, const size_t nL
       }
       else if(sysex_return >= 500 && sysex_return < 600)
       {
-        LOGDBG("SysEx send voice %u request",sysex_return-500);
         SendSystemExclusiveVoice(sysex_return-500, nCable, nTG);
       }
       break;
@@ -30,6 +30,8 @@
 #include <circle/spinlock.h>
 #include "userinterface.h"
 
+#define MAX_DX7_SYSEX_LENGTH 4104
+
 class CMiniDexed;
 
 class CMIDIDevice
@@ -57,6 +59,19 @@ protected:
 	void MIDIMessageHandler (const u8 *pMessage, size_t nLength, unsigned nCable = 0);
 	void AddDevice (const char *pDeviceName);
 	void HandleSystemExclusive(const uint8_t* pMessage, const size_t nLength, const unsigned nCable, const uint8_t nTG);
+
+	// DX7 bank bulk dumps are not assembled by the drivers, but written to the
+	// voice loader as they arrive. The driver calls BankDumpBegin() with the
+	// first BankDumpHeaderLength bytes of a SysEx message. If it returns true,
+	// the driver passes the following bytes up to and including F7 to
+	// BankDumpData() and calls BankDumpEnd() then, or BankDumpAbort(), if the
+	// message is cut off. Otherwise the message is assembled as usual.
+	static const unsigned BankDumpHeaderLength = 6;
+	bool BankDumpBegin (const u8 *pHeader, unsigned nCable);
+	void BankDumpData (const u8 *pData, size_t nLength);
+	void BankDumpEnd (void);
+	void BankDumpAbort (void);
+
 private:
 	CMiniDexed *m_pSynthesizer;
 	CConfig *m_pConfig;
@@ -66,6 +81,9 @@ private:
 
 	std::string m_DeviceName;
 
+	bool m_bBankDumpReceived;		// for the SysEx message in progress
+	unsigned m_nBankDumpTG;			// selects the bank dump, which is streamed
+
 	typedef std::unordered_map<std::string, CMIDIDevice *> TDeviceMap;
 	static TDeviceMap s_DeviceMap;
 
@@ -0,0 +1,546 @@
+//
+// midifileplayer.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "midifileplayer.h"
+#include <circle/logger.h>
+#include <string.h>
+#include <assert.h>
+
+LOGMODULE ("midifileplayer");
+
+#define MIDI_CONTROL_CHANGE		0xB0
+#define MIDI_CC_ALL_SOUND_OFF		120
+
+#define SMF_META_EVENT			0xFF
+#define SMF_META_END_OF_TRACK		0x2F
+#define SMF_META_SET_TEMPO		0x51
+
+CMIDIFilePlayer::CMIDIFilePlayer (CMiniDexed *pSynthesizer, CConfig *pConfig, CUserInterface *pUI)
+:	CMIDIDevice (pSynthesizer, pConfig, pUI),
+	m_pConfig (pConfig),
+	m_bFileOpen (false),
+	m_bLoop (false),
+	m_nSpeedPercent (100),
+	m_nTracks (0),
+	m_nDivision (96),
+	m_nTicksPerSecond (0),
+	m_nMicrosPerQuarter (500000),
+	m_nCurrentTick (0),
+	m_fCurrentSample (0.0),
+	m_nQueueIn (0),
+	m_nQueueDue (0),
+	m_nQueueOut (0),
+	m_nSampleTime (0),
+	m_bPlaying (false)
+{
+	AddDevice ("smf1");
+}
+
+CMIDIFilePlayer::~CMIDIFilePlayer (void)
+{
+	Stop ();
+}
+
+bool CMIDIFilePlayer::Start (const char *pFileName, bool bLoop, unsigned nSpeedPercent)
+{
+	assert (pFileName);
+
+	Stop ();
+
+	if (f_open (&m_File, pFileName, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		LOGWARN ("%s: Cannot open file", pFileName);
+
+		return false;
+	}
+	m_bFileOpen = true;
+
+	m_FileName = pFileName;
+	m_bLoop = bLoop;
+	m_nSpeedPercent = nSpeedPercent > 0 ? nSpeedPercent : 100;
+
+	if (!ReadHeader ())
+	{
+		LOGWARN ("%s: Invalid or unsupported MIDI file", pFileName);
+
+		Stop ();
+
+		return false;
+	}
+
+	RewindTracks ();
+
+	m_nQueueIn = 0;
+	m_nQueueDue = 0;
+	m_nQueueOut = 0;
+	m_nSampleTime = 0;
+
+	// give the main loop some time to fill the queue before the first event
+	m_nCurrentTick = 0;
+	m_fCurrentSample = (double) m_pConfig->GetSampleRate () * PrerollMillis / 1000;
+
+	LOGNOTE ("Playing %s (%u tracks)", pFileName, m_nTracks);
+
+	__atomic_store_n (&m_bPlaying, true, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void CMIDIFilePlayer::Stop (void)
+{
+	if (m_bPlaying)
+	{
+		__atomic_store_n (&m_bPlaying, false, __ATOMIC_RELEASE);
+
+		for (u8 ucChannel = 0; ucChannel < Channels; ucChannel++)
+		{
+			u8 Message[] = {(u8) (MIDI_CONTROL_CHANGE | ucChannel), MIDI_CC_ALL_SOUND_OFF, 0};
+			MIDIMessageHandler (Message, sizeof Message);
+		}
+	}
+
+	if (m_bFileOpen)
+	{
+		f_close (&m_File);
+
+		m_bFileOpen = false;
+	}
+}
+
+bool CMIDIFilePlayer::IsPlaying (void) const
+{
+	return m_bPlaying;
+}
+
+void CMIDIFilePlayer::Process (void)
+{
+	if (!m_bPlaying)
+	{
+		return;
+	}
+
+	// dispatch the events, which ProcessChunk() has released, here like
+	// the messages from the serial MIDI interface
+	unsigned nQueueDue = __atomic_load_n (&m_nQueueDue, __ATOMIC_ACQUIRE);
+	while (m_nQueueOut != nQueueDue)
+	{
+		const TEvent *pEvent = &m_Queue[m_nQueueOut & (QueueSize-1)];
+
+		MIDIMessageHandler (pEvent->Data, pEvent->nLength);
+
+		m_nQueueOut++;
+	}
+
+	// decode events in time order, until the queue is full
+	while (m_nQueueIn - m_nQueueOut < QueueSize)
+	{
+		TTrack *pNext = nullptr;
+		for (unsigned i = 0; i < m_nTracks; i++)
+		{
+			if (   !m_Track[i].bEnd
+			    && (   !pNext
+				|| m_Track[i].nNextTick < pNext->nNextTick))
+			{
+				pNext = &m_Track[i];
+			}
+		}
+
+		if (!pNext)
+		{
+			if (   m_bLoop
+			    && m_nCurrentTick > 0)
+			{
+				// continue seamlessly after the end of the longest track
+				RewindTracks ();
+
+				m_nCurrentTick = 0;
+				m_nMicrosPerQuarter = 500000;
+
+				continue;
+			}
+
+			if (m_nQueueIn == m_nQueueOut)
+			{
+				LOGNOTE ("%s: Finished", m_FileName.c_str ());
+
+				Stop ();
+			}
+
+			return;
+		}
+
+		// the tempo may change at any tick, so convert stepwise
+		m_fCurrentSample += (double) (pNext->nNextTick - m_nCurrentTick) * GetSamplesPerTick ();
+		m_nCurrentTick = pNext->nNextTick;
+
+		TEvent *pEvent = &m_Queue[m_nQueueIn & (QueueSize-1)];
+		if (ReadEvent (pNext, pEvent))
+		{
+			pEvent->nSample = (u64) m_fCurrentSample;
+
+			__atomic_store_n (&m_nQueueIn, m_nQueueIn+1, __ATOMIC_RELEASE);
+		}
+
+		if (!pNext->bEnd)
+		{
+			ReadDeltaTime (pNext);
+		}
+	}
+}
+
+void CMIDIFilePlayer::ProcessChunk (unsigned nFrames)
+{
+	if (!__atomic_load_n (&m_bPlaying, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+
+	u64 nChunkEnd = m_nSampleTime + nFrames;
+
+	unsigned nQueueDue = m_nQueueDue;
+	while (nQueueDue != __atomic_load_n (&m_nQueueIn, __ATOMIC_ACQUIRE))
+	{
+		const TEvent *pEvent = &m_Queue[nQueueDue & (QueueSize-1)];
+		if (pEvent->nSample >= nChunkEnd)
+		{
+			break;
+		}
+
+		nQueueDue++;
+	}
+
+	__atomic_store_n (&m_nQueueDue, nQueueDue, __ATOMIC_RELEASE);
+
+	m_nSampleTime = nChunkEnd;
+}
+
+bool CMIDIFilePlayer::ReadHeader (void)
+{
+	u8 Header[14];
+	UINT nBytesRead;
+	if (   f_read (&m_File, Header, sizeof Header, &nBytesRead) != FR_OK
+	    || nBytesRead != sizeof Header
+	    || memcmp (Header, "MThd", 4) != 0)
+	{
+		return false;
+	}
+
+	u32 nHeaderSize = Header[4] << 24 | Header[5] << 16 | Header[6] << 8 | Header[7];
+	unsigned nFormat = Header[8] << 8 | Header[9];
+	unsigned nTracks = Header[10] << 8 | Header[11];
+	unsigned nDivision = Header[12] << 8 | Header[13];
+
+	if (   nHeaderSize < 6
+	    || nFormat > 1
+	    || nDivision == 0)
+	{
+		return false;
+	}
+
+	if (nDivision & 0x8000)
+	{
+		// SMPTE format: negative frames per second, ticks per frame
+		unsigned nFramesPerSecond = -(s8) (nDivision >> 8);
+		m_nTicksPerSecond = nFramesPerSecond * (nDivision & 0xFF);
+		if (m_nTicksPerSecond == 0)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		m_nTicksPerSecond = 0;
+		m_nDivision = nDivision;
+	}
+
+	if (nTracks > MaxTracks)
+	{
+		LOGWARN ("Only %u of %u tracks will be played", MaxTracks, nTracks);
+
+		nTracks = MaxTracks;
+	}
+
+	// locate the track chunks, unknown chunks are skipped
+	FSIZE_t nOffset = 8 + nHeaderSize;
+	m_nTracks = 0;
+	while (m_nTracks < nTracks)
+	{
+		u8 Chunk[8];
+		if (   f_lseek (&m_File, nOffset) != FR_OK
+		    || f_read (&m_File, Chunk, sizeof Chunk, &nBytesRead) != FR_OK
+		    || nBytesRead != sizeof Chunk)
+		{
+			break;
+		}
+
+		u32 nSize = Chunk[4] << 24 | Chunk[5] << 16 | Chunk[6] << 8 | Chunk[7];
+
+		if (memcmp (Chunk, "MTrk", 4) == 0)
+		{
+			m_Track[m_nTracks].nStart = nOffset + 8;
+			m_Track[m_nTracks].nSize = nSize;
+			m_nTracks++;
+		}
+
+		nOffset += 8 + nSize;
+	}
+
+	return m_nTracks > 0;
+}
+
+void CMIDIFilePlayer::RewindTracks (void)
+{
+	for (unsigned i = 0; i < m_nTracks; i++)
+	{
+		TTrack *pTrack = &m_Track[i];
+
+		pTrack->nRead = 0;
+		pTrack->nBufferPos = 0;
+		pTrack->nBufferLen = 0;
+		pTrack->bEnd = false;
+		pTrack->ucRunningStatus = 0;
+		pTrack->nNextTick = 0;
+
+		ReadDeltaTime (pTrack);
+	}
+}
+
+bool CMIDIFilePlayer::ReadByte (TTrack *pTrack, u8 *pByte)
+{
+	assert (pTrack);
+
+	if (pTrack->nBufferPos >= pTrack->nBufferLen)
+	{
+		if (pTrack->nRead >= pTrack->nSize)
+		{
+			return false;
+		}
+
+		unsigned nChunk = pTrack->nSize - pTrack->nRead;
+		if (nChunk > TrackBufferSize)
+		{
+			nChunk = TrackBufferSize;
+		}
+
+		// all tracks share one file handle
+		UINT nBytesRead;
+		if (   f_lseek (&m_File, pTrack->nStart + pTrack->nRead) != FR_OK
+		    || f_read (&m_File, pTrack->Buffer, nChunk, &nBytesRead) != FR_OK
+		    || nBytesRead != nChunk)
+		{
+			return false;
+		}
+
+		pTrack->nRead += nChunk;
+		pTrack->nBufferPos = 0;
+		pTrack->nBufferLen = nChunk;
+	}
+
+	*pByte = pTrack->Buffer[pTrack->nBufferPos++];
+
+	return true;
+}
+
+bool CMIDIFilePlayer::ReadVarLen (TTrack *pTrack, u32 *pValue)
+{
+	u32 nValue = 0;
+
+	for (unsigned i = 0; i < 4; i++)
+	{
+		u8 ucByte;
+		if (!ReadByte (pTrack, &ucByte))
+		{
+			return false;
+		}
+
+		nValue = nValue << 7 | (ucByte & 0x7F);
+
+		if (!(ucByte & 0x80))
+		{
+			*pValue = nValue;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CMIDIFilePlayer::Skip (TTrack *pTrack, u32 nBytes)
+{
+	while (nBytes--)
+	{
+		u8 ucByte;
+		if (!ReadByte (pTrack, &ucByte))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CMIDIFilePlayer::ReadDeltaTime (TTrack *pTrack)
+{
+	u32 nDelta;
+	if (!ReadVarLen (pTrack, &nDelta))
+	{
+		pTrack->bEnd = true;
+
+		return false;
+	}
+
+	pTrack->nNextTick += nDelta;
+
+	return true;
+}
+
+bool CMIDIFilePlayer::ReadEvent (TTrack *pTrack, TEvent *pEvent)
+{
+	u8 ucStatus;
+	if (!ReadByte (pTrack, &ucStatus))
+	{
+		pTrack->bEnd = true;
+
+		return false;
+	}
+
+	u8 ucData1 = 0;
+	bool bHaveData1 = false;
+	if (!(ucStatus & 0x80))
+	{
+		// running status
+		if (!pTrack->ucRunningStatus)
+		{
+			pTrack->bEnd = true;
+
+			return false;
+		}
+
+		ucData1 = ucStatus;
+		bHaveData1 = true;
+		ucStatus = pTrack->ucRunningStatus;
+	}
+	else if (ucStatus >= 0xF0)
+	{
+		pTrack->ucRunningStatus = 0;	// cancelled by meta and SysEx events
+	}
+
+	if (ucStatus == SMF_META_EVENT)
+	{
+		u8 ucType;
+		u32 nLength;
+		if (   !ReadByte (pTrack, &ucType)
+		    || !ReadVarLen (pTrack, &nLength))
+		{
+			pTrack->bEnd = true;
+
+			return false;
+		}
+
+		if (   ucType == SMF_META_SET_TEMPO
+		    && nLength == 3)
+		{
+			u8 Tempo[3];
+			if (   !ReadByte (pTrack, &Tempo[0])
+			    || !ReadByte (pTrack, &Tempo[1])
+			    || !ReadByte (pTrack, &Tempo[2]))
+			{
+				pTrack->bEnd = true;
+
+				return false;
+			}
+
+			m_nMicrosPerQuarter = Tempo[0] << 16 | Tempo[1] << 8 | Tempo[2];
+
+			return false;
+		}
+
+		if (   ucType == SMF_META_END_OF_TRACK
+		    || !Skip (pTrack, nLength))
+		{
+			pTrack->bEnd = true;
+		}
+
+		return false;
+	}
+
+	if (   ucStatus == 0xF0
+	    || ucStatus == 0xF7)
+	{
+		// SysEx events in files are not played
+		u32 nLength;
+		if (   !ReadVarLen (pTrack, &nLength)
+		    || !Skip (pTrack, nLength))
+		{
+			pTrack->bEnd = true;
+		}
+
+		return false;
+	}
+
+	if (ucStatus >= 0xF0)
+	{
+		pTrack->bEnd = true;		// not allowed in MIDI files
+
+		return false;
+	}
+
+	pTrack->ucRunningStatus = ucStatus;
+
+	pEvent->Data[0] = ucStatus;
+	pEvent->nLength = (ucStatus & 0xE0) == 0xC0 ? 2 : 3;	// program change, channel aftertouch
+
+	if (   !bHaveData1
+	    && !ReadByte (pTrack, &ucData1))
+	{
+		pTrack->bEnd = true;
+
+		return false;
+	}
+	pEvent->Data[1] = ucData1;
+
+	if (   pEvent->nLength == 3
+	    && !ReadByte (pTrack, &pEvent->Data[2]))
+	{
+		pTrack->bEnd = true;
+
+		return false;
+	}
+
+	return true;
+}
+
+double CMIDIFilePlayer::GetSamplesPerTick (void) const
+{
+	double fSamplesPerTick;
+
+	if (m_nTicksPerSecond != 0)
+	{
+		fSamplesPerTick = (double) m_pConfig->GetSampleRate () / m_nTicksPerSecond;
+	}
+	else
+	{
+		assert (m_nDivision > 0);
+		fSamplesPerTick =   (double) m_pConfig->GetSampleRate () * m_nMicrosPerQuarter
+				  / (1000000.0 * m_nDivision);
+	}
+
+	return fSamplesPerTick * 100 / m_nSpeedPercent;
+}
@@ -0,0 +1,126 @@
+//
+// midifileplayer.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _midifileplayer_h
+#define _midifileplayer_h
+
+#include "mididevice.h"
+#include "config.h"
+#include <fatfs/ff.h>
+#include <circle/types.h>
+#include <string>
+
+class CMiniDexed;
+
+// Standard MIDI File (type 0 and 1) player for reproducible load tests.
+// The main loop streams the file from SD in small chunks per track and
+// queues the decoded events with their sample time. ProcessSound() releases
+// the events, which are due within the next chunk, and the main loop passes
+// them to MIDIMessageHandler() like from an external device. So the audio
+// core only advances the clock, the events are handled on core 0.
+class CMIDIFilePlayer : public CMIDIDevice
+{
+public:
+	static const unsigned MaxTracks = 16;
+	static const unsigned TrackBufferSize = 256;
+	static const unsigned QueueSize = 256;		// must be a power of 2
+	static const unsigned PrerollMillis = 100;
+
+public:
+	CMIDIFilePlayer (CMiniDexed *pSynthesizer, CConfig *pConfig, CUserInterface *pUI);
+	~CMIDIFilePlayer (void);
+
+	bool Start (const char *pFileName, bool bLoop, unsigned nSpeedPercent);
+	void Stop (void);
+
+	bool IsPlaying (void) const;
+
+	// called from the main loop, dispatches the due events and reads ahead from SD
+	void Process (void);
+
+	// called from ProcessSound() before the next chunk is rendered, releases the due events
+	void ProcessChunk (unsigned nFrames);
+
+private:
+	struct TTrack
+	{
+		FSIZE_t nStart;			// file offset of the track data
+		unsigned nSize;
+		unsigned nRead;			// bytes loaded from file so far
+
+		u8 Buffer[TrackBufferSize];
+		unsigned nBufferPos;
+		unsigned nBufferLen;
+
+		bool bEnd;
+		u8 ucRunningStatus;
+		u64 nNextTick;			// absolute time of the pending event
+	};
+
+	struct TEvent
+	{
+		u64 nSample;
+		u8 Data[3];
+		u8 nLength;
+	};
+
+	bool ReadHeader (void);
+	void RewindTracks (void);
+
+	bool ReadByte (TTrack *pTrack, u8 *pByte);
+	bool ReadVarLen (TTrack *pTrack, u32 *pValue);
+	bool Skip (TTrack *pTrack, u32 nBytes);
+	bool ReadDeltaTime (TTrack *pTrack);
+
+	bool ReadEvent (TTrack *pTrack, TEvent *pEvent);	// false if meta event only
+
+	double GetSamplesPerTick (void) const;
+
+private:
+	CConfig *m_pConfig;
+
+	FIL m_File;
+	bool m_bFileOpen;
+
+	std::string m_FileName;
+	bool m_bLoop;
+	unsigned m_nSpeedPercent;
+
+	unsigned m_nTracks;
+	TTrack m_Track[MaxTracks];
+
+	unsigned m_nDivision;			// ticks per quarter note
+	unsigned m_nTicksPerSecond;		// != 0 for SMPTE time division
+	unsigned m_nMicrosPerQuarter;
+
+	u64 m_nCurrentTick;
+	double m_fCurrentSample;		// sample time of m_nCurrentTick
+
+	// filled and emptied by the main loop, the audio core moves m_nQueueDue
+	TEvent m_Queue[QueueSize];
+	volatile unsigned m_nQueueIn;		// next event to be decoded
+	volatile unsigned m_nQueueDue;		// events before are due
+	volatile unsigned m_nQueueOut;		// next event to be dispatched
+
+	volatile u64 m_nSampleTime;		// frames rendered since start
+
+	volatile bool m_bPlaying;
+};
+
+#endif
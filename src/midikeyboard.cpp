@@ -43,6 +43,12 @@ CMIDIKeyboard::CMIDIKeyboard (CMiniDexed *pSynthesizer, CConfig *pConfig, CUserI
 	assert (m_nInstance < MaxInstances);
 	s_pThis[m_nInstance] = this;
 
+	m_SysEx.nCable = MaxCables;
+	m_SysEx.nLength = 0;
+	m_SysEx.bOverflow = false;
+	m_SysEx.bBankDump = false;
+	m_usDroppedSysEx = 0;
+
 	m_DeviceName.Format ("umidi%u", nInstance+1);
 
 	AddDevice (m_DeviceName);
@@ -100,28 +106,157 @@ void CMIDIKeyboard::Send (const u8 *pMessage, size_t nLength, unsigned nCable)
 	m_SendQueue.push (Entry);
 }
 
+void CMIDIKeyboard::USBMIDIMessageHandler (u8 *pPacket, unsigned nLength, unsigned nCable)
+{
+	assert (nCable < MaxCables);
+	TSysExAssembler *pSysEx = &m_SysEx;
+	u16 usCableMask = 1 << nCable;
+
+	if (   pSysEx->nCable != nCable
+	    && !(m_usDroppedSysEx & usCableMask))
+	{
+		if (   nLength == 0
+		    || (pPacket[0] & 0x80) == 0		// continuation of a SysEx we did not see start
+		    || pPacket[0] == 0xF7)
+		{
+			return;
+		}
+
+		if (pPacket[0] != 0xF0)
+		{
+			// no SysEx in progress, ordinary message
+			MIDIMessageHandler (pPacket, nLength, nCable);
+
+			return;
+		}
+	}
+
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		u8 uchData = pPacket[i];
+
+		if (uchData >= 0xF8)
+		{
+			// System Real Time messages may appear anywhere in the byte stream
+			MIDIMessageHandler (&pPacket[i], 1, nCable);
+
+			continue;
+		}
+
+		if (uchData == 0xF0)
+		{
+			if (   pSysEx->nCable == MaxCables
+			    || pSysEx->nCable == nCable)
+			{
+				if (pSysEx->bBankDump)
+				{
+					BankDumpAbort ();
+					pSysEx->bBankDump = false;
+				}
+
+				pSysEx->nCable = nCable;
+				pSysEx->nLength = 0;
+				pSysEx->bOverflow = false;
+
+				m_usDroppedSysEx &= ~usCableMask;
+			}
+			else
+			{
+				// buffer is in use by another cable
+				m_usDroppedSysEx |= usCableMask;
+			}
+		}
+		else if (   (uchData & 0x80) == 0x80
+			 && uchData != 0xF7)
+		{
+			// unterminated SysEx, a new status byte aborts it
+			if (pSysEx->nCable == nCable)
+			{
+				if (pSysEx->bBankDump)
+				{
+					BankDumpAbort ();
+					pSysEx->bBankDump = false;
+				}
+
+				pSysEx->nCable = MaxCables;
+			}
+			m_usDroppedSysEx &= ~usCableMask;
+
+			MIDIMessageHandler (&pPacket[i], nLength-i, nCable);
+
+			return;
+		}
+
+		if (pSysEx->nCable != nCable)
+		{
+			if (uchData == 0xF7)
+			{
+				m_usDroppedSysEx &= ~usCableMask;
+			}
+
+			continue;
+		}
+
+		if (pSysEx->bBankDump)
+		{
+			// a bank dump is written to the voice loader as it arrives
+			BankDumpData (&uchData, 1);
+		}
+		else if (pSysEx->nLength < MAX_DX7_SYSEX_LENGTH)
+		{
+			pSysEx->Buffer[pSysEx->nLength++] = uchData;
+
+			if (   pSysEx->nLength == BankDumpHeaderLength
+			    && BankDumpBegin (pSysEx->Buffer, nCable))
+			{
+				pSysEx->bBankDump = true;
+			}
+		}
+		else
+		{
+			pSysEx->bOverflow = true;
+		}
+
+		if (uchData == 0xF7)
+		{
+			if (pSysEx->bBankDump)
+			{
+				BankDumpEnd ();
+				pSysEx->bBankDump = false;
+			}
+			else if (!pSysEx->bOverflow)
+			{
+				// handed over in place, the buffer is not touched until we return
+				MIDIMessageHandler (pSysEx->Buffer, pSysEx->nLength, nCable);
+			}
+
+			pSysEx->nCable = MaxCables;
+		}
+	}
+}
+
 void CMIDIKeyboard::MIDIPacketHandler0 (unsigned nCable, u8 *pPacket, unsigned nLength)
 {
 	assert (s_pThis[0] != 0);
-	s_pThis[0]->MIDIMessageHandler (pPacket, nLength, nCable);
+	s_pThis[0]->USBMIDIMessageHandler (pPacket, nLength, nCable);
 }
 
 void CMIDIKeyboard::MIDIPacketHandler1 (unsigned nCable, u8 *pPacket, unsigned nLength)
 {
 	assert (s_pThis[1] != 0);
-	s_pThis[1]->MIDIMessageHandler (pPacket, nLength, nCable);
+	s_pThis[1]->USBMIDIMessageHandler (pPacket, nLength, nCable);
 }
 
 void CMIDIKeyboard::MIDIPacketHandler2 (unsigned nCable, u8 *pPacket, unsigned nLength)
 {
 	assert (s_pThis[2] != 0);
-	s_pThis[2]->MIDIMessageHandler (pPacket, nLength, nCable);
+	s_pThis[2]->USBMIDIMessageHandler (pPacket, nLength, nCable);
 }
 
 void CMIDIKeyboard::MIDIPacketHandler3 (unsigned nCable, u8 *pPacket, unsigned nLength)
 {
 	assert (s_pThis[3] != 0);
-	s_pThis[3]->MIDIMessageHandler (pPacket, nLength, nCable);
+	s_pThis[3]->USBMIDIMessageHandler (pPacket, nLength, nCable);
 }
 
 void CMIDIKeyboard::DeviceRemovedHandler (CDevice *pDevice, void *pContext)
@@ -130,4 +265,12 @@ void CMIDIKeyboard::DeviceRemovedHandler (CDevice *pDevice, void *pContext)
 	assert (pThis != 0);
 
 	pThis->m_pMIDIDevice = 0;
+
+	// no more packets will arrive for an unfinished SysEx
+	if (pThis->m_SysEx.bBankDump)
+	{
+		pThis->BankDumpAbort ();
+		pThis->m_SysEx.bBankDump = false;
+	}
+	pThis->m_SysEx.nCable = MaxCables;
 }
@@ -37,6 +37,7 @@ class CMIDIKeyboard : public CMIDIDevice
 {
 public:
 	static const unsigned MaxInstances = 4;
+	static const unsigned MaxCables = 16;
 
 public:
 	CMIDIKeyboard (CMiniDexed *pSynthesizer, CConfig *pConfig, CUserInterface *pUI, unsigned nInstance = 0);
@@ -47,6 +48,8 @@ public:
 	void Send (const u8 *pMessage, size_t nLength, unsigned nCable = 0) override;
 
 private:
+	void USBMIDIMessageHandler (u8 *pPacket, unsigned nLength, unsigned nCable);
+
 	static void MIDIPacketHandler0 (unsigned nCable, u8 *pPacket, unsigned nLength);
 	static void MIDIPacketHandler1 (unsigned nCable, u8 *pPacket, unsigned nLength);
 	static void MIDIPacketHandler2 (unsigned nCable, u8 *pPacket, unsigned nLength);
@@ -62,6 +65,20 @@ private:
 		unsigned nCable;
 	};
 
+	// SysEx arrives in fragments of up to 3 bytes (one USB event packet each)
+	// and is assembled here, before it is handed over as one message. There
+	// is one buffer per device, which is owned by the cable, on which the
+	// SysEx started. A SysEx on another cable in the meantime is dropped.
+	// A bank bulk dump is not assembled, but streamed after its header.
+	struct TSysExAssembler
+	{
+		unsigned nCable;		// MaxCables if no SysEx in progress
+		unsigned nLength;
+		bool	 bOverflow;		// message too long, is dropped at its end
+		bool	 bBankDump;		// streamed with CMIDIDevice::BankDumpData()
+		u8	 Buffer[MAX_DX7_SYSEX_LENGTH];
+	};
+
 private:
 	unsigned m_nInstance;
 	CString m_DeviceName;
@@ -70,6 +87,9 @@ private:
 
 	std::queue<TSendQueueEntry> m_SendQueue;
 
+	TSysExAssembler m_SysEx;
+	u16 m_usDroppedSysEx;			// bit mask of cables
+
 	static CMIDIKeyboard *s_pThis[MaxInstances];
 
 	static TMIDIPacketHandler * const s_pMIDIPacketHandler[MaxInstances];
@@ -0,0 +1,217 @@
+//
+// miditrace.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "miditrace.h"
+#include <circle/timer.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define MIDI_SYSTEM_EXCLUSIVE_BEGIN	0xF0
+
+CMIDITrace *CMIDITrace::s_pThis = 0;
+
+CMIDITrace::CMIDITrace (void)
+:	m_nWriteIndex (0),
+	m_nReadIndex (0),
+	m_nDropped (0)
+{
+	assert ((Records & (Records-1)) == 0);
+
+	for (unsigned i = 0; i < Records; i++)
+	{
+		m_Record[i].nSequence = i;
+	}
+
+	assert (!s_pThis);
+	s_pThis = this;
+}
+
+CMIDITrace::~CMIDITrace (void)
+{
+	s_pThis = 0;
+}
+
+// Bounded multi-producer/single-consumer ring: Each record carries a
+// sequence number, which tells if it is free for the producer claiming
+// index nPos (nSequence == nPos) or ready for the consumer (nPos + 1).
+void CMIDITrace::Write (TRecordType Type, const char *pDevice, unsigned nCable,
+			const u8 *pData, size_t nLength, int nValue, unsigned nTG)
+{
+	TRecord *pRecord;
+	u32 nPos = __atomic_load_n (&m_nWriteIndex, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		pRecord = &m_Record[nPos & (Records-1)];
+
+		u32 nSequence = __atomic_load_n (&pRecord->nSequence, __ATOMIC_ACQUIRE);
+		int nDiff = (int) (nSequence - nPos);
+		if (nDiff == 0)
+		{
+			if (__atomic_compare_exchange_n (&m_nWriteIndex, &nPos, nPos+1, false,
+							 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (nDiff < 0)
+		{
+			// ring is full, never wait for the main loop here
+			__atomic_fetch_add (&m_nDropped, 1, __ATOMIC_RELAXED);
+
+			return;
+		}
+		else
+		{
+			nPos = __atomic_load_n (&m_nWriteIndex, __ATOMIC_RELAXED);
+		}
+	}
+
+	pRecord->nTicks = CTimer::GetClockTicks ();
+	pRecord->pDevice = pDevice;
+	pRecord->nLength = nLength > 0xFFFF ? 0xFFFF : (u16) nLength;
+	pRecord->ucType = (u8) Type;
+	pRecord->ucCable = (u8) nCable;
+	pRecord->ucTG = (u8) nTG;
+	pRecord->nValue = nValue;
+
+	if (pData != 0)
+	{
+		memcpy (pRecord->Data, pData, nLength < MaxDataBytes ? nLength : MaxDataBytes);
+	}
+
+	__atomic_store_n (&pRecord->nSequence, nPos+1, __ATOMIC_RELEASE);
+}
+
+void CMIDITrace::Dump (void)
+{
+	for (unsigned i = 0; i < MaxDumpPerCall; i++)
+	{
+		TRecord *pRecord = &m_Record[m_nReadIndex & (Records-1)];
+
+		if (__atomic_load_n (&pRecord->nSequence, __ATOMIC_ACQUIRE) != m_nReadIndex+1)
+		{
+			break;
+		}
+
+		DumpRecord (*pRecord);
+
+		__atomic_store_n (&pRecord->nSequence, m_nReadIndex+Records, __ATOMIC_RELEASE);
+		m_nReadIndex++;
+	}
+
+	u32 nDropped = __atomic_exchange_n (&m_nDropped, 0, __ATOMIC_RELAXED);
+	if (nDropped > 0)
+	{
+		printf ("MIDI trace: %u record(s) dropped\n", (unsigned) nDropped);
+	}
+}
+
+CMIDITrace *CMIDITrace::Get (void)
+{
+	assert (s_pThis);
+	return s_pThis;
+}
+
+void CMIDITrace::DumpRecord (const TRecord &rRecord)
+{
+	const u8 *pData = rRecord.Data;
+	unsigned nLength = rRecord.nLength;
+	unsigned nStored = nLength < MaxDataBytes ? nLength : MaxDataBytes;
+
+	printf ("%10u %s: ", rRecord.nTicks / (CLOCKHZ / 1000000),
+		rRecord.pDevice ? rRecord.pDevice : "-");
+
+	switch (rRecord.ucType)
+	{
+	case RecordMessage:
+		if (   nLength > 3
+		    && pData[0] == MIDI_SYSTEM_EXCLUSIVE_BEGIN)
+		{
+			printf ("MIDI%u: SysEx data length: [%u]:", (unsigned) rRecord.ucCable, nLength);
+		}
+		else if (nLength > 3)
+		{
+			printf ("MIDI%u: Unhandled MIDI event type 0x%02x", (unsigned) rRecord.ucCable,
+				(unsigned) pData[0]);
+			nStored = 0;
+		}
+		else
+		{
+			printf ("MIDI%u:", (unsigned) rRecord.ucCable);
+		}
+		break;
+
+	case RecordSerialData:
+		printf ("Incoming MIDI data [%u]:", nLength);
+		break;
+
+	case RecordSysEx:
+		printf ("MIDI-SYSEX: channel: %d, len: %u, TG: %u\n", rRecord.nValue,
+			nLength, (unsigned) rRecord.ucTG);
+		return;
+
+	case RecordSysExResult:
+		printf ("SYSEX handler return value: %d, TG: %u", rRecord.nValue,
+			(unsigned) rRecord.ucTG);
+
+		if (   rRecord.nValue >= 64 && rRecord.nValue <= 77
+		    && nStored >= 6)
+		{
+			printf (" (function parameter change: %u value %u)",
+				(unsigned) pData[4], (unsigned) pData[5]);
+		}
+		else if (rRecord.nValue == 100)
+		{
+			printf (" (one voice bulk upload)");
+		}
+		else if (rRecord.nValue == 200)
+		{
+			printf (" (bank bulk upload)");
+		}
+		else if (   rRecord.nValue >= 300 && rRecord.nValue < 500
+			 && nStored >= 6)
+		{
+			printf (" (voice parameter change: %u value %u)",
+				(unsigned) pData[4] + ((pData[3] & 0x03) * 128), (unsigned) pData[5]);
+		}
+		else if (rRecord.nValue >= 500 && rRecord.nValue < 600)
+		{
+			printf (" (send voice %d request)", rRecord.nValue-500);
+		}
+		printf ("\n");
+		return;
+
+	default:
+		printf ("Unknown trace record\n");
+		return;
+	}
+
+	for (unsigned i = 0; i < nStored; i++)
+	{
+		printf (" %02X", (unsigned) pData[i]);
+	}
+
+	if (nStored < nLength)
+	{
+		printf (" ...");
+	}
+
+	printf ("\n");
+}
@@ -0,0 +1,82 @@
+//
+// miditrace.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _miditrace_h
+#define _miditrace_h
+
+#include <circle/types.h>
+
+// Deferred MIDI dump: The receive path only copies the raw bytes and a
+// timestamp into a lock-free ring buffer. The formatting and printing is
+// done later from the main loop (Dump()), so that enabling the dump does
+// not change the timing of the MIDI handling itself.
+class CMIDITrace
+{
+public:
+	enum TRecordType
+	{
+		RecordMessage,		// complete MIDI message (Data = first bytes)
+		RecordSerialData,	// raw data read from the serial interface
+		RecordSysEx,		// SysEx routed to a TG (nValue = TG channel)
+		RecordSysExResult	// result of checkSystemExclusive() (nValue)
+	};
+
+	static const unsigned Records = 256;		// must be a power of 2
+	static const unsigned MaxDataBytes = 16;	// bytes stored per record
+	static const unsigned MaxDumpPerCall = 16;	// records printed per Dump()
+
+public:
+	CMIDITrace (void);
+	~CMIDITrace (void);
+
+	// may be called from any context (IRQ, main loop), never blocks
+	void Write (TRecordType Type, const char *pDevice, unsigned nCable,
+		    const u8 *pData, size_t nLength, int nValue = 0, unsigned nTG = 0);
+
+	// called from the main loop only
+	void Dump (void);
+
+	static CMIDITrace *Get (void);
+
+private:
+	struct TRecord
+	{
+		volatile u32 nSequence;
+		unsigned nTicks;
+		const char *pDevice;
+		u16 nLength;		// original length of the data
+		u8 ucType;
+		u8 ucCable;
+		u8 ucTG;
+		int nValue;
+		u8 Data[MaxDataBytes];
+	};
+
+	void DumpRecord (const TRecord &rRecord);
+
+	TRecord m_Record[Records];
+
+	u32 m_nWriteIndex;		// next record to be claimed by a producer
+	u32 m_nReadIndex;		// next record to be printed
+	u32 m_nDropped;			// records lost because the ring was full
+
+	static CMIDITrace *s_pThis;
+};
+
+#endif
@@ -18,18 +18,23 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include "minidexed.h"
+#include "bootprofiler.h"
 #include <circle/logger.h>
 #include <circle/memory.h>
 #include <circle/sound/pwmsoundbasedevice.h>
 #include <circle/sound/i2ssoundbasedevice.h>
 #include <circle/sound/hdmisoundbasedevice.h>
 #include <circle/gpiopin.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
 
 LOGMODULE ("minidexed");
 
+static_assert (CMiniDexed::TGParameterUnknown <= CParameterStore::MaxParameters,
+	       "Too many TG parameters for CParameterStore");
+
 CMiniDexed::CMiniDexed (CConfig *pConfig, CInterruptSystem *pInterrupt,
 			CGPIOManager *pGPIOManager, CI2CMaster *pI2CMaster, FATFS *pFileSystem)
 :
@@ -42,6 +47,10 @@ CMiniDexed::CMiniDexed (CConfig *pConfig, CInterruptSystem *pInterrupt,
 	m_PCKeyboard (this, pConfig, &m_UI),
 	m_SerialMIDI (this, pInterrupt, pConfig, &m_UI),
 	m_bUseSerial (false),
+	m_MIDIFilePlayer (this, pConfig, &m_UI),
+	m_pVoiceSearchDevice (nullptr),
+	m_pSnapshotRequestDevice (nullptr),
+	m_bSnapshotReceived (false),
 	m_pSoundDevice (0),
 	m_bChannelsSwapped (pConfig->GetChannelsSwapped ()),
 #ifdef ARM_ALLOW_MULTI_CORE
@@ -49,46 +58,64 @@ CMiniDexed::CMiniDexed (CConfig *pConfig, CInterruptSystem *pInterrupt,
 #endif
 	m_GetChunkTimer ("GetChunk",
 			 1000000U * pConfig->GetChunkSize ()/2 / pConfig->GetSampleRate ()),
+	m_VoiceSwapTimer ("VoiceSwap"),
 	m_bProfileEnabled (m_pConfig->GetProfileEnabled ()),
+	m_LatencyMeter (this, pConfig->GetLatencyMeterEnabled (),
+			pConfig->GetLatencyTestInterval (), pConfig->GetSampleRate ()),
 	m_bSavePerformance (false),
 	m_bSavePerformanceNewFile (false),
 	m_bSetNewPerformance (false),
 	m_bDeletePerformance (false),
-	m_bLoadPerformanceBusy(false)
+	m_bLoadPerformanceBusy(false),
+	m_nPerformanceBankMSB (0),
+	m_nPerformanceBank (0),
+	m_nSwitchTG (0),
+	m_bPerformanceSwitchPending (false),
+	m_bSetMorphPerformances (false),
+	m_nMorphTarget (0),
+	m_nMorphPosition (0),
+	m_nMorphRampFrames (pConfig->GetMorphRampTime () * pConfig->GetSampleRate () / 1000),
+	m_BootJob (BootJobNone),
+	m_StartedBootJob (BootJobNone),
+	m_bPerformanceLoaded (false),
+	m_DeferredBoot (DeferredBootNone)
 {
 	assert (m_pConfig);
 
 	for (unsigned i = 0; i < CConfig::ToneGenerators; i++)
 	{
-		m_nVoiceBankID[i] = 0;
+		m_TGParameters.Set (TGParameterVoiceBank, 0, i);
 		m_nVoiceBankIDMSB[i] = 0;
-		m_nProgram[i] = 0;
-		m_nVolume[i] = 100;
-		m_nPan[i] = 64;
-		m_nMasterTune[i] = 0;
-		m_nCutoff[i] = 99;
-		m_nResonance[i] = 0;
-		m_nMIDIChannel[i] = CMIDIDevice::Disabled;
-		m_nPitchBendRange[i] = 2;
-		m_nPitchBendStep[i] = 0;
-		m_nPortamentoMode[i] = 0;
-		m_nPortamentoGlissando[i] = 0;
-		m_nPortamentoTime[i] = 0;
-		m_bMonoMode[i]=0; 
-		m_nNoteLimitLow[i] = 0;
-		m_nNoteLimitHigh[i] = 127;
-		m_nNoteShift[i] = 0;
+		m_TGParameters.Set (TGParameterProgram, 0, i);
+		m_nPendingProgram[i] = -1;
+		m_bVoicePending[i] = false;
+		m_fVoiceFadeGain[i] = 1.0f;
+		m_TGParameters.Set (TGParameterVolume, 100, i);
+		m_TGParameters.Set (TGParameterPan, 64, i);
+		m_TGParameters.Set (TGParameterMasterTune, 0, i);
+		m_TGParameters.Set (TGParameterCutoff, 99, i);
+		m_TGParameters.Set (TGParameterResonance, 0, i);
+		m_TGParameters.Set (TGParameterMIDIChannel, CMIDIDevice::Disabled, i);
+		m_TGParameters.Set (TGParameterPitchBendRange, 2, i);
+		m_TGParameters.Set (TGParameterPitchBendStep, 0, i);
+		m_TGParameters.Set (TGParameterPortamentoMode, 0, i);
+		m_TGParameters.Set (TGParameterPortamentoGlissando, 0, i);
+		m_TGParameters.Set (TGParameterPortamentoTime, 0, i);
+		m_TGParameters.Set (TGParameterMonoMode, 0, i); 
+		m_TGParameters.Set (TGParameterNoteLimitLow, 0, i);
+		m_TGParameters.Set (TGParameterNoteLimitHigh, 127, i);
+		m_TGParameters.Set (TGParameterNoteShift, 0, i);
 		
-		m_nModulationWheelRange[i]=99;
-		m_nModulationWheelTarget[i]=7;
-		m_nFootControlRange[i]=99;
-		m_nFootControlTarget[i]=0;	
-		m_nBreathControlRange[i]=99;	
-		m_nBreathControlTarget[i]=0;	
-		m_nAftertouchRange[i]=99;	
-		m_nAftertouchTarget[i]=0;
+		m_TGParameters.Set (TGParameterMWRange, 99, i);
+		SetControllerTarget (TGParameterMWPitch, 7, i);
+		m_TGParameters.Set (TGParameterFCRange, 99, i);
+		SetControllerTarget (TGParameterFCPitch, 0, i);	
+		m_TGParameters.Set (TGParameterBCRange, 99, i);	
+		SetControllerTarget (TGParameterBCPitch, 0, i);	
+		m_TGParameters.Set (TGParameterATRange, 99, i);	
+		SetControllerTarget (TGParameterATPitch, 0, i);
 		
-		m_nReverbSend[i] = 0;
+		m_TGParameters.Set (TGParameterReverbSend, 0, i);
 		m_uchOPMask[i] = 0b111111;	// All operators on
 
 		m_pTG[i] = new CDexedAdapter (CConfig::MaxNotes, pConfig->GetSampleRate ());
@@ -149,6 +176,11 @@ CMiniDexed::CMiniDexed (CConfig *pConfig, CInterruptSystem *pInterrupt,
 	}
 #endif
 
+	for (unsigned nCore = 0; nCore < CORES; nCore++)
+	{
+		m_ParameterUpdate[nCore] = {0, false, false};
+	}
+
 	setMasterVolume(1.0);
 
 	// BEGIN setup tg_mixer
@@ -170,6 +202,10 @@ CMiniDexed::CMiniDexed (CConfig *pConfig, CInterruptSystem *pInterrupt,
 	SetParameter (ParameterCompressorEnable, 1);
 
 	SetPerformanceSelectChannel(m_pConfig->GetPerformanceSelectChannel());
+	m_PerformanceConfig.SetVoiceDataBlob (m_pConfig->GetPerformanceVoiceBlob ());
+
+	unsigned nFadeTime = pConfig->GetProgramChangeFadeTime ();
+	m_fVoiceFadeStep = nFadeTime > 0 ? 1000.0f / (nFadeTime * pConfig->GetSampleRate ()) : 0.0f;
 };
 
 bool CMiniDexed::Initialize (void)
@@ -177,12 +213,34 @@ bool CMiniDexed::Initialize (void)
 	assert (m_pConfig);
 	assert (m_pSoundDevice);
 
+	CBootProfiler *pProfiler = CBootProfiler::Get ();
+	bool bFastStart = m_pConfig->GetFastStart ();
+
 	if (!m_UI.Initialize ())
 	{
 		return false;
 	}
 
-	m_SysExFileLoader.Load (m_pConfig->GetHeaderlessSysExVoices ());
+#ifdef ARM_ALLOW_MULTI_CORE
+	// Start the secondary cores now, core 1 runs the boot jobs, until the
+	// sound device has been started. Cores 2 and 3 wait to be kicked.
+	if (!CMultiCoreSupport::Initialize ())
+	{
+		return false;
+	}
+#endif
+
+	pProfiler->PhaseDone ("UI");
+
+	StartBootJob (BootJobSetupTGs);
+
+	// with fast start the voice banks and the performance list are loaded
+	// from the main loop, after the sound has been started
+	if (!bFastStart)
+	{
+		m_SysExFileLoader.Load (m_pConfig->GetHeaderlessSysExVoices ());
+		pProfiler->PhaseDone ("Voice banks");
+	}
 
 	if (m_SerialMIDI.Initialize ())
 	{
@@ -205,43 +263,28 @@ bool CMiniDexed::Initialize (void)
 		LOGNOTE("Program Change: Disabled");
 	}
 
-	for (unsigned i = 0; i < CConfig::ToneGenerators; i++)
-	{
-		assert (m_pTG[i]);
-
-		SetVolume (100, i);
-		ProgramChange (0, i);
-
-		m_pTG[i]->setTranspose (24);
-
-		m_pTG[i]->setPBController (2, 0);
-		m_pTG[i]->setMWController (99, 1, 0); 
+	m_bPerformanceLoaded = m_PerformanceConfig.Load ();
+	pProfiler->PhaseDone ("Performance");
 
-		m_pTG[i]->setFCController (99, 1, 0); 
-		m_pTG[i]->setBCController (99, 1, 0);
-		m_pTG[i]->setATController (99, 1, 0);
-		
-		tg_mixer->pan(i,mapfloat(m_nPan[i],0,127,0.0f,1.0f));
-		tg_mixer->gain(i,1.0f);
-		reverb_send_mixer->pan(i,mapfloat(m_nPan[i],0,127,0.0f,1.0f));
-		reverb_send_mixer->gain(i,mapfloat(m_nReverbSend[i],0,99,0.0f,1.0f));
-	}
+	WaitBootJob ();		// the TGs must be set up, before the performance is applied
+	StartBootJob (BootJobApplyPerformance);
 
-	if (m_PerformanceConfig.Load ())
-	{
-		LoadPerformanceParameters(); 
-	}
-	else
+	if (!bFastStart)
 	{
-		SetMIDIChannel (CMIDIDevice::OmniMode, 0);
+		ListPerformances ();
+		pProfiler->PhaseDone ("Performance list");
 	}
-	
-	// load performances file list, and attempt to create the performance folder
-	if (!m_PerformanceConfig.ListPerformances()) 
+
+	WaitBootJob ();
+
+	if (!bFastStart)
 	{
-		LOGERR ("Cannot create internal Performance folder, new performances can't be created");
+		// read the banks of the performance now, so that it sounds right from the start
+		m_SysExFileLoader.LoadRequestedBanks ();
+		RetryProgramChanges ();
+		pProfiler->PhaseDone ("Performance banks");
 	}
-	
+
 	// setup and start the sound device
 	if (!m_pSoundDevice->AllocateQueueFrames (m_pConfig->GetChunkSize ()))
 	{
@@ -260,13 +303,21 @@ bool CMiniDexed::Initialize (void)
 
 	m_pSoundDevice->Start ();
 
-#ifdef ARM_ALLOW_MULTI_CORE
-	// start secondary cores
-	if (!CMultiCoreSupport::Initialize ())
+	StartBootJob (BootJobFinished);		// core 1 starts processing the sound
+	pProfiler->PhaseDone ("Sound");
+
+	if (bFastStart)
 	{
-		return false;
+		m_SysExFileLoader.LoadStart (m_pConfig->GetHeaderlessSysExVoices ());
+		m_DeferredBoot = DeferredBootVoiceBanks;
+	}
+
+	if (*m_pConfig->GetMIDIFilePlayerFile ())
+	{
+		m_MIDIFilePlayer.Start (m_pConfig->GetMIDIFilePlayerFile (),
+					m_pConfig->GetMIDIFilePlayerLoop (),
+					m_pConfig->GetMIDIFilePlayerSpeed ());
 	}
-#endif
 	
 	return true;
 }
@@ -290,8 +341,23 @@ void CMiniDexed::Process (bool bPlugAndPlayUpdated)
 		m_SerialMIDI.Process ();
 	}
 
+	m_MIDIFilePlayer.Process ();
+
 	m_UI.Process ();
 
+	m_SysExFileLoader.Process ();
+
+	ProcessVoiceSearch ();
+
+	ProcessSnapshotSysEx ();
+
+	RetryProgramChanges ();
+
+	if (m_DeferredBoot != DeferredBootNone)
+	{
+		ProcessDeferredBoot ();
+	}
+
 	if (m_bSavePerformance)
 	{
 		DoSavePerformance ();
@@ -304,27 +370,60 @@ void CMiniDexed::Process (bool bPlugAndPlayUpdated)
 		DoSavePerformanceNewFile ();
 		m_bSavePerformanceNewFile = false;
 	}
+
+	m_PerformanceConfig.SaveStep ();
+
+	if (   m_bLoadPerformanceBusy
+	    && !__atomic_load_n (&m_bPerformanceSwitchPending, __ATOMIC_ACQUIRE))
+	{
+		m_bLoadPerformanceBusy = false;		// ProcessSound() has switched
+	}
 	
 	if (m_bSetNewPerformance && !m_bLoadPerformanceBusy)
 	{
-		DoSetNewPerformance ();
-		if (m_nSetNewPerformanceID == GetActualPerformanceID())
+		// repeated, while the voice banks are loaded, or if another
+		// performance has been selected meanwhile
+		unsigned nID = m_nSetNewPerformanceID;
+		if (   DoSetNewPerformance ()
+		    && m_nSetNewPerformanceID == nID)
 		{
 			m_bSetNewPerformance = false;
 		}
-		
 	}
 	
+	if (m_bSetMorphPerformances)
+	{
+		DoSetMorphPerformances ();
+	}
+
 	if(m_bDeletePerformance)
 	{
 		DoDeletePerformance ();
 		m_bDeletePerformance = false;
 	}
+
+	if (   !m_bSetNewPerformance
+	    && !m_bLoadPerformanceBusy
+	    && m_DeferredBoot == DeferredBootNone)
+	{
+		m_PerformanceConfig.ReadTableStep ();
+	}
 		
+	if (m_pConfig->GetMIDIDumpEnabled ())
+	{
+		m_MIDITrace.Dump ();
+	}
+
+	m_LatencyMeter.Process ();
+
 	if (m_bProfileEnabled)
 	{
 		m_GetChunkTimer.Dump ();
+		m_VoiceSwapTimer.Dump ();
+		m_SysExFileLoader.DumpVoiceCacheStats ();
 	}
+
+	m_LatencyMeter.Dump ();
 }
 
 #ifdef ARM_ALLOW_MULTI_CORE
@@ -335,6 +434,8 @@ void CMiniDexed::Run (unsigned nCore)
 
 	if (nCore == 1)
 	{
+		RunBootJobs ();
+
 		m_CoreStatus[nCore] = CoreStatusIdle;			// core 1 ready
 
 		// wait for cores 2 and 3 to be ready
@@ -385,7 +486,187 @@ void CMiniDexed::Run (unsigned nCore)
 	}
 }
 
+void CMiniDexed::RunBootJobs (void)
+{
+	while (1)
+	{
+		TBootJob Job;
+		while ((Job = m_BootJob) == BootJobNone)
+		{
+			// just wait
+		}
+
+		if (Job == BootJobFinished)
+		{
+			break;
+		}
+
+		RunBootJob (Job);
+
+		__atomic_store_n (&m_BootJob, BootJobNone, __ATOMIC_RELEASE);
+	}
+}
+
+#endif
+
+void CMiniDexed::StartBootJob (TBootJob Job)
+{
+	m_StartedBootJob = Job;
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	assert (m_BootJob == BootJobNone);
+	__atomic_store_n (&m_BootJob, Job, __ATOMIC_RELEASE);
+#else
+	if (Job != BootJobFinished)
+	{
+		RunBootJob (Job);
+		CBootProfiler::Get ()->PhaseDone (GetBootJobName (Job));
+	}
+#endif
+}
+
+void CMiniDexed::WaitBootJob (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	while (__atomic_load_n (&m_BootJob, __ATOMIC_ACQUIRE) != BootJobNone)
+	{
+		// just wait
+	}
+
+	// the part of the job, which did not run in parallel to core 0
+	CBootProfiler::Get ()->PhaseDone (GetBootJobName (m_StartedBootJob));
 #endif
+}
+
+const char *CMiniDexed::GetBootJobName (TBootJob Job)
+{
+	switch (Job)
+	{
+	case BootJobSetupTGs:		return "TG setup";
+	case BootJobApplyPerformance:	return "Apply performance";
+	default:			return "Boot job";
+	}
+}
+
+// Core 0 does not access the TGs, the voice cache and the UI, while a job is running.
+void CMiniDexed::RunBootJob (TBootJob Job)
+{
+	switch (Job)
+	{
+	case BootJobSetupTGs:
+		for (unsigned i = 0; i < CConfig::ToneGenerators; i++)
+		{
+			assert (m_pTG[i]);
+
+			SetVolume (100, i);
+
+			m_pTG[i]->setTranspose (24);
+
+			m_pTG[i]->setPBController (2, 0);
+			m_pTG[i]->setMWController (99, 1, 0); 
+
+			m_pTG[i]->setFCController (99, 1, 0); 
+			m_pTG[i]->setBCController (99, 1, 0);
+			m_pTG[i]->setATController (99, 1, 0);
+			
+			tg_mixer->pan(i,mapfloat(m_TGParameters.Get (TGParameterPan, i),0,127,0.0f,1.0f));
+			tg_mixer->gain(i,1.0f);
+			reverb_send_mixer->pan(i,mapfloat(m_TGParameters.Get (TGParameterPan, i),0,127,0.0f,1.0f));
+			reverb_send_mixer->gain(i,mapfloat(m_TGParameters.Get (TGParameterReverbSend, i),0,99,0.0f,1.0f));
+		}
+		break;
+
+	case BootJobApplyPerformance:
+		for (unsigned i = 0; i < CConfig::ToneGenerators; i++)
+		{
+			ProgramChange (0, i);
+		}
+
+		if (m_bPerformanceLoaded)
+		{
+			LoadPerformanceParameters(); 
+		}
+		else
+		{
+			SetMIDIChannel (CMIDIDevice::OmniMode, 0);
+		}
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+// one step per call from the main loop, while the sound is running already
+void CMiniDexed::ProcessDeferredBoot (void)
+{
+	CBootProfiler *pProfiler = CBootProfiler::Get ();
+
+	switch (m_DeferredBoot)
+	{
+	case DeferredBootVoiceBanks:
+		// one directory per call, the sound keeps running with the built-in voices
+		if (!m_SysExFileLoader.LoadStep ())
+		{
+			break;
+		}
+		pProfiler->PhaseDone ("Voice banks");
+
+		// The performance has been started with the built-in voices, because
+		// its banks were not known yet. The banks are loaded by the following
+		// calls of m_SysExFileLoader.Process() and the voices are switched.
+		if (m_bPerformanceLoaded)
+		{
+			for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+			{
+				if (!m_PerformanceConfig.VoiceDataFilled (nTG))
+				{
+					BankSelect (m_PerformanceConfig.GetBankNumber (nTG), nTG);
+					ProgramChange (m_PerformanceConfig.GetVoiceNumber (nTG), nTG);
+				}
+			}
+		}
+
+		m_DeferredBoot = DeferredBootPerformanceList;
+		break;
+
+	case DeferredBootPerformanceList:
+		ListPerformances ();
+		pProfiler->PhaseDone ("Performance list");
+
+		pProfiler->Dump ();
+
+		m_DeferredBoot = DeferredBootNone;
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+void CMiniDexed::ListPerformances (void)
+{
+	// load performances file list, and attempt to create the performance folder
+	if (!m_PerformanceConfig.ListPerformances()) 
+	{
+		LOGERR ("Cannot create internal Performance folder, new performances can't be created");
+	}
+}
+
+// retries program changes, which had to wait for their bank to be loaded
+void CMiniDexed::RetryProgramChanges (void)
+{
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		int nProgram = __atomic_exchange_n (&m_nPendingProgram[nTG], -1, __ATOMIC_ACQ_REL);
+		if (nProgram >= 0)
+		{
+			ProgramChange (nProgram, nTG);
+		}
+	}
+}
 
 CSysExFileLoader *CMiniDexed::GetSysExFileLoader (void)
 {
@@ -401,9 +682,12 @@ void CMiniDexed::BankSelect (unsigned nBank, unsigned nTG)
 	if (GetSysExFileLoader ()->IsValidBank(nBank))
 	{
 		// Only change if we have the bank loaded
-		m_nVoiceBankID[nTG] = nBank;
+		m_TGParameters.Set (TGParameterVoiceBank, nBank, nTG);
 
-		m_UI.ParameterChanged ();
+		// read it from SD now, the program change should follow soon
+		m_SysExFileLoader.RequestBank (nBank);
+
+		ParameterChanged ();
 	}
 }
 
@@ -427,7 +711,7 @@ void CMiniDexed::BankSelectLSB (unsigned nBankLSB, unsigned nTG)
 	nBankLSB=constrain((int)nBankLSB,0,127);
 
 	assert (nTG < CConfig::ToneGenerators);
-	unsigned nBank = m_nVoiceBankID[nTG];
+	unsigned nBank = m_TGParameters.Get (TGParameterVoiceBank, nTG);
 	unsigned nBankMSB = m_nVoiceBankIDMSB[nTG];
 	nBank = (nBankMSB << 7) + nBankLSB;
 
@@ -439,6 +723,8 @@ void CMiniDexed::ProgramChange (unsigned nProgram, unsigned nTG)
 {
 	assert (m_pConfig);
 
+	unsigned nRequestedProgram = nProgram;
+
 	unsigned nBankOffset;
 	bool bPCAcrossBanks = m_pConfig->GetExpandPCAcrossBanks();
 	if (bPCAcrossBanks)
@@ -463,25 +749,34 @@ void CMiniDexed::ProgramChange (unsigned nProgram, unsigned nTG)
 	}
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nProgram[nTG] = nProgram;
+	m_TGParameters.Set (TGParameterProgram, nProgram, nTG);
 
 	uint8_t Buffer[156];
-	m_SysExFileLoader.GetVoice (m_nVoiceBankID[nTG]+nBankOffset, nProgram, Buffer);
+	if (!m_SysExFileLoader.GetVoice (m_TGParameters.Get (TGParameterVoiceBank, nTG)+nBankOffset, nProgram, Buffer))
+	{
+		// bank is being loaded, Process() will repeat the program change
+		__atomic_store_n (&m_nPendingProgram[nTG], (int) nRequestedProgram, __ATOMIC_RELEASE);
 
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->loadVoiceParameters (Buffer);
+		return;
+	}
+
+	// a newer program change overrides one, which is still waiting
+	__atomic_store_n (&m_nPendingProgram[nTG], -1, __ATOMIC_RELEASE);
+
+	// the voice is swapped in by ProcessSound(), while the TG is not rendered
+	SetPendingVoice (Buffer, nTG);
 
 	if (m_pConfig->GetMIDIAutoVoiceDumpOnPC())
 	{
 		// Only do the voice dump back out over MIDI if we have a specific
 		// MIDI channel configured for this TG
-		if (m_nMIDIChannel[nTG] < CMIDIDevice::Channels)
+		if (m_TGParameters.Get (TGParameterMIDIChannel, nTG) < CMIDIDevice::Channels)
 		{
 			m_SerialMIDI.SendSystemExclusiveVoice(nProgram,0,nTG);
 		}
 	}
 
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::ProgramChangePerformance (unsigned nProgram)
@@ -490,13 +785,35 @@ void CMiniDexed::ProgramChangePerformance (unsigned nProgram)
 	{
 		// Program Change messages change Performances.
 		unsigned nLastPerformance = m_PerformanceConfig.GetLastPerformance();
+		unsigned nID = m_nPerformanceBank * PERFORMANCES_PER_BANK + nProgram;
 
 		// GetLastPerformance actually returns 1-indexed, number of performances
-		if (nProgram < nLastPerformance - 1)
+		if (nID < nLastPerformance - 1)
 		{
-			SetNewPerformance(nProgram);
+			SetNewPerformance(nID);
 		}
-		m_UI.ParameterChanged ();
+		ParameterChanged ();
+	}
+}
+
+void CMiniDexed::PerformanceBankSelectMSB (unsigned nBankMSB)
+{
+	// valid with the following LSB only, like BankSelectMSB()
+	m_nPerformanceBankMSB = constrain ((int) nBankMSB, 0, 127);
+}
+
+void CMiniDexed::PerformanceBankSelectLSB (unsigned nBankLSB)
+{
+	nBankLSB = constrain ((int) nBankLSB, 0, 127);
+
+	unsigned nBank = (m_nPerformanceBankMSB << 7) + nBankLSB;
+	if (nBank * PERFORMANCES_PER_BANK < m_PerformanceConfig.GetLastPerformance ())
+	{
+		m_nPerformanceBank = nBank;
+	}
+	else
+	{
+		LOGNOTE ("Performance bank %u not present", nBank+1);
 	}
 }
 
@@ -505,12 +822,9 @@ void CMiniDexed::SetVolume (unsigned nVolume, unsigned nTG)
 	nVolume=constrain((int)nVolume,0,127);
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nVolume[nTG] = nVolume;
-
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->setGain (nVolume / 127.0f);
+	m_TGParameters.Set (TGParameterVolume, nVolume, nTG);
 
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::SetPan (unsigned nPan, unsigned nTG)
@@ -518,12 +832,9 @@ void CMiniDexed::SetPan (unsigned nPan, unsigned nTG)
 	nPan=constrain((int)nPan,0,127);
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPan[nTG] = nPan;
-	
-	tg_mixer->pan(nTG,mapfloat(nPan,0,127,0.0f,1.0f));
-	reverb_send_mixer->pan(nTG,mapfloat(nPan,0,127,0.0f,1.0f));
+	m_TGParameters.Set (TGParameterPan, nPan, nTG);
 
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::SetReverbSend (unsigned nReverbSend, unsigned nTG)
@@ -531,11 +842,9 @@ void CMiniDexed::SetReverbSend (unsigned nReverbSend, unsigned nTG)
 	nReverbSend=constrain((int)nReverbSend,0,99);
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nReverbSend[nTG] = nReverbSend;
-
-	reverb_send_mixer->gain(nTG,mapfloat(nReverbSend,0,99,0.0f,1.0f));
+	m_TGParameters.Set (TGParameterReverbSend, nReverbSend, nTG);
 	
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::SetMasterTune (int nMasterTune, unsigned nTG)
@@ -543,12 +852,9 @@ void CMiniDexed::SetMasterTune (int nMasterTune, unsigned nTG)
 	nMasterTune=constrain((int)nMasterTune,-99,99);
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nMasterTune[nTG] = nMasterTune;
+	m_TGParameters.Set (TGParameterMasterTune, nMasterTune, nTG);
 
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->setMasterTune ((int8_t) nMasterTune);
-
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::SetCutoff (int nCutoff, unsigned nTG)
@@ -556,12 +862,9 @@ void CMiniDexed::SetCutoff (int nCutoff, unsigned nTG)
 	nCutoff = constrain (nCutoff, 0, 99);
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nCutoff[nTG] = nCutoff;
-
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->setFilterCutoff (mapfloat (nCutoff, 0, 99, 0.0f, 1.0f));
+	m_TGParameters.Set (TGParameterCutoff, nCutoff, nTG);
 
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::SetResonance (int nResonance, unsigned nTG)
@@ -569,22 +872,47 @@ void CMiniDexed::SetResonance (int nResonance, unsigned nTG)
 	nResonance = constrain (nResonance, 0, 99);
 
 	assert (nTG < CConfig::ToneGenerators);
-	m_nResonance[nTG] = nResonance;
+	m_TGParameters.Set (TGParameterResonance, nResonance, nTG);
 
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->setFilterResonance (mapfloat (nResonance, 0, 99, 0.0f, 1.0f));
+	ParameterChanged ();
+}
 
-	m_UI.ParameterChanged ();
+void CMiniDexed::SetNoteLimitLow (unsigned nNote, unsigned nTG)
+{
+	nNote = constrain ((int) nNote, 0, 127);
+
+	assert (nTG < CConfig::ToneGenerators);
+	m_TGParameters.Set (TGParameterNoteLimitLow, nNote, nTG);
+
+	ParameterChanged ();
+}
+
+void CMiniDexed::SetNoteLimitHigh (unsigned nNote, unsigned nTG)
+{
+	nNote = constrain ((int) nNote, 0, 127);
+
+	assert (nTG < CConfig::ToneGenerators);
+	m_TGParameters.Set (TGParameterNoteLimitHigh, nNote, nTG);
+
+	ParameterChanged ();
 }
 
+void CMiniDexed::SetNoteShift (int nShift, unsigned nTG)
+{
+	nShift = constrain (nShift, -127, 127);
+
+	assert (nTG < CConfig::ToneGenerators);
+	m_TGParameters.Set (TGParameterNoteShift, nShift, nTG);
 
+	ParameterChanged ();
+}
 
 void CMiniDexed::SetMIDIChannel (uint8_t uchChannel, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
 	assert (uchChannel < CMIDIDevice::ChannelUnknown);
 
-	m_nMIDIChannel[nTG] = uchChannel;
+	m_TGParameters.Set (TGParameterMIDIChannel, uchChannel, nTG);
 
 	for (unsigned i = 0; i < CConfig::MaxUSBMIDIDevices; i++)
 	{
@@ -593,6 +921,7 @@ void CMiniDexed::SetMIDIChannel (uint8_t uchChannel, unsigned nTG)
 	}
 
 	m_PCKeyboard.SetChannel (uchChannel, nTG);
+	m_MIDIFilePlayer.SetChannel (uchChannel, nTG);
 
 	if (m_bUseSerial)
 	{
@@ -603,7 +932,7 @@ void CMiniDexed::SetMIDIChannel (uint8_t uchChannel, unsigned nTG)
 	unsigned nActiveTGs = 0;
 	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
 	{
-		if (m_nMIDIChannel[nTG] != CMIDIDevice::Disabled)
+		if (m_TGParameters.Get (TGParameterMIDIChannel, nTG) != CMIDIDevice::Disabled)
 		{
 			nActiveTGs++;
 		}
@@ -614,7 +943,7 @@ void CMiniDexed::SetMIDIChannel (uint8_t uchChannel, unsigned nTG)
 	m_nActiveTGsLog2 = Log2[nActiveTGs];
 #endif
 
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::keyup (int16_t pitch, unsigned nTG)
@@ -645,13 +974,13 @@ int16_t CMiniDexed::ApplyNoteLimits (int16_t pitch, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
 
-	if (   pitch < (int16_t) m_nNoteLimitLow[nTG]
-	    || pitch > (int16_t) m_nNoteLimitHigh[nTG])
+	if (   pitch < (int16_t) m_TGParameters.Get (TGParameterNoteLimitLow, nTG)
+	    || pitch > (int16_t) m_TGParameters.Get (TGParameterNoteLimitHigh, nTG))
 	{
 		return -1;
 	}
 
-	pitch += m_nNoteShift[nTG];
+	pitch += m_TGParameters.Get (TGParameterNoteShift, nTG);
 
 	if (   pitch < 0
 	    || pitch > 127)
@@ -723,81 +1052,298 @@ void CMiniDexed::setPitchbend (int16_t value, unsigned nTG)
 	m_pTG[nTG]->setPitchbend (value);
 }
 
-void CMiniDexed::ControllersRefresh (unsigned nTG)
+// Applies the changes of the TG parameters to the sound engine, called from
+// ProcessSound() only, before the TGs are rendered
+void CMiniDexed::ApplyTGParameters (void)
 {
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->ControllersRefresh ();
-}
+	static_assert (TGRefreshUnknown <= CParameterStore::MaxParameters,
+		       "Too many TG parameters for CParameterStore");
 
-void CMiniDexed::SetParameter (TParameter Parameter, int nValue)
-{
-	assert (reverb);
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		CParameterStore::TChanges Changes;
+		if (!m_TGParameters.TakeChanges (nTG, &Changes))
+		{
+			continue;
+		}
 
-	assert (Parameter < ParameterUnknown);
-	m_nParameter[Parameter] = nValue;
+		assert (m_pTG[nTG]);
+		CDexedAdapter *pTG = m_pTG[nTG];
 
-	switch (Parameter)
-	{
-	case ParameterCompressorEnable:
-		for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+		if (CParameterStore::IsChanged (Changes, TGParameterVolume))
 		{
-			assert (m_pTG[nTG]);
-			m_pTG[nTG]->setCompressor (!!nValue);
+			// before the TG compressor, not ramped (pan and send are ramped by the mixers)
+			pTG->setGain (m_TGParameters.Get (TGParameterVolume, nTG) / 127.0f);
 		}
-		break;
 
-	case ParameterReverbEnable:
-		nValue=constrain((int)nValue,0,1);
-		m_ReverbSpinLock.Acquire ();
-		reverb->set_bypass (!nValue);
-		m_ReverbSpinLock.Release ();
-		break;
+		if (CParameterStore::IsChanged (Changes, TGParameterPan))
+		{
+			tg_mixer->pan (nTG, mapfloat (m_TGParameters.Get (TGParameterPan, nTG), 0, 127, 0.0f, 1.0f));
+			reverb_send_mixer->pan (nTG, mapfloat (m_TGParameters.Get (TGParameterPan, nTG), 0, 127, 0.0f, 1.0f));
+		}
 
+		if (CParameterStore::IsChanged (Changes, TGParameterReverbSend))
+		{
+			reverb_send_mixer->gain (nTG, mapfloat (m_TGParameters.Get (TGParameterReverbSend, nTG), 0, 99, 0.0f, 1.0f));
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterMasterTune))
+		{
+			pTG->setMasterTune ((int8_t) m_TGParameters.Get (TGParameterMasterTune, nTG));
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterCutoff))
+		{
+			pTG->setFilterCutoff (mapfloat (m_TGParameters.Get (TGParameterCutoff, nTG), 0, 99, 0.0f, 1.0f));
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterResonance))
+		{
+			pTG->setFilterResonance (mapfloat (m_TGParameters.Get (TGParameterResonance, nTG), 0, 99, 0.0f, 1.0f));
+		}
+
+		bool bRefreshControllers = CParameterStore::IsChanged (Changes, TGRefreshControllers);
+
+		if (CParameterStore::IsChanged (Changes, TGParameterPitchBendRange))
+		{
+			pTG->setPitchbendRange (m_TGParameters.Get (TGParameterPitchBendRange, nTG));
+			bRefreshControllers = true;
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterPitchBendStep))
+		{
+			pTG->setPitchbendStep (m_TGParameters.Get (TGParameterPitchBendStep, nTG));
+			bRefreshControllers = true;
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterPortamentoMode))
+		{
+			pTG->setPortamentoMode (m_TGParameters.Get (TGParameterPortamentoMode, nTG));
+			bRefreshControllers = true;
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterPortamentoGlissando))
+		{
+			pTG->setPortamentoGlissando (m_TGParameters.Get (TGParameterPortamentoGlissando, nTG));
+			bRefreshControllers = true;
+		}
+
+		if (CParameterStore::IsChanged (Changes, TGParameterPortamentoTime))
+		{
+			pTG->setPortamentoTime (m_TGParameters.Get (TGParameterPortamentoTime, nTG));
+			bRefreshControllers = true;
+		}
+
+		if (   CParameterStore::IsChanged (Changes, TGParameterMWRange)
+		    || CParameterStore::IsChanged (Changes, TGParameterMWPitch)
+		    || CParameterStore::IsChanged (Changes, TGParameterMWAmplitude)
+		    || CParameterStore::IsChanged (Changes, TGParameterMWEGBias))
+		{
+			pTG->setMWController (m_TGParameters.Get (TGParameterMWRange, nTG), GetControllerTarget (TGParameterMWPitch, nTG), 0);
+			bRefreshControllers = true;
+		}
+
+		if (   CParameterStore::IsChanged (Changes, TGParameterFCRange)
+		    || CParameterStore::IsChanged (Changes, TGParameterFCPitch)
+		    || CParameterStore::IsChanged (Changes, TGParameterFCAmplitude)
+		    || CParameterStore::IsChanged (Changes, TGParameterFCEGBias))
+		{
+			pTG->setFCController (m_TGParameters.Get (TGParameterFCRange, nTG), GetControllerTarget (TGParameterFCPitch, nTG), 0);
+			bRefreshControllers = true;
+		}
+
+		if (   CParameterStore::IsChanged (Changes, TGParameterBCRange)
+		    || CParameterStore::IsChanged (Changes, TGParameterBCPitch)
+		    || CParameterStore::IsChanged (Changes, TGParameterBCAmplitude)
+		    || CParameterStore::IsChanged (Changes, TGParameterBCEGBias))
+		{
+			pTG->setBCController (m_TGParameters.Get (TGParameterBCRange, nTG), GetControllerTarget (TGParameterBCPitch, nTG), 0);
+			bRefreshControllers = true;
+		}
+
+		if (   CParameterStore::IsChanged (Changes, TGParameterATRange)
+		    || CParameterStore::IsChanged (Changes, TGParameterATPitch)
+		    || CParameterStore::IsChanged (Changes, TGParameterATAmplitude)
+		    || CParameterStore::IsChanged (Changes, TGParameterATEGBias))
+		{
+			pTG->setATController (m_TGParameters.Get (TGParameterATRange, nTG), GetControllerTarget (TGParameterATPitch, nTG), 0);
+			bRefreshControllers = true;
+		}
+
+		if (bRefreshControllers)
+		{
+			pTG->ControllersRefresh ();
+		}
+
+		bool bRefreshVoice = CParameterStore::IsChanged (Changes, TGRefreshVoice);
+
+		if (CParameterStore::IsChanged (Changes, TGParameterMonoMode))
+		{
+			pTG->setMonoMode (m_TGParameters.Get (TGParameterMonoMode, nTG));
+			bRefreshVoice = true;
+		}
+
+		if (bRefreshVoice)
+		{
+			pTG->doRefreshVoice ();
+		}
+	}
+}
+
+// done by ApplyTGParameters(), multiple requests within a chunk are merged
+void CMiniDexed::ControllersRefresh (unsigned nTG)
+{
+	m_TGParameters.MarkChanged (TGRefreshControllers, nTG);
+}
+
+void CMiniDexed::RefreshVoice (unsigned nTG)
+{
+	m_TGParameters.MarkChanged (TGRefreshVoice, nTG);
+}
+
+void CMiniDexed::ParameterChanged (void)
+{
+	TParameterUpdate *pUpdate = GetParameterUpdate ();
+	if (pUpdate->nDepth > 0)
+	{
+		__atomic_store_n (&pUpdate->bChanged, true, __ATOMIC_RELAXED);
+
+		return;
+	}
+
+	m_UI.ParameterChanged ();
+}
+
+CMiniDexed::TParameterUpdate *CMiniDexed::GetParameterUpdate (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return &m_ParameterUpdate[CMultiCoreSupport::ThisCore ()];
+#else
+	return &m_ParameterUpdate[0];
+#endif
+}
+
+void CMiniDexed::BeginParameterUpdate (void)
+{
+	GetParameterUpdate ()->nDepth++;
+}
+
+void CMiniDexed::EndParameterUpdate (void)
+{
+	TParameterUpdate *pUpdate = GetParameterUpdate ();
+	assert (pUpdate->nDepth > 0);
+	if (--pUpdate->nDepth > 0)
+	{
+		return;
+	}
+
+	// an interrupt on this core may add to the update meanwhile
+	if (__atomic_exchange_n (&pUpdate->bReverbChanged, false, __ATOMIC_RELAXED))
+	{
+		m_ReverbSpinLock.Acquire ();
+
+		for (unsigned i = ParameterReverbEnable; i <= ParameterReverbLevel; i++)
+		{
+			ApplyReverbParameter ((TParameter) i);
+		}
+
+		m_ReverbSpinLock.Release ();
+	}
+
+	if (__atomic_exchange_n (&pUpdate->bChanged, false, __ATOMIC_RELAXED))
+	{
+		m_UI.ParameterChanged ();
+	}
+}
+
+void CMiniDexed::SetParameter (TParameter Parameter, int nValue)
+{
+	assert (reverb);
+
+	assert (Parameter < ParameterUnknown);
+	m_nParameter[Parameter] = nValue;
+
+	switch (Parameter)
+	{
+	case ParameterCompressorEnable:
+		for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+		{
+			assert (m_pTG[nTG]);
+			m_pTG[nTG]->setCompressor (!!nValue);
+		}
+		break;
+
+	case ParameterReverbEnable:
 	case ParameterReverbSize:
-		nValue=constrain((int)nValue,0,99);
+	case ParameterReverbHighDamp:
+	case ParameterReverbLowDamp:
+	case ParameterReverbLowPass:
+	case ParameterReverbDiffusion:
+	case ParameterReverbLevel:
+		if (GetParameterUpdate ()->nDepth > 0)
+		{
+			__atomic_store_n (&GetParameterUpdate ()->bReverbChanged, true, __ATOMIC_RELAXED);
+			break;
+		}
+
 		m_ReverbSpinLock.Acquire ();
-		reverb->size (nValue / 99.0f);
+		ApplyReverbParameter (Parameter);
 		m_ReverbSpinLock.Release ();
 		break;
 
+	case ParameterPerformanceSelectChannel:
+		// Nothing more to do
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+// m_ReverbSpinLock must be held
+void CMiniDexed::ApplyReverbParameter (TParameter Parameter)
+{
+	assert (reverb);
+
+	assert (Parameter < ParameterUnknown);
+	int nValue = m_nParameter[Parameter];
+
+	switch (Parameter)
+	{
+	case ParameterReverbEnable:
+		nValue=constrain((int)nValue,0,1);
+		reverb->set_bypass (!nValue);
+		break;
+
+	case ParameterReverbSize:
+		nValue=constrain((int)nValue,0,99);
+		reverb->size (nValue / 99.0f);
+		break;
+
 	case ParameterReverbHighDamp:
 		nValue=constrain((int)nValue,0,99);
-		m_ReverbSpinLock.Acquire ();
 		reverb->hidamp (nValue / 99.0f);
-		m_ReverbSpinLock.Release ();
 		break;
 
 	case ParameterReverbLowDamp:
 		nValue=constrain((int)nValue,0,99);
-		m_ReverbSpinLock.Acquire ();
 		reverb->lodamp (nValue / 99.0f);
-		m_ReverbSpinLock.Release ();
 		break;
 
 	case ParameterReverbLowPass:
 		nValue=constrain((int)nValue,0,99);
-		m_ReverbSpinLock.Acquire ();
 		reverb->lowpass (nValue / 99.0f);
-		m_ReverbSpinLock.Release ();
 		break;
 
 	case ParameterReverbDiffusion:
 		nValue=constrain((int)nValue,0,99);
-		m_ReverbSpinLock.Acquire ();
 		reverb->diffusion (nValue / 99.0f);
-		m_ReverbSpinLock.Release ();
 		break;
 
 	case ParameterReverbLevel:
 		nValue=constrain((int)nValue,0,99);
-		m_ReverbSpinLock.Acquire ();
 		reverb->level (nValue / 99.0f);
-		m_ReverbSpinLock.Release ();
-		break;
-
-	case ParameterPerformanceSelectChannel:
-		// Nothing more to do
 		break;
 
 	default:
@@ -861,60 +1407,42 @@ void CMiniDexed::SetTGParameter (TTGParameter Parameter, int nValue, unsigned nT
 
 	case TGParameterReverbSend:	SetReverbSend (nValue, nTG);	break;
 
+	case TGParameterNoteLimitLow:	SetNoteLimitLow (nValue, nTG);	break;
+	case TGParameterNoteLimitHigh:	SetNoteLimitHigh (nValue, nTG);	break;
+	case TGParameterNoteShift:	SetNoteShift (nValue, nTG);	break;
+
 	default:
 		assert (0);
 		break;
 	}
 }
 
+void CMiniDexed::SetTGParameters (const TTGParameterChange *pChanges, unsigned nChanges)
+{
+	assert (pChanges);
+
+	BeginParameterUpdate ();
+
+	for (unsigned i = 0; i < nChanges; i++)
+	{
+		SetTGParameter (pChanges[i].Parameter, pChanges[i].nValue, pChanges[i].nTG);
+	}
+
+	EndParameterUpdate ();
+}
+
 int CMiniDexed::GetTGParameter (TTGParameter Parameter, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
 
 	switch (Parameter)
 	{
-	case TGParameterVoiceBank:	return m_nVoiceBankID[nTG];
-	case TGParameterVoiceBankMSB:	return m_nVoiceBankID[nTG] >> 7;
-	case TGParameterVoiceBankLSB:	return m_nVoiceBankID[nTG] & 0x7F;
-	case TGParameterProgram:	return m_nProgram[nTG];
-	case TGParameterVolume:		return m_nVolume[nTG];
-	case TGParameterPan:		return m_nPan[nTG];
-	case TGParameterMasterTune:	return m_nMasterTune[nTG];
-	case TGParameterCutoff:		return m_nCutoff[nTG];
-	case TGParameterResonance:	return m_nResonance[nTG];
-	case TGParameterMIDIChannel:	return m_nMIDIChannel[nTG];
-	case TGParameterReverbSend:	return m_nReverbSend[nTG];
-	case TGParameterPitchBendRange:	return m_nPitchBendRange[nTG];
-	case TGParameterPitchBendStep:	return m_nPitchBendStep[nTG];
-	case TGParameterPortamentoMode:		return m_nPortamentoMode[nTG];
-	case TGParameterPortamentoGlissando:	return m_nPortamentoGlissando[nTG];
-	case TGParameterPortamentoTime:		return m_nPortamentoTime[nTG];
-	case TGParameterMonoMode:		return m_bMonoMode[nTG] ? 1 : 0; 
-	
-	case TGParameterMWRange:					return getModController(0, 0, nTG);
-	case TGParameterMWPitch:					return getModController(0, 1, nTG);
-	case TGParameterMWAmplitude:				return getModController(0, 2, nTG); 
-	case TGParameterMWEGBias:					return getModController(0, 3, nTG); 
-	
-	case TGParameterFCRange:					return getModController(1, 0,  nTG); 
-	case TGParameterFCPitch:					return getModController(1, 1,  nTG); 
-	case TGParameterFCAmplitude:				return getModController(1, 2,  nTG); 
-	case TGParameterFCEGBias:					return getModController(1, 3,  nTG); 
-	
-	case TGParameterBCRange:					return getModController(2, 0,  nTG); 
-	case TGParameterBCPitch:					return getModController(2, 1,  nTG); 
-	case TGParameterBCAmplitude:				return getModController(2, 2,  nTG); 
-	case TGParameterBCEGBias:					return getModController(2, 3,  nTG); 
-	
-	case TGParameterATRange:					return getModController(3, 0,  nTG); 
-	case TGParameterATPitch:					return getModController(3, 1,  nTG); 
-	case TGParameterATAmplitude:				return getModController(3, 2,  nTG); 
-	case TGParameterATEGBias:					return getModController(3, 3,  nTG); 
-	
-	
+	case TGParameterVoiceBankMSB:	return m_TGParameters.Get (TGParameterVoiceBank, nTG) >> 7;
+	case TGParameterVoiceBankLSB:	return m_TGParameters.Get (TGParameterVoiceBank, nTG) & 0x7F;
+
 	default:
-		assert (0);
-		return 0;
+		assert (Parameter < TGParameterUnknown);
+		return m_TGParameters.Get (Parameter, nTG);
 	}
 }
 
@@ -948,6 +1476,7 @@ void CMiniDexed::SetVoiceParameter (uint8_t uchOffset, uint8_t uchValue, unsigne
 	uchOffset += nOP * 21;
 	assert (uchOffset < 156);
 
+	FlushPendingVoice (nTG);
 	m_pTG[nTG]->setVoiceDataElement (uchOffset, uchValue);
 }
 
@@ -970,17 +1499,21 @@ uint8_t CMiniDexed::GetVoiceParameter (uint8_t uchOffset, unsigned nOP, unsigned
 	uchOffset += nOP * 21;
 	assert (uchOffset < 156);
 
-	return m_pTG[nTG]->getVoiceDataElement (uchOffset);
+	uint8_t Data[156];
+	GetVoiceData (Data, nTG);
+
+	return Data[uchOffset];
 }
 
 std::string CMiniDexed::GetVoiceName (unsigned nTG)
 {
-	char VoiceName[11];
-	memset (VoiceName, 0, sizeof VoiceName);
-
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_pTG[nTG]->setName (VoiceName);
+	uint8_t Data[156];
+	GetVoiceData (Data, nTG);
+
+	char VoiceName[11];
+	memcpy (VoiceName, &Data[145], 10);
+	VoiceName[10] = '\0';
 
 	std::string Result (VoiceName);
 
@@ -1001,8 +1534,21 @@ void CMiniDexed::ProcessSound (void)
 			m_GetChunkTimer.Start ();
 		}
 
+		SwapPerformance ();
+		SwapVoices ();
+		ProcessMorph (nFrames);
+		ApplyTGParameters ();
+
+		m_MIDIFilePlayer.ProcessChunk (nFrames);
+
 		float32_t SampleBuffer[nFrames];
 		m_pTG[0]->getSamples (SampleBuffer, nFrames);
+		ApplyVoiceFade (SampleBuffer, nFrames, 0);
+
+		if (m_LatencyMeter.GetArmedTG () == 0)
+		{
+			m_LatencyMeter.ProcessChunk (SampleBuffer, nFrames, m_nQueueSizeFrames - nFrames);
+		}
 
 		// Convert single float array (mono) to int16 array
 		int16_t tmp_int[nFrames];
@@ -1029,11 +1575,20 @@ void CMiniDexed::ProcessSound (void)
 	unsigned nFrames = m_nQueueSizeFrames - m_pSoundDevice->GetQueueFramesAvail ();
 	if (nFrames >= m_nQueueSizeFrames/2)
 	{
+		// all TGs are idle now
 		if (m_bProfileEnabled)
 		{
 			m_GetChunkTimer.Start ();
 		}
 
+		SwapPerformance ();
+		SwapVoices ();
+		ProcessMorph (nFrames);
+		ApplyTGParameters ();
+
+		// release the events of the MIDI file player, which are due in this chunk
+		m_MIDIFilePlayer.ProcessChunk (nFrames);
+
 		m_nFramesToProcess = nFrames;
 
 		// kick secondary cores
@@ -1060,6 +1615,18 @@ void CMiniDexed::ProcessSound (void)
 			}
 		}
 
+		for (unsigned i = 0; i < CConfig::ToneGenerators; i++)
+		{
+			ApplyVoiceFade (m_OutputLevel[i], nFrames, i);
+		}
+
+		int nLatencyTG = m_LatencyMeter.GetArmedTG ();
+		if (nLatencyTG >= 0)
+		{
+			m_LatencyMeter.ProcessChunk (m_OutputLevel[nLatencyTG], nFrames,
+						     m_nQueueSizeFrames - nFrames);
+		}
+
 		//
 		// Audio signal path after tone generators starts here
 		//
@@ -1155,124 +1722,238 @@ void CMiniDexed::ProcessSound (void)
 
 #endif
 
-unsigned CMiniDexed::GetPerformanceSelectChannel (void)
+void CMiniDexed::SetPendingVoice (const uint8_t *pData, unsigned nTG)
 {
-	// Stores and returns Select Channel using MIDI Device Channel definitions
-	return (unsigned) GetParameter (ParameterPerformanceSelectChannel);
-}
+	assert (nTG < CConfig::ToneGenerators);
+	assert (pData);
 
-void CMiniDexed::SetPerformanceSelectChannel (unsigned uCh)
-{
-	// Turns a configuration setting to MIDI Device Channel definitions
-	// Mirrors the logic in Performance Config for handling MIDI channel configuration
-	if (uCh == 0)
-	{
-		SetParameter (ParameterPerformanceSelectChannel, CMIDIDevice::Disabled);
-	}
-	else if (uCh < CMIDIDevice::Channels)
-	{
-		SetParameter (ParameterPerformanceSelectChannel, uCh - 1);
-	}
-	else
-	{
-		SetParameter (ParameterPerformanceSelectChannel, CMIDIDevice::OmniMode);
-	}
+	m_VoiceSwapSpinLock.Acquire ();
+
+	memcpy (m_PendingVoice[nTG], pData, sizeof m_PendingVoice[nTG]);
+	m_bVoicePending[nTG] = true;			// overrides a previous one
+
+	m_VoiceSwapSpinLock.Release ();
 }
 
-bool CMiniDexed::SavePerformance (bool bSaveAsDeault)
+// the voice is loaded directly, a pending voice would override it
+void CMiniDexed::CancelPendingVoice (unsigned nTG)
 {
-	m_bSavePerformance = true;
-	m_bSaveAsDeault=bSaveAsDeault;
+	assert (nTG < CConfig::ToneGenerators);
 
-	return true;
+	m_VoiceSwapSpinLock.Acquire ();
+	m_bVoicePending[nTG] = false;
+	m_VoiceSwapSpinLock.Release ();
 }
 
-bool CMiniDexed::DoSavePerformance (void)
+// the voice is edited, so a pending voice must be loaded before
+void CMiniDexed::FlushPendingVoice (unsigned nTG)
 {
-	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
-	{
-		m_PerformanceConfig.SetBankNumber (m_nVoiceBankID[nTG], nTG);
-		m_PerformanceConfig.SetVoiceNumber (m_nProgram[nTG], nTG);
-		m_PerformanceConfig.SetMIDIChannel (m_nMIDIChannel[nTG], nTG);
-		m_PerformanceConfig.SetVolume (m_nVolume[nTG], nTG);
-		m_PerformanceConfig.SetPan (m_nPan[nTG], nTG);
-		m_PerformanceConfig.SetDetune (m_nMasterTune[nTG], nTG);
-		m_PerformanceConfig.SetCutoff (m_nCutoff[nTG], nTG);
-		m_PerformanceConfig.SetResonance (m_nResonance[nTG], nTG);
-		m_PerformanceConfig.SetPitchBendRange (m_nPitchBendRange[nTG], nTG);
-		m_PerformanceConfig.SetPitchBendStep	(m_nPitchBendStep[nTG], nTG);
-		m_PerformanceConfig.SetPortamentoMode (m_nPortamentoMode[nTG], nTG);
-		m_PerformanceConfig.SetPortamentoGlissando (m_nPortamentoGlissando[nTG], nTG);
-		m_PerformanceConfig.SetPortamentoTime (m_nPortamentoTime[nTG], nTG);
-
-		m_PerformanceConfig.SetNoteLimitLow (m_nNoteLimitLow[nTG], nTG);
-		m_PerformanceConfig.SetNoteLimitHigh (m_nNoteLimitHigh[nTG], nTG);
-		m_PerformanceConfig.SetNoteShift (m_nNoteShift[nTG], nTG);
-		m_pTG[nTG]->getVoiceData(m_nRawVoiceData);  
- 		m_PerformanceConfig.SetVoiceDataToTxt (m_nRawVoiceData, nTG); 
-		m_PerformanceConfig.SetMonoMode (m_bMonoMode[nTG], nTG); 
-				
-		m_PerformanceConfig.SetModulationWheelRange (m_nModulationWheelRange[nTG], nTG);
-		m_PerformanceConfig.SetModulationWheelTarget (m_nModulationWheelTarget[nTG], nTG);
-		m_PerformanceConfig.SetFootControlRange (m_nFootControlRange[nTG], nTG);
-		m_PerformanceConfig.SetFootControlTarget (m_nFootControlTarget[nTG], nTG);
-		m_PerformanceConfig.SetBreathControlRange (m_nBreathControlRange[nTG], nTG);
-		m_PerformanceConfig.SetBreathControlTarget (m_nBreathControlTarget[nTG], nTG);
-		m_PerformanceConfig.SetAftertouchRange (m_nAftertouchRange[nTG], nTG);
-		m_PerformanceConfig.SetAftertouchTarget (m_nAftertouchTarget[nTG], nTG);
-		
-		m_PerformanceConfig.SetReverbSend (m_nReverbSend[nTG], nTG);
-	}
+	assert (nTG < CConfig::ToneGenerators);
 
-	m_PerformanceConfig.SetCompressorEnable (!!m_nParameter[ParameterCompressorEnable]);
-	m_PerformanceConfig.SetReverbEnable (!!m_nParameter[ParameterReverbEnable]);
-	m_PerformanceConfig.SetReverbSize (m_nParameter[ParameterReverbSize]);
-	m_PerformanceConfig.SetReverbHighDamp (m_nParameter[ParameterReverbHighDamp]);
-	m_PerformanceConfig.SetReverbLowDamp (m_nParameter[ParameterReverbLowDamp]);
-	m_PerformanceConfig.SetReverbLowPass (m_nParameter[ParameterReverbLowPass]);
-	m_PerformanceConfig.SetReverbDiffusion (m_nParameter[ParameterReverbDiffusion]);
-	m_PerformanceConfig.SetReverbLevel (m_nParameter[ParameterReverbLevel]);
+	m_VoiceSwapSpinLock.Acquire ();
 
-	if(m_bSaveAsDeault)
+	if (m_bVoicePending[nTG])
 	{
-		m_PerformanceConfig.SetNewPerformance(0);
-		
+		assert (m_pTG[nTG]);
+		m_pTG[nTG]->loadVoiceParameters (m_PendingVoice[nTG]);
+
+		m_bVoicePending[nTG] = false;
 	}
-	return m_PerformanceConfig.Save ();
+
+	m_VoiceSwapSpinLock.Release ();
 }
 
-void CMiniDexed::setMonoMode(uint8_t mono, uint8_t nTG)
+void CMiniDexed::GetVoiceData (uint8_t *pData, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
 	assert (m_pTG[nTG]);
-	m_bMonoMode[nTG]= mono != 0; 
-	m_pTG[nTG]->setMonoMode(constrain(mono, 0, 1));
-	m_pTG[nTG]->doRefreshVoice();
-	m_UI.ParameterChanged ();
-}
+	assert (pData);
 
-void CMiniDexed::setPitchbendRange(uint8_t range, uint8_t nTG)
-{
+	m_VoiceSwapSpinLock.Acquire ();
+
+	if (m_bVoicePending[nTG])
+	{
+		memcpy (pData, m_PendingVoice[nTG], sizeof m_PendingVoice[nTG]);
+	}
+	else
+	{
+		m_pTG[nTG]->getVoiceData (pData);
+	}
+
+	m_VoiceSwapSpinLock.Release ();
+}
+
+// Loads the pending voices at the chunk boundary, so that this does not delay
+// the MIDI handling and does not wait for the TG spin lock. With fading enabled,
+// a TG is swapped, when ApplyVoiceFade() has faded it out completely. The
+// profile shows the maximum time of a single swap.
+void CMiniDexed::SwapVoices (void)
+{
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		if (   !m_bVoicePending[nTG]
+		    || (   m_fVoiceFadeStep > 0.0f
+			&& m_fVoiceFadeGain[nTG] > 0.0f))
+		{
+			continue;
+		}
+
+		if (m_bProfileEnabled)
+		{
+			m_VoiceSwapTimer.Start ();
+		}
+
+		FlushPendingVoice (nTG);
+
+		if (m_bProfileEnabled)
+		{
+			m_VoiceSwapTimer.Stop ();
+		}
+	}
+}
+
+void CMiniDexed::ApplyVoiceFade (float32_t *pBuffer, unsigned nFrames, unsigned nTG)
+{
+	assert (pBuffer);
+	assert (nTG < CConfig::ToneGenerators);
+
+	float32_t fGain = m_fVoiceFadeGain[nTG];
+	bool bFadeOut = m_bVoicePending[nTG] || m_bPerformanceSwitchPending;
+
+	if (   m_fVoiceFadeStep == 0.0f
+	    || (   fGain >= 1.0f
+		&& !bFadeOut))
+	{
+		return;
+	}
+
+	// fade out towards a pending voice swap, fade in afterwards
+	float32_t fStep = bFadeOut ? -m_fVoiceFadeStep : m_fVoiceFadeStep;
+	for (unsigned i = 0; i < nFrames; i++)
+	{
+		fGain += fStep;
+		if (fGain < 0.0f)
+		{
+			fGain = 0.0f;
+		}
+		else if (fGain > 1.0f)
+		{
+			fGain = 1.0f;
+		}
+
+		pBuffer[i] *= fGain;
+	}
+
+	m_fVoiceFadeGain[nTG] = fGain;
+}
+
+unsigned CMiniDexed::GetPerformanceSelectChannel (void)
+{
+	// Stores and returns Select Channel using MIDI Device Channel definitions
+	return (unsigned) GetParameter (ParameterPerformanceSelectChannel);
+}
+
+void CMiniDexed::SetPerformanceSelectChannel (unsigned uCh)
+{
+	// Turns a configuration setting to MIDI Device Channel definitions
+	// Mirrors the logic in Performance Config for handling MIDI channel configuration
+	if (uCh == 0)
+	{
+		SetParameter (ParameterPerformanceSelectChannel, CMIDIDevice::Disabled);
+	}
+	else if (uCh < CMIDIDevice::Channels)
+	{
+		SetParameter (ParameterPerformanceSelectChannel, uCh - 1);
+	}
+	else
+	{
+		SetParameter (ParameterPerformanceSelectChannel, CMIDIDevice::OmniMode);
+	}
+}
+
+bool CMiniDexed::SavePerformance (bool bSaveAsDeault)
+{
+	m_bSavePerformance = true;
+	m_bSaveAsDeault=bSaveAsDeault;
+
+	return true;
+}
+
+bool CMiniDexed::DoSavePerformance (void)
+{
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		m_PerformanceConfig.SetBankNumber (m_TGParameters.Get (TGParameterVoiceBank, nTG), nTG);
+		m_PerformanceConfig.SetVoiceNumber (m_TGParameters.Get (TGParameterProgram, nTG), nTG);
+		m_PerformanceConfig.SetMIDIChannel (m_TGParameters.Get (TGParameterMIDIChannel, nTG), nTG);
+		m_PerformanceConfig.SetVolume (m_TGParameters.Get (TGParameterVolume, nTG), nTG);
+		m_PerformanceConfig.SetPan (m_TGParameters.Get (TGParameterPan, nTG), nTG);
+		m_PerformanceConfig.SetDetune (m_TGParameters.Get (TGParameterMasterTune, nTG), nTG);
+		m_PerformanceConfig.SetCutoff (m_TGParameters.Get (TGParameterCutoff, nTG), nTG);
+		m_PerformanceConfig.SetResonance (m_TGParameters.Get (TGParameterResonance, nTG), nTG);
+		m_PerformanceConfig.SetPitchBendRange (m_TGParameters.Get (TGParameterPitchBendRange, nTG), nTG);
+		m_PerformanceConfig.SetPitchBendStep	(m_TGParameters.Get (TGParameterPitchBendStep, nTG), nTG);
+		m_PerformanceConfig.SetPortamentoMode (m_TGParameters.Get (TGParameterPortamentoMode, nTG), nTG);
+		m_PerformanceConfig.SetPortamentoGlissando (m_TGParameters.Get (TGParameterPortamentoGlissando, nTG), nTG);
+		m_PerformanceConfig.SetPortamentoTime (m_TGParameters.Get (TGParameterPortamentoTime, nTG), nTG);
+
+		m_PerformanceConfig.SetNoteLimitLow (m_TGParameters.Get (TGParameterNoteLimitLow, nTG), nTG);
+		m_PerformanceConfig.SetNoteLimitHigh (m_TGParameters.Get (TGParameterNoteLimitHigh, nTG), nTG);
+		m_PerformanceConfig.SetNoteShift (m_TGParameters.Get (TGParameterNoteShift, nTG), nTG);
+		GetVoiceData (m_nRawVoiceData, nTG);
+ 		m_PerformanceConfig.SetVoiceDataToTxt (m_nRawVoiceData, nTG); 
+		m_PerformanceConfig.SetMonoMode (m_TGParameters.Get (TGParameterMonoMode, nTG), nTG); 
+				
+		m_PerformanceConfig.SetModulationWheelRange (m_TGParameters.Get (TGParameterMWRange, nTG), nTG);
+		m_PerformanceConfig.SetModulationWheelTarget (GetControllerTarget (TGParameterMWPitch, nTG), nTG);
+		m_PerformanceConfig.SetFootControlRange (m_TGParameters.Get (TGParameterFCRange, nTG), nTG);
+		m_PerformanceConfig.SetFootControlTarget (GetControllerTarget (TGParameterFCPitch, nTG), nTG);
+		m_PerformanceConfig.SetBreathControlRange (m_TGParameters.Get (TGParameterBCRange, nTG), nTG);
+		m_PerformanceConfig.SetBreathControlTarget (GetControllerTarget (TGParameterBCPitch, nTG), nTG);
+		m_PerformanceConfig.SetAftertouchRange (m_TGParameters.Get (TGParameterATRange, nTG), nTG);
+		m_PerformanceConfig.SetAftertouchTarget (GetControllerTarget (TGParameterATPitch, nTG), nTG);
+		
+		m_PerformanceConfig.SetReverbSend (m_TGParameters.Get (TGParameterReverbSend, nTG), nTG);
+	}
+
+	m_PerformanceConfig.SetCompressorEnable (!!m_nParameter[ParameterCompressorEnable]);
+	m_PerformanceConfig.SetReverbEnable (!!m_nParameter[ParameterReverbEnable]);
+	m_PerformanceConfig.SetReverbSize (m_nParameter[ParameterReverbSize]);
+	m_PerformanceConfig.SetReverbHighDamp (m_nParameter[ParameterReverbHighDamp]);
+	m_PerformanceConfig.SetReverbLowDamp (m_nParameter[ParameterReverbLowDamp]);
+	m_PerformanceConfig.SetReverbLowPass (m_nParameter[ParameterReverbLowPass]);
+	m_PerformanceConfig.SetReverbDiffusion (m_nParameter[ParameterReverbDiffusion]);
+	m_PerformanceConfig.SetReverbLevel (m_nParameter[ParameterReverbLevel]);
+
+	if(m_bSaveAsDeault)
+	{
+		m_PerformanceConfig.SetNewPerformance(0);
+		
+	}
+	return m_PerformanceConfig.Save ();
+}
+
+void CMiniDexed::setMonoMode(uint8_t mono, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+	m_TGParameters.Set (TGParameterMonoMode, mono != 0, nTG); 
+	ParameterChanged ();
+}
+
+void CMiniDexed::setPitchbendRange(uint8_t range, uint8_t nTG)
+{
 	range = constrain (range, 0, 12);
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_nPitchBendRange[nTG] = range;
-	
-	m_pTG[nTG]->setPitchbendRange(range);
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	m_TGParameters.Set (TGParameterPitchBendRange, range, nTG);
+	ParameterChanged ();
 }
 
 void CMiniDexed::setPitchbendStep(uint8_t step, uint8_t nTG)
 {
 	step= constrain (step, 0, 12);
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_nPitchBendStep[nTG] = step;
-	
-	m_pTG[nTG]->setPitchbendStep(step);
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	m_TGParameters.Set (TGParameterPitchBendStep, step, nTG);
+	ParameterChanged ();
 }
 
 void CMiniDexed::setPortamentoMode(uint8_t mode, uint8_t nTG)
@@ -1280,264 +1961,906 @@ void CMiniDexed::setPortamentoMode(uint8_t mode, uint8_t nTG)
 	mode= constrain (mode, 0, 1);
 
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_nPortamentoMode[nTG] = mode;
-	
-	m_pTG[nTG]->setPortamentoMode(mode);
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	m_TGParameters.Set (TGParameterPortamentoMode, mode, nTG);
+	ParameterChanged ();
 }
 
 void CMiniDexed::setPortamentoGlissando(uint8_t glissando, uint8_t nTG)
 {
 	glissando = constrain (glissando, 0, 1);
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_nPortamentoGlissando[nTG] = glissando;
-	
-	m_pTG[nTG]->setPortamentoGlissando(glissando);
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	m_TGParameters.Set (TGParameterPortamentoGlissando, glissando, nTG);
+	ParameterChanged ();
 }
 
 void CMiniDexed::setPortamentoTime(uint8_t time, uint8_t nTG)
 {
 	time = constrain (time, 0, 99);
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-	m_nPortamentoTime[nTG] = time;
-	
-	m_pTG[nTG]->setPortamentoTime(time);
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	m_TGParameters.Set (TGParameterPortamentoTime, time, nTG);
+	ParameterChanged ();
 }
 
 void CMiniDexed::setModWheelRange(uint8_t range, uint8_t nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
 
-	m_nModulationWheelRange[nTG] = range;
-	m_pTG[nTG]->setMWController(range, m_pTG[nTG]->getModWheelTarget(), 0);
-//	m_pTG[nTG]->setModWheelRange(constrain(range, 0, 99));  replaces with the above due to wrong constrain on dexed_synth module. 
+	m_TGParameters.Set (TGParameterMWRange, range, nTG);
 
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	ParameterChanged ();
 }
 
 void CMiniDexed::setModWheelTarget(uint8_t target, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	SetControllerTarget (TGParameterMWPitch, target, nTG);
+	ParameterChanged ();
+}
+
+void CMiniDexed::setFootControllerRange(uint8_t range, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	m_TGParameters.Set (TGParameterFCRange, range, nTG);
+
+	ParameterChanged ();
+}
+
+void CMiniDexed::setFootControllerTarget(uint8_t target, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	SetControllerTarget (TGParameterFCPitch, target, nTG);
+	ParameterChanged ();
+}
+
+void CMiniDexed::setBreathControllerRange(uint8_t range, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	m_TGParameters.Set (TGParameterBCRange, range, nTG);
+
+	ParameterChanged ();
+}
+
+void CMiniDexed::setBreathControllerTarget(uint8_t target, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	SetControllerTarget (TGParameterBCPitch, target, nTG);
+	ParameterChanged ();
+}
+
+void CMiniDexed::setAftertouchRange(uint8_t range, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	m_TGParameters.Set (TGParameterATRange, range, nTG);
+
+	ParameterChanged ();
+}
+
+void CMiniDexed::setAftertouchTarget(uint8_t target, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	SetControllerTarget (TGParameterATPitch, target, nTG);
+	ParameterChanged ();
+}
+
+void CMiniDexed::loadVoiceParameters(const uint8_t* data, uint8_t nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
 	assert (m_pTG[nTG]);
 
-	m_nModulationWheelTarget[nTG] = target;
+	uint8_t voice[161];
+
+	memcpy(voice, data, sizeof(uint8_t)*161);
 
-	m_pTG[nTG]->setModWheelTarget(constrain(target, 0, 7));
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	// fix voice name
+	for (uint8_t i = 0; i < 10; i++)
+	{
+		if (voice[151 + i] > 126) // filter characters
+			voice[151 + i] = 32;
+	}
+
+	CancelPendingVoice (nTG);
+	m_pTG[nTG]->loadVoiceParameters(&voice[6]);
+	m_pTG[nTG]->doRefreshVoice();
+	ParameterChanged ();
 }
 
-void CMiniDexed::setFootControllerRange(uint8_t range, uint8_t nTG)
+void CMiniDexed::BankBulkDump (const uint8_t *pMessage, size_t nLength, unsigned nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	if (BankDumpStart ())
+	{
+		BankDumpWrite (pMessage, nLength);
+		BankDumpEnd (nTG);
+	}
+}
+
+bool CMiniDexed::BankDumpStart (void)
+{
+	if (!m_SysExFileLoader.BankDumpStart ())
+	{
+		LOGWARN ("Bank bulk dump ignored, receiver is busy");
+
+		return false;
+	}
+
+	return true;
+}
+
+void CMiniDexed::BankDumpWrite (const uint8_t *pData, size_t nLength)
+{
+	m_SysExFileLoader.BankDumpWrite (pData, nLength);
+}
+
+void CMiniDexed::BankDumpEnd (unsigned nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+
+	int nBankID = m_SysExFileLoader.BankDumpEnd ();
+	if (nBankID < 0)
+	{
+		LOGWARN ("Bank bulk dump rejected");
+
+		return;
+	}
+
+	LOGNOTE ("Bank bulk dump received as bank #%d", nBankID+1);
+
+	// like on a DX7 the received voices are available at once
+	BankSelect (nBankID, nTG);
+	ProgramChange (m_TGParameters.Get (TGParameterProgram, nTG), nTG);
+}
+
+void CMiniDexed::BankDumpAbort (void)
+{
+	m_SysExFileLoader.BankDumpAbort ();
+
+	LOGWARN ("Bank bulk dump aborted");
+}
+
+void CMiniDexed::VoiceSearchRequest (const uint8_t *pMessage, size_t nLength,
+				     CMIDIDevice *pDevice, unsigned nCable)
+{
+	assert (pMessage);
+	assert (pDevice);
+
+	size_t nQueryLength = nLength >= 6 ? nLength - 5 : 0;
+	if (   nQueryLength == 0
+	    || nQueryLength > CVoiceNameIndex::NameLength
+	    || pMessage[3] > 1
+	    || pMessage[nLength-1] != 0xF7)
+	{
+		LOGWARN ("Invalid voice search request");
+
+		return;
+	}
+
+	if (__atomic_load_n (&m_pVoiceSearchDevice, __ATOMIC_ACQUIRE))
+	{
+		return;				// previous request is still pending
+	}
+
+	memcpy (m_VoiceSearchQuery, &pMessage[4], nQueryLength);
+	m_VoiceSearchQuery[nQueryLength] = '\0';
+	m_bVoiceSearchPrefix = pMessage[3] == 1;
+	m_nVoiceSearchCable = nCable;
+
+	__atomic_store_n (&m_pVoiceSearchDevice, pDevice, __ATOMIC_RELEASE);
+}
+
+void CMiniDexed::ProcessVoiceSearch (void)
+{
+	CMIDIDevice *pDevice = __atomic_load_n (&m_pVoiceSearchDevice, __ATOMIC_ACQUIRE);
+	if (!pDevice)
+	{
+		return;
+	}
+
+	CVoiceNameIndex::TMatch Matches[MaxVoiceSearchMatches];
+	unsigned nMatches = m_SysExFileLoader.FindVoices (m_VoiceSearchQuery, m_bVoiceSearchPrefix,
+							  Matches, MaxVoiceSearchMatches);
+
+	uint8_t Reply[5 + MaxVoiceSearchMatches * (3+CVoiceNameIndex::NameLength)];
+	unsigned nLength = 0;
+	Reply[nLength++] = 0xF0;
+	Reply[nLength++] = 0x7D;		// non-commercial
+	Reply[nLength++] = 0x02;		// voice search reply
+	Reply[nLength++] = nMatches;
+
+	for (unsigned i = 0; i < nMatches; i++)
+	{
+		Reply[nLength++] = Matches[i].nBankID >> 7;
+		Reply[nLength++] = Matches[i].nBankID & 0x7F;
+		Reply[nLength++] = Matches[i].nVoiceID;
+		memcpy (&Reply[nLength], Matches[i].Name, CVoiceNameIndex::NameLength);
+		nLength += CVoiceNameIndex::NameLength;
+	}
+
+	Reply[nLength++] = 0xF7;
+	assert (nLength <= sizeof Reply);
+
+	pDevice->Send (Reply, nLength, m_nVoiceSearchCable);
+
+	__atomic_store_n (&m_pVoiceSearchDevice, nullptr, __ATOMIC_RELEASE);
+}
+
+void CMiniDexed::GetSnapshot (CSynthSnapshot *pSnapshot)
+{
+	assert (pSnapshot);
+
+	pSnapshot->SetHeader ();
+
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		CSynthSnapshot::TToneGenerator *pTG = &pSnapshot->TG[nTG];
+
+		GetVoiceData (pTG->VoiceData, nTG);
+
+		pTG->nBankMSB = m_TGParameters.Get (TGParameterVoiceBank, nTG) >> 7;
+		pTG->nBankLSB = m_TGParameters.Get (TGParameterVoiceBank, nTG) & 0x7F;
+		pTG->nProgram = m_TGParameters.Get (TGParameterProgram, nTG);
+		pTG->nMIDIChannel = m_TGParameters.Get (TGParameterMIDIChannel, nTG);
+		pTG->nVolume = m_TGParameters.Get (TGParameterVolume, nTG);
+		pTG->nPan = m_TGParameters.Get (TGParameterPan, nTG);
+		pTG->nMasterTune = m_TGParameters.Get (TGParameterMasterTune, nTG);
+		pTG->nCutoff = m_TGParameters.Get (TGParameterCutoff, nTG);
+		pTG->nResonance = m_TGParameters.Get (TGParameterResonance, nTG);
+		pTG->nNoteLimitLow = m_TGParameters.Get (TGParameterNoteLimitLow, nTG);
+		pTG->nNoteLimitHigh = m_TGParameters.Get (TGParameterNoteLimitHigh, nTG);
+		pTG->nNoteShift = m_TGParameters.Get (TGParameterNoteShift, nTG);
+		pTG->nReverbSend = m_TGParameters.Get (TGParameterReverbSend, nTG);
+		pTG->nPitchBendRange = m_TGParameters.Get (TGParameterPitchBendRange, nTG);
+		pTG->nPitchBendStep = m_TGParameters.Get (TGParameterPitchBendStep, nTG);
+		pTG->nPortamentoMode = m_TGParameters.Get (TGParameterPortamentoMode, nTG);
+		pTG->nPortamentoGlissando = m_TGParameters.Get (TGParameterPortamentoGlissando, nTG);
+		pTG->nPortamentoTime = m_TGParameters.Get (TGParameterPortamentoTime, nTG);
+		pTG->bMonoMode = m_TGParameters.Get (TGParameterMonoMode, nTG) ? 1 : 0;
+		pTG->nModulationWheelRange = m_TGParameters.Get (TGParameterMWRange, nTG);
+		pTG->nModulationWheelTarget = GetControllerTarget (TGParameterMWPitch, nTG);
+		pTG->nFootControlRange = m_TGParameters.Get (TGParameterFCRange, nTG);
+		pTG->nFootControlTarget = GetControllerTarget (TGParameterFCPitch, nTG);
+		pTG->nBreathControlRange = m_TGParameters.Get (TGParameterBCRange, nTG);
+		pTG->nBreathControlTarget = GetControllerTarget (TGParameterBCPitch, nTG);
+		pTG->nAftertouchRange = m_TGParameters.Get (TGParameterATRange, nTG);
+		pTG->nAftertouchTarget = GetControllerTarget (TGParameterATPitch, nTG);
+	}
+
+	pSnapshot->bCompressorEnable = m_nParameter[ParameterCompressorEnable];
+	pSnapshot->bReverbEnable = m_nParameter[ParameterReverbEnable];
+	pSnapshot->nReverbSize = m_nParameter[ParameterReverbSize];
+	pSnapshot->nReverbHighDamp = m_nParameter[ParameterReverbHighDamp];
+	pSnapshot->nReverbLowDamp = m_nParameter[ParameterReverbLowDamp];
+	pSnapshot->nReverbLowPass = m_nParameter[ParameterReverbLowPass];
+	pSnapshot->nReverbDiffusion = m_nParameter[ParameterReverbDiffusion];
+	pSnapshot->nReverbLevel = m_nParameter[ParameterReverbLevel];
+}
+
+bool CMiniDexed::SetSnapshot (const CSynthSnapshot &rSnapshot)
+{
+	if (!rSnapshot.IsValid ())
+	{
+		LOGWARN ("Invalid snapshot");
+
+		return false;
+	}
+
+	BeginParameterUpdate ();
+
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		const CSynthSnapshot::TToneGenerator &rTG = rSnapshot.TG[nTG];
+
+		// the voice data is authoritative, bank and program are restored
+		// for display and further program changes only
+		__atomic_store_n (&m_nPendingProgram[nTG], -1, __ATOMIC_RELEASE);
+		m_TGParameters.Set (TGParameterVoiceBank, (rTG.nBankMSB & 0x7F) << 7 | (rTG.nBankLSB & 0x7F), nTG);
+		m_nVoiceBankIDMSB[nTG] = rTG.nBankMSB & 0x7F;
+		m_TGParameters.Set (TGParameterProgram, constrain ((int) rTG.nProgram, 0, 31), nTG);
+
+		// swapped in by ProcessSound(), while the TG is not rendered
+		SetPendingVoice (rTG.VoiceData, nTG);
+
+		SetMIDIChannel (rTG.nMIDIChannel, nTG);
+		SetVolume (rTG.nVolume, nTG);
+		SetPan (rTG.nPan, nTG);
+		SetMasterTune (rTG.nMasterTune, nTG);
+		SetCutoff (rTG.nCutoff, nTG);
+		SetResonance (rTG.nResonance, nTG);
+		setPitchbendRange (rTG.nPitchBendRange, nTG);
+		setPitchbendStep (rTG.nPitchBendStep, nTG);
+		setPortamentoMode (rTG.nPortamentoMode, nTG);
+		setPortamentoGlissando (rTG.nPortamentoGlissando, nTG);
+		setPortamentoTime (rTG.nPortamentoTime, nTG);
+
+		SetNoteLimitLow (rTG.nNoteLimitLow, nTG);
+		SetNoteLimitHigh (rTG.nNoteLimitHigh, nTG);
+		SetNoteShift (rTG.nNoteShift, nTG);
+
+		setMonoMode (rTG.bMonoMode ? 1 : 0, nTG);
+		SetReverbSend (rTG.nReverbSend, nTG);
+
+		setModWheelRange (rTG.nModulationWheelRange, nTG);
+		setModWheelTarget (rTG.nModulationWheelTarget, nTG);
+		setFootControllerRange (rTG.nFootControlRange, nTG);
+		setFootControllerTarget (rTG.nFootControlTarget, nTG);
+		setBreathControllerRange (rTG.nBreathControlRange, nTG);
+		setBreathControllerTarget (rTG.nBreathControlTarget, nTG);
+		setAftertouchRange (rTG.nAftertouchRange, nTG);
+		setAftertouchTarget (rTG.nAftertouchTarget, nTG);
+	}
+
+	SetParameter (ParameterCompressorEnable, rSnapshot.bCompressorEnable ? 1 : 0);
+	SetParameter (ParameterReverbEnable, rSnapshot.bReverbEnable ? 1 : 0);
+	SetParameter (ParameterReverbSize, rSnapshot.nReverbSize);
+	SetParameter (ParameterReverbHighDamp, rSnapshot.nReverbHighDamp);
+	SetParameter (ParameterReverbLowDamp, rSnapshot.nReverbLowDamp);
+	SetParameter (ParameterReverbLowPass, rSnapshot.nReverbLowPass);
+	SetParameter (ParameterReverbDiffusion, rSnapshot.nReverbDiffusion);
+	SetParameter (ParameterReverbLevel, rSnapshot.nReverbLevel);
+
+	EndParameterUpdate ();
+
+	return true;
+}
+
+void CMiniDexed::SnapshotSysEx (const uint8_t *pMessage, size_t nLength,
+				CMIDIDevice *pDevice, unsigned nCable)
+{
+	assert (pMessage);
+	assert (pDevice);
+	assert (nLength >= 3);
+
+	if (pMessage[2] == 0x03)		// snapshot request
+	{
+		if (   nLength != 4
+		    || pMessage[3] != 0xF7)
+		{
+			LOGWARN ("Invalid snapshot request");
+
+			return;
+		}
+
+		if (__atomic_load_n (&m_pSnapshotRequestDevice, __ATOMIC_ACQUIRE))
+		{
+			return;			// previous request is still pending
+		}
+
+		m_nSnapshotRequestCable = nCable;
+
+		__atomic_store_n (&m_pSnapshotRequestDevice, pDevice, __ATOMIC_RELEASE);
+
+		return;
+	}
+
+	if (__atomic_load_n (&m_bSnapshotReceived, __ATOMIC_ACQUIRE))
+	{
+		return;				// previous snapshot is still pending
+	}
+
+	if (!m_ReceivedSnapshot.FromSysEx (pMessage, nLength))
+	{
+		LOGWARN ("Invalid snapshot dump");
+
+		return;
+	}
+
+	__atomic_store_n (&m_bSnapshotReceived, true, __ATOMIC_RELEASE);
+}
+
+void CMiniDexed::ProcessSnapshotSysEx (void)
+{
+	if (__atomic_load_n (&m_bSnapshotReceived, __ATOMIC_ACQUIRE))
+	{
+		StopMorph ();
+		SetSnapshot (m_ReceivedSnapshot);
+
+		__atomic_store_n (&m_bSnapshotReceived, false, __ATOMIC_RELEASE);
+	}
+
+	CMIDIDevice *pDevice = __atomic_load_n (&m_pSnapshotRequestDevice, __ATOMIC_ACQUIRE);
+	if (pDevice)
+	{
+		CSynthSnapshot Snapshot;
+		GetSnapshot (&Snapshot);
+
+		unsigned nLength = Snapshot.ToSysEx (m_SnapshotDump);
+
+		pDevice->Send (m_SnapshotDump, nLength, m_nSnapshotRequestCable);
+
+		__atomic_store_n (&m_pSnapshotRequestDevice, nullptr, __ATOMIC_RELEASE);
+	}
+}
+
+void CMiniDexed::setVoiceDataElement(uint8_t data, uint8_t number, uint8_t nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
 	assert (m_pTG[nTG]);
 
-	m_nFootControlRange[nTG]=range;
-	m_pTG[nTG]->setFCController(range, m_pTG[nTG]->getFootControllerTarget(), 0);
-//	m_pTG[nTG]->setFootControllerRange(constrain(range, 0, 99));  replaces with the above due to wrong constrain on dexed_synth module. 
+	FlushPendingVoice (nTG);
+	m_pTG[nTG]->setVoiceDataElement(constrain(data, 0, 155),constrain(number, 0, 99));
+	//m_pTG[nTG]->doRefreshVoice();
+	ParameterChanged ();
+}
+
+int16_t CMiniDexed::checkSystemExclusive(const uint8_t* pMessage,const  uint16_t nLength, uint8_t nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
+	assert (m_pTG[nTG]);
 
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	return(m_pTG[nTG]->checkSystemExclusive(pMessage, nLength));
 }
 
-void CMiniDexed::setFootControllerTarget(uint8_t target, uint8_t nTG)
+void CMiniDexed::getSysExVoiceDump(uint8_t* dest, uint8_t nTG)
+{
+	uint8_t checksum = 0;
+	uint8_t data[156];
+
+	assert (nTG < CConfig::ToneGenerators);
+	assert (m_pTG[nTG]);
+
+	GetVoiceData (data, nTG);
+
+	dest[0] = 0xF0; // SysEx start
+	dest[1] = 0x43; // ID=Yamaha
+	dest[2] = 0x00 | m_TGParameters.Get (TGParameterMIDIChannel, nTG); // 0x0c Sub-status 0 and MIDI channel
+	dest[3] = 0x00; // Format number (0=1 voice)
+	dest[4] = 0x01; // Byte count MSB
+	dest[5] = 0x1B; // Byte count LSB
+	for (uint8_t n = 0; n < 155; n++)
+	{
+		checksum -= data[n];
+		dest[6 + n] = data[n];
+	}
+	dest[161] = checksum & 0x7f; // Checksum
+	dest[162] = 0xF7; // SysEx end
+}
+
+void CMiniDexed::setMasterVolume (float32_t vol)
+{
+	if(vol < 0.0)
+		vol = 0.0;
+	else if(vol > 1.0)
+		vol = 1.0;
+
+	nMasterVolume=vol;
+}
+
+std::string CMiniDexed::GetPerformanceFileName(unsigned nID)
+{
+	return m_PerformanceConfig.GetPerformanceFileName(nID);
+}
+
+std::string CMiniDexed::GetPerformanceName(unsigned nID)
+{
+	return m_PerformanceConfig.GetPerformanceName(nID);
+}
+
+unsigned CMiniDexed::GetLastPerformance()
+{
+	return m_PerformanceConfig.GetLastPerformance();
+}
+
+unsigned CMiniDexed::GetActualPerformanceID()
+{
+	return m_PerformanceConfig.GetActualPerformanceID();
+}
+
+void CMiniDexed::SetActualPerformanceID(unsigned nID)
+{
+	m_PerformanceConfig.SetActualPerformanceID(nID);
+}
+
+bool CMiniDexed::SetNewPerformance(unsigned nID)
+{
+	StopMorph ();
+
+	m_bSetNewPerformance = true;
+	m_nSetNewPerformanceID = nID;
+
+	return true;
+}
+
+// Prepares the switch to the new performance, which is done by ProcessSound()
+// at the next chunk boundaries. Returns false, if it has to be called again,
+// because voice banks are loaded.
+bool CMiniDexed::DoSetNewPerformance (void)
 {
+	unsigned nID = m_nSetNewPerformanceID;
+
+	// from the performance table, the file is read only, if it is not there yet
+	const CPerformanceConfig::TPerformance *pPerformance = m_PerformanceConfig.GetStoredPerformance (nID);
+	if (   !pPerformance
+	    || !pPerformance->bMIDIChannelSet)
+	{
+		m_PerformanceConfig.SetNewPerformance(nID);
+		if (pPerformance)
+		{
+			m_PerformanceConfig.SetPerformance (*pPerformance);
+		}
+
+		SetMIDIChannel (CMIDIDevice::OmniMode, 0);
+		return true;
+	}
+
+	const CPerformanceConfig::TPerformance &rPerformance = *pPerformance;
+
+	// all voices must be available, to switch at once
+	bool bComplete = true;
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		// an unknown bank is ignored like in BankSelect()
+		unsigned nBank = constrain ((int) rPerformance.nBankNumber[nTG], 0, 16383);
+		if (!m_SysExFileLoader.IsValidBank (nBank))
+		{
+			nBank = m_TGParameters.Get (TGParameterVoiceBank, nTG);
+		}
+		m_nSwitchBank[nTG] = nBank;
+
+		if (rPerformance.bVoiceDataFilled[nTG])
+		{
+			memcpy (m_SwitchVoice[nTG], rPerformance.VoiceData[nTG], sizeof m_SwitchVoice[nTG]);
+		}
+		else if (!m_SysExFileLoader.GetVoice (nBank, constrain ((int) rPerformance.nVoiceNumber[nTG], 0, 31),
+						      m_SwitchVoice[nTG]))
+		{
+			bComplete = false;		// the bank has been requested
+		}
+	}
+
+	if (!bComplete)
+	{
+		return false;
+	}
+
+	m_SwitchPerformance = rPerformance;
+
+	m_PerformanceConfig.SetNewPerformance(nID);
+	m_PerformanceConfig.SetPerformance (rPerformance);
+
+	m_nSwitchTG = 0;
+	m_bLoadPerformanceBusy = true;		// until the switch is done
+	__atomic_store_n (&m_bPerformanceSwitchPending, true, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+// Switches to the prepared performance at the chunk boundaries, one TG per
+// chunk, so that the audio core never loads all voices at once. The effects
+// are set with the last TG. With fading enabled, this waits until all TGs have
+// been faded out, and they stay silent until the last TG has been switched.
+void CMiniDexed::SwapPerformance (void)
+{
+	if (!__atomic_load_n (&m_bPerformanceSwitchPending, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+
+	if (m_fVoiceFadeStep > 0.0f)
+	{
+		for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+		{
+			if (m_fVoiceFadeGain[nTG] > 0.0f)
+			{
+				return;
+			}
+		}
+	}
+
+	const CPerformanceConfig::TPerformance &rPerformance = m_SwitchPerformance;
+
+	unsigned nTG = m_nSwitchTG;
 	assert (nTG < CConfig::ToneGenerators);
+
+	m_TGParameters.Set (TGParameterVoiceBank, m_nSwitchBank[nTG], nTG);
+	m_TGParameters.Set (TGParameterProgram, constrain ((int) rPerformance.nVoiceNumber[nTG], 0, 31), nTG);
+
+	CancelPendingVoice (nTG);
+
 	assert (m_pTG[nTG]);
+	m_pTG[nTG]->loadVoiceParameters (m_SwitchVoice[nTG]);
+
+	BeginParameterUpdate ();
+
+	SetTGPerformanceParameters (rPerformance, nTG);
 
-	m_nFootControlTarget[nTG] = target;
+	if (++m_nSwitchTG == CConfig::ToneGenerators)
+	{
+		SetEffectPerformanceParameters (rPerformance);
+
+		__atomic_store_n (&m_bPerformanceSwitchPending, false, __ATOMIC_RELEASE);
+	}
 
-	m_pTG[nTG]->setFootControllerTarget(constrain(target, 0, 7));
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	EndParameterUpdate ();
 }
 
-void CMiniDexed::setBreathControllerRange(uint8_t range, uint8_t nTG)
+void CMiniDexed::SetMorphPerformances (unsigned nFromID, unsigned nToID)
 {
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	m_nMorphFromID = nFromID;
+	m_nMorphToID = nToID;
 
-	m_nBreathControlRange[nTG]=range;
-	m_pTG[nTG]->setBCController(range, m_pTG[nTG]->getBreathControllerTarget(), 0);
-	//m_pTG[nTG]->setBreathControllerRange(constrain(range, 0, 99));
-
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	__atomic_store_n (&m_bSetMorphPerformances, true, __ATOMIC_RELEASE);
 }
 
-void CMiniDexed::setBreathControllerTarget(uint8_t target, uint8_t nTG)
+void CMiniDexed::StopMorph (void)
 {
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
-
-	m_nBreathControlTarget[nTG]=target;
+	m_bSetMorphPerformances = false;
 
-	m_pTG[nTG]->setBreathControllerTarget(constrain(target, 0, 7));
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	m_MorphSpinLock.Acquire ();
+	m_Morph.Clear ();
+	m_MorphSpinLock.Release ();
 }
 
-void CMiniDexed::setAftertouchRange(uint8_t range, uint8_t nTG)
+void CMiniDexed::SetMorphPosition (unsigned nPosition)
 {
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	nPosition = constrain ((int) nPosition, 0, 127);
 
-	m_nAftertouchRange[nTG]=range;
-	m_pTG[nTG]->setATController(range, m_pTG[nTG]->getAftertouchTarget(), 0);
-//	m_pTG[nTG]->setAftertouchRange(constrain(range, 0, 99));
-
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	__atomic_store_n (&m_nMorphTarget, nPosition << 7, __ATOMIC_RELAXED);
 }
 
-void CMiniDexed::setAftertouchTarget(uint8_t target, uint8_t nTG)
+void CMiniDexed::MorphSysEx (const uint8_t *pMessage, size_t nLength)
 {
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	assert (pMessage);
+
+	if (   nLength != 8
+	    || pMessage[7] != 0xF7)
+	{
+		LOGWARN ("Invalid morph request");
 
-	m_nAftertouchTarget[nTG]=target;
+		return;
+	}
 
-	m_pTG[nTG]->setAftertouchTarget(constrain(target, 0, 7));
-	m_pTG[nTG]->ControllersRefresh();
-	m_UI.ParameterChanged ();
+	SetMorphPerformances ((pMessage[3] & 0x7F) << 7 | (pMessage[4] & 0x7F),
+			      (pMessage[5] & 0x7F) << 7 | (pMessage[6] & 0x7F));
 }
 
-void CMiniDexed::loadVoiceParameters(const uint8_t* data, uint8_t nTG)
+// Called from Process() again, while a bank of a performance has to be loaded
+void CMiniDexed::DoSetMorphPerformances (void)
 {
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	// the IDs come from MIDI, the performance index may have changed meanwhile
+	unsigned nPerformances = GetLastPerformance ();
+	if (   m_nMorphFromID >= nPerformances
+	    || m_nMorphToID >= nPerformances)
+	{
+		LOGWARN ("Cannot morph performance %u to %u, not found", m_nMorphFromID+1, m_nMorphToID+1);
 
-	uint8_t voice[161];
+		m_bSetMorphPerformances = false;
 
-	memcpy(voice, data, sizeof(uint8_t)*161);
+		return;
+	}
 
-	// fix voice name
-	for (uint8_t i = 0; i < 10; i++)
+	CSynthSnapshot FromSnapshot, ToSnapshot;
+	bool bFromComplete, bToComplete;
+	if (   !GetPerformanceSnapshot (m_nMorphFromID, &FromSnapshot, &bFromComplete)
+	    || !GetPerformanceSnapshot (m_nMorphToID, &ToSnapshot, &bToComplete))
 	{
-		if (voice[151 + i] > 126) // filter characters
-			voice[151 + i] = 32;
+		LOGWARN ("Cannot morph performance %u to %u", m_nMorphFromID+1, m_nMorphToID+1);
+
+		m_bSetMorphPerformances = false;
+
+		return;
 	}
 
-	m_pTG[nTG]->loadVoiceParameters(&voice[6]);
-	m_pTG[nTG]->doRefreshVoice();
-	m_UI.ParameterChanged ();
-}
+	if (!bFromComplete || !bToComplete)
+	{
+		return;
+	}
 
-void CMiniDexed::setVoiceDataElement(uint8_t data, uint8_t number, uint8_t nTG)
-{
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	m_bSetMorphPerformances = false;
 
-	m_pTG[nTG]->setVoiceDataElement(constrain(data, 0, 155),constrain(number, 0, 99));
-	//m_pTG[nTG]->doRefreshVoice();
-	m_UI.ParameterChanged ();
-}
+	StopMorph ();
+	SetSnapshot (FromSnapshot);
 
-int16_t CMiniDexed::checkSystemExclusive(const uint8_t* pMessage,const  uint16_t nLength, uint8_t nTG)
-{
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	m_MorphSpinLock.Acquire ();
+	m_Morph.Setup (FromSnapshot, ToSnapshot);
+	m_nMorphPosition = 0;
+	m_MorphSpinLock.Release ();
 
-	return(m_pTG[nTG]->checkSystemExclusive(pMessage, nLength));
+	LOGNOTE ("Morphing performance %u to %u (%u parameters)",
+		 m_nMorphFromID+1, m_nMorphToID+1, m_Morph.GetParameterCount ());
 }
 
-void CMiniDexed::getSysExVoiceDump(uint8_t* dest, uint8_t nTG)
+// The morph position follows the controller with a ramp, only the parameters,
+// which change their value, are set.
+void CMiniDexed::ProcessMorph (unsigned nFrames)
 {
-	uint8_t checksum = 0;
-	uint8_t data[155];
+	m_MorphSpinLock.Acquire ();
 
-	assert (nTG < CConfig::ToneGenerators);
-	assert (m_pTG[nTG]);
+	unsigned nTarget = __atomic_load_n (&m_nMorphTarget, __ATOMIC_RELAXED);
+	if (   !m_Morph.IsActive ()
+	    || m_nMorphPosition == nTarget)
+	{
+		m_MorphSpinLock.Release ();
 
-	m_pTG[nTG]->getVoiceData(data);
+		return;
+	}
 
-	dest[0] = 0xF0; // SysEx start
-	dest[1] = 0x43; // ID=Yamaha
-	dest[2] = 0x00 | m_nMIDIChannel[nTG]; // 0x0c Sub-status 0 and MIDI channel
-	dest[3] = 0x00; // Format number (0=1 voice)
-	dest[4] = 0x01; // Byte count MSB
-	dest[5] = 0x1B; // Byte count LSB
-	for (uint8_t n = 0; n < 155; n++)
+	unsigned nStep = CSynthMorph::MaxPosition;
+	if (m_nMorphRampFrames > nFrames)
 	{
-		checksum -= data[n];
-		dest[6 + n] = data[n];
+		nStep = CSynthMorph::MaxPosition * nFrames / m_nMorphRampFrames + 1;
 	}
-	dest[161] = checksum & 0x7f; // Checksum
-	dest[162] = 0xF7; // SysEx end
-}
 
-void CMiniDexed::setMasterVolume (float32_t vol)
-{
-	if(vol < 0.0)
-		vol = 0.0;
-	else if(vol > 1.0)
-		vol = 1.0;
+	if (m_nMorphPosition < nTarget)
+	{
+		m_nMorphPosition = m_nMorphPosition + nStep < nTarget ? m_nMorphPosition + nStep : nTarget;
+	}
+	else
+	{
+		m_nMorphPosition = m_nMorphPosition > nTarget + nStep ? m_nMorphPosition - nStep : nTarget;
+	}
 
-	nMasterVolume=vol;
-}
+	unsigned nChanges = m_Morph.Update (m_nMorphPosition);
+	const CSynthMorph::TChange *pChanges = m_Morph.GetChanges ();
 
-std::string CMiniDexed::GetPerformanceFileName(unsigned nID)
-{
-	return m_PerformanceConfig.GetPerformanceFileName(nID);
-}
+	BeginParameterUpdate ();
 
-std::string CMiniDexed::GetPerformanceName(unsigned nID)
-{
-	return m_PerformanceConfig.GetPerformanceName(nID);
-}
+	for (unsigned i = 0; i < nChanges; i++)
+	{
+		ApplySnapshotValue (pChanges[i].nOffset, pChanges[i].uchValue);
+	}
 
-unsigned CMiniDexed::GetLastPerformance()
-{
-	return m_PerformanceConfig.GetLastPerformance();
-}
+	EndParameterUpdate ();
 
-unsigned CMiniDexed::GetActualPerformanceID()
-{
-	return m_PerformanceConfig.GetActualPerformanceID();
+	m_MorphSpinLock.Release ();
 }
 
-void CMiniDexed::SetActualPerformanceID(unsigned nID)
+// Sets a single value of a CSynthSnapshot, must be called in a parameter update
+// from ProcessMorph() with m_MorphSpinLock held
+void CMiniDexed::ApplySnapshotValue (unsigned nOffset, uint8_t uchValue)
 {
-	m_PerformanceConfig.SetActualPerformanceID(nID);
-}
+	typedef CSynthSnapshot::TToneGenerator TTG;
 
-bool CMiniDexed::SetNewPerformance(unsigned nID)
-{
-	m_bSetNewPerformance = true;
-	m_nSetNewPerformanceID = nID;
+	assert (nOffset >= offsetof (CSynthSnapshot, TG));
+	unsigned nTGOffset = nOffset - offsetof (CSynthSnapshot, TG);
+	unsigned nTG = nTGOffset / sizeof (TTG);
+	if (nTG < CConfig::ToneGenerators)
+	{
+		unsigned nField = nTGOffset % sizeof (TTG);
+		if (nField < CSynthSnapshot::VoiceDataSize)
+		{
+			// a pending voice would override the morphed value later,
+			// the TGs are not rendered at this time
+			FlushPendingVoice (nTG);
 
-	return true;
+			assert (m_pTG[nTG]);
+			m_pTG[nTG]->setVoiceDataElement (nField, uchValue);
+
+			RefreshVoice (nTG);
+			ParameterChanged ();
+
+			return;
+		}
+
+		switch (nField)
+		{
+		case offsetof (TTG, nMIDIChannel):		SetMIDIChannel (uchValue, nTG);			break;
+		case offsetof (TTG, nVolume):			SetVolume (uchValue, nTG);			break;
+		case offsetof (TTG, nPan):			SetPan (uchValue, nTG);				break;
+		case offsetof (TTG, nMasterTune):		SetMasterTune ((s8) uchValue, nTG);		break;
+		case offsetof (TTG, nCutoff):			SetCutoff (uchValue, nTG);			break;
+		case offsetof (TTG, nResonance):		SetResonance (uchValue, nTG);			break;
+		case offsetof (TTG, nNoteLimitLow):		SetNoteLimitLow (uchValue, nTG);		break;
+		case offsetof (TTG, nNoteLimitHigh):		SetNoteLimitHigh (uchValue, nTG);		break;
+		case offsetof (TTG, nNoteShift):		SetNoteShift ((s8) uchValue, nTG);		break;
+		case offsetof (TTG, nReverbSend):		SetReverbSend (uchValue, nTG);			break;
+		case offsetof (TTG, nPitchBendRange):		setPitchbendRange (uchValue, nTG);		break;
+		case offsetof (TTG, nPitchBendStep):		setPitchbendStep (uchValue, nTG);		break;
+		case offsetof (TTG, nPortamentoMode):		setPortamentoMode (uchValue, nTG);		break;
+		case offsetof (TTG, nPortamentoGlissando):	setPortamentoGlissando (uchValue, nTG);		break;
+		case offsetof (TTG, nPortamentoTime):		setPortamentoTime (uchValue, nTG);		break;
+		case offsetof (TTG, bMonoMode):			setMonoMode (uchValue ? 1 : 0, nTG);		break;
+		case offsetof (TTG, nModulationWheelRange):	setModWheelRange (uchValue, nTG);		break;
+		case offsetof (TTG, nModulationWheelTarget):	setModWheelTarget (uchValue, nTG);		break;
+		case offsetof (TTG, nFootControlRange):		setFootControllerRange (uchValue, nTG);		break;
+		case offsetof (TTG, nFootControlTarget):	setFootControllerTarget (uchValue, nTG);	break;
+		case offsetof (TTG, nBreathControlRange):	setBreathControllerRange (uchValue, nTG);	break;
+		case offsetof (TTG, nBreathControlTarget):	setBreathControllerTarget (uchValue, nTG);	break;
+		case offsetof (TTG, nAftertouchRange):		setAftertouchRange (uchValue, nTG);		break;
+		case offsetof (TTG, nAftertouchTarget):		setAftertouchTarget (uchValue, nTG);		break;
+		default:											break;
+		}
+
+		return;
+	}
+
+	switch (nOffset)
+	{
+	case offsetof (CSynthSnapshot, bCompressorEnable):	SetParameter (ParameterCompressorEnable, uchValue ? 1 : 0);	break;
+	case offsetof (CSynthSnapshot, bReverbEnable):		SetParameter (ParameterReverbEnable, uchValue ? 1 : 0);		break;
+	case offsetof (CSynthSnapshot, nReverbSize):		SetParameter (ParameterReverbSize, uchValue);			break;
+	case offsetof (CSynthSnapshot, nReverbHighDamp):	SetParameter (ParameterReverbHighDamp, uchValue);		break;
+	case offsetof (CSynthSnapshot, nReverbLowDamp):		SetParameter (ParameterReverbLowDamp, uchValue);		break;
+	case offsetof (CSynthSnapshot, nReverbLowPass):		SetParameter (ParameterReverbLowPass, uchValue);		break;
+	case offsetof (CSynthSnapshot, nReverbDiffusion):	SetParameter (ParameterReverbDiffusion, uchValue);		break;
+	case offsetof (CSynthSnapshot, nReverbLevel):		SetParameter (ParameterReverbLevel, uchValue);			break;
+	default:												break;
+	}
 }
 
-bool CMiniDexed::DoSetNewPerformance (void)
+bool CMiniDexed::GetPerformanceSnapshot (unsigned nID, CSynthSnapshot *pSnapshot, bool *pComplete)
 {
-	m_bLoadPerformanceBusy = true;
-	
-	unsigned nID = m_nSetNewPerformanceID;
-	m_PerformanceConfig.SetNewPerformance(nID);
-	
-	if (m_PerformanceConfig.Load ())
+	assert (pSnapshot);
+	assert (pComplete);
+
+	const CPerformanceConfig::TPerformance *pPerformance = m_PerformanceConfig.GetStoredPerformance (nID);
+	if (   !pPerformance
+	    || !pPerformance->bMIDIChannelSet)
 	{
-		LoadPerformanceParameters();
-		m_bLoadPerformanceBusy = false;
-		return true;
+		return false;
 	}
-	else
+
+	const CPerformanceConfig::TPerformance &rPerformance = *pPerformance;
+
+	pSnapshot->SetHeader ();
+
+	*pComplete = true;
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
 	{
-		SetMIDIChannel (CMIDIDevice::OmniMode, 0);
-		m_bLoadPerformanceBusy = false;
-		return false;
+		CSynthSnapshot::TToneGenerator *pTG = &pSnapshot->TG[nTG];
+
+		// an unknown bank is ignored like in BankSelect()
+		unsigned nBank = constrain ((int) rPerformance.nBankNumber[nTG], 0, 16383);
+		if (!m_SysExFileLoader.IsValidBank (nBank))
+		{
+			nBank = m_TGParameters.Get (TGParameterVoiceBank, nTG);
+		}
+		unsigned nProgram = constrain ((int) rPerformance.nVoiceNumber[nTG], 0, 31);
+
+		if (rPerformance.bVoiceDataFilled[nTG])
+		{
+			memcpy (pTG->VoiceData, rPerformance.VoiceData[nTG], sizeof pTG->VoiceData);
+		}
+		else if (!m_SysExFileLoader.GetVoice (nBank, nProgram, pTG->VoiceData))
+		{
+			*pComplete = false;		// the bank has been requested
+		}
+
+		pTG->nBankMSB = nBank >> 7;
+		pTG->nBankLSB = nBank & 0x7F;
+		pTG->nProgram = nProgram;
+		pTG->nMIDIChannel = rPerformance.nMIDIChannel[nTG];
+		pTG->nVolume = rPerformance.nVolume[nTG];
+		pTG->nPan = rPerformance.nPan[nTG];
+		pTG->nMasterTune = rPerformance.nDetune[nTG];
+		pTG->nCutoff = rPerformance.nCutoff[nTG];
+		pTG->nResonance = rPerformance.nResonance[nTG];
+		pTG->nNoteLimitLow = rPerformance.nNoteLimitLow[nTG];
+		pTG->nNoteLimitHigh = rPerformance.nNoteLimitHigh[nTG];
+		pTG->nNoteShift = rPerformance.nNoteShift[nTG];
+		pTG->nReverbSend = rPerformance.nReverbSend[nTG];
+		pTG->nPitchBendRange = rPerformance.nPitchBendRange[nTG];
+		pTG->nPitchBendStep = rPerformance.nPitchBendStep[nTG];
+		pTG->nPortamentoMode = rPerformance.nPortamentoMode[nTG];
+		pTG->nPortamentoGlissando = rPerformance.nPortamentoGlissando[nTG];
+		pTG->nPortamentoTime = rPerformance.nPortamentoTime[nTG];
+		pTG->bMonoMode = rPerformance.bMonoMode[nTG] ? 1 : 0;
+		pTG->nModulationWheelRange = rPerformance.nModulationWheelRange[nTG];
+		pTG->nModulationWheelTarget = rPerformance.nModulationWheelTarget[nTG];
+		pTG->nFootControlRange = rPerformance.nFootControlRange[nTG];
+		pTG->nFootControlTarget = rPerformance.nFootControlTarget[nTG];
+		pTG->nBreathControlRange = rPerformance.nBreathControlRange[nTG];
+		pTG->nBreathControlTarget = rPerformance.nBreathControlTarget[nTG];
+		pTG->nAftertouchRange = rPerformance.nAftertouchRange[nTG];
+		pTG->nAftertouchTarget = rPerformance.nAftertouchTarget[nTG];
 	}
+
+	pSnapshot->bCompressorEnable = rPerformance.bCompressorEnable ? 1 : 0;
+	pSnapshot->bReverbEnable = rPerformance.bReverbEnable ? 1 : 0;
+	pSnapshot->nReverbSize = rPerformance.nReverbSize;
+	pSnapshot->nReverbHighDamp = rPerformance.nReverbHighDamp;
+	pSnapshot->nReverbLowDamp = rPerformance.nReverbLowDamp;
+	pSnapshot->nReverbLowPass = rPerformance.nReverbLowPass;
+	pSnapshot->nReverbDiffusion = rPerformance.nReverbDiffusion;
+	pSnapshot->nReverbLevel = rPerformance.nReverbLevel;
+
+	return true;
 }
 
 bool CMiniDexed::SavePerformanceNewFile ()
@@ -1569,56 +2892,86 @@ bool CMiniDexed::DoSavePerformanceNewFile (void)
 
 void CMiniDexed::LoadPerformanceParameters(void)
 {
+	const CPerformanceConfig::TPerformance *pPerformance = m_PerformanceConfig.GetPerformance ();
+
+	BeginParameterUpdate ();
+
 	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		BankSelect (pPerformance->nBankNumber[nTG], nTG);
+		ProgramChange (pPerformance->nVoiceNumber[nTG], nTG);
+
+		if (pPerformance->bVoiceDataFilled[nTG])
 		{
-			
-			BankSelect (m_PerformanceConfig.GetBankNumber (nTG), nTG);
-			ProgramChange (m_PerformanceConfig.GetVoiceNumber (nTG), nTG);
-			SetMIDIChannel (m_PerformanceConfig.GetMIDIChannel (nTG), nTG);
-			SetVolume (m_PerformanceConfig.GetVolume (nTG), nTG);
-			SetPan (m_PerformanceConfig.GetPan (nTG), nTG);
-			SetMasterTune (m_PerformanceConfig.GetDetune (nTG), nTG);
-			SetCutoff (m_PerformanceConfig.GetCutoff (nTG), nTG);
-			SetResonance (m_PerformanceConfig.GetResonance (nTG), nTG);
-			setPitchbendRange (m_PerformanceConfig.GetPitchBendRange (nTG), nTG);
-			setPitchbendStep (m_PerformanceConfig.GetPitchBendStep (nTG), nTG);
-			setPortamentoMode (m_PerformanceConfig.GetPortamentoMode (nTG), nTG);
-			setPortamentoGlissando (m_PerformanceConfig.GetPortamentoGlissando  (nTG), nTG);
-			setPortamentoTime (m_PerformanceConfig.GetPortamentoTime (nTG), nTG);
-
-			m_nNoteLimitLow[nTG] = m_PerformanceConfig.GetNoteLimitLow (nTG);
-			m_nNoteLimitHigh[nTG] = m_PerformanceConfig.GetNoteLimitHigh (nTG);
-			m_nNoteShift[nTG] = m_PerformanceConfig.GetNoteShift (nTG);
-			
-			if(m_PerformanceConfig.VoiceDataFilled(nTG)) 
-			{
-			uint8_t* tVoiceData = m_PerformanceConfig.GetVoiceDataFromTxt(nTG);
-			m_pTG[nTG]->loadVoiceParameters(tVoiceData); 
-			}
-			setMonoMode(m_PerformanceConfig.GetMonoMode(nTG) ? 1 : 0, nTG); 
-			SetReverbSend (m_PerformanceConfig.GetReverbSend (nTG), nTG);
-					
-			setModWheelRange (m_PerformanceConfig.GetModulationWheelRange (nTG),  nTG);
-			setModWheelTarget (m_PerformanceConfig.GetModulationWheelTarget (nTG),  nTG);
-			setFootControllerRange (m_PerformanceConfig.GetFootControlRange (nTG),  nTG);
-			setFootControllerTarget (m_PerformanceConfig.GetFootControlTarget (nTG),  nTG);
-			setBreathControllerRange (m_PerformanceConfig.GetBreathControlRange (nTG),  nTG);
-			setBreathControllerTarget (m_PerformanceConfig.GetBreathControlTarget (nTG),  nTG);
-			setAftertouchRange (m_PerformanceConfig.GetAftertouchRange (nTG),  nTG);
-			setAftertouchTarget (m_PerformanceConfig.GetAftertouchTarget (nTG),  nTG);
-			
-		
+			// overrides the voice of the program change, swapped in by ProcessSound()
+			__atomic_store_n (&m_nPendingProgram[nTG], -1, __ATOMIC_RELEASE);
+			SetPendingVoice (pPerformance->VoiceData[nTG], nTG);
 		}
+	}
+
+	SetPerformanceParameters (*pPerformance);
+
+	EndParameterUpdate ();
+}
+
+// sets all parameters of the performance except the voices
+void CMiniDexed::SetPerformanceParameters (const CPerformanceConfig::TPerformance &rPerformance)
+{
+	BeginParameterUpdate ();
+
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		SetTGPerformanceParameters (rPerformance, nTG);
+	}
+
+	SetEffectPerformanceParameters (rPerformance);
+
+	EndParameterUpdate ();
+}
+
+void CMiniDexed::SetTGPerformanceParameters (const CPerformanceConfig::TPerformance &rPerformance, unsigned nTG)
+{
+	assert (nTG < CConfig::ToneGenerators);
 
-		// Effects
-		SetParameter (ParameterCompressorEnable, m_PerformanceConfig.GetCompressorEnable () ? 1 : 0);
-		SetParameter (ParameterReverbEnable, m_PerformanceConfig.GetReverbEnable () ? 1 : 0);
-		SetParameter (ParameterReverbSize, m_PerformanceConfig.GetReverbSize ());
-		SetParameter (ParameterReverbHighDamp, m_PerformanceConfig.GetReverbHighDamp ());
-		SetParameter (ParameterReverbLowDamp, m_PerformanceConfig.GetReverbLowDamp ());
-		SetParameter (ParameterReverbLowPass, m_PerformanceConfig.GetReverbLowPass ());
-		SetParameter (ParameterReverbDiffusion, m_PerformanceConfig.GetReverbDiffusion ());
-		SetParameter (ParameterReverbLevel, m_PerformanceConfig.GetReverbLevel ());
+	SetMIDIChannel (rPerformance.nMIDIChannel[nTG], nTG);
+	SetVolume (rPerformance.nVolume[nTG], nTG);
+	SetPan (rPerformance.nPan[nTG], nTG);
+	SetMasterTune (rPerformance.nDetune[nTG], nTG);
+	SetCutoff (rPerformance.nCutoff[nTG], nTG);
+	SetResonance (rPerformance.nResonance[nTG], nTG);
+	setPitchbendRange (rPerformance.nPitchBendRange[nTG], nTG);
+	setPitchbendStep (rPerformance.nPitchBendStep[nTG], nTG);
+	setPortamentoMode (rPerformance.nPortamentoMode[nTG], nTG);
+	setPortamentoGlissando (rPerformance.nPortamentoGlissando[nTG], nTG);
+	setPortamentoTime (rPerformance.nPortamentoTime[nTG], nTG);
+
+	SetNoteLimitLow (rPerformance.nNoteLimitLow[nTG], nTG);
+	SetNoteLimitHigh (rPerformance.nNoteLimitHigh[nTG], nTG);
+	SetNoteShift (rPerformance.nNoteShift[nTG], nTG);
+
+	setMonoMode(rPerformance.bMonoMode[nTG] ? 1 : 0, nTG); 
+	SetReverbSend (rPerformance.nReverbSend[nTG], nTG);
+
+	setModWheelRange (rPerformance.nModulationWheelRange[nTG],  nTG);
+	setModWheelTarget (rPerformance.nModulationWheelTarget[nTG],  nTG);
+	setFootControllerRange (rPerformance.nFootControlRange[nTG],  nTG);
+	setFootControllerTarget (rPerformance.nFootControlTarget[nTG],  nTG);
+	setBreathControllerRange (rPerformance.nBreathControlRange[nTG],  nTG);
+	setBreathControllerTarget (rPerformance.nBreathControlTarget[nTG],  nTG);
+	setAftertouchRange (rPerformance.nAftertouchRange[nTG],  nTG);
+	setAftertouchTarget (rPerformance.nAftertouchTarget[nTG],  nTG);
+}
+
+void CMiniDexed::SetEffectPerformanceParameters (const CPerformanceConfig::TPerformance &rPerformance)
+{
+	SetParameter (ParameterCompressorEnable, rPerformance.bCompressorEnable ? 1 : 0);
+	SetParameter (ParameterReverbEnable, rPerformance.bReverbEnable ? 1 : 0);
+	SetParameter (ParameterReverbSize, rPerformance.nReverbSize);
+	SetParameter (ParameterReverbHighDamp, rPerformance.nReverbHighDamp);
+	SetParameter (ParameterReverbLowDamp, rPerformance.nReverbLowDamp);
+	SetParameter (ParameterReverbLowPass, rPerformance.nReverbLowPass);
+	SetParameter (ParameterReverbDiffusion, rPerformance.nReverbDiffusion);
+	SetParameter (ParameterReverbLevel, rPerformance.nReverbLevel);
 }
 
 std::string CMiniDexed::GetNewPerformanceDefaultName(void)	
@@ -1674,131 +3027,71 @@ bool CMiniDexed::GetPerformanceSelectToLoad(void)
 
 void CMiniDexed::setModController (unsigned controller, unsigned parameter, uint8_t value, uint8_t nTG)
 {
-	 uint8_t nBits;
-	
-	switch (controller)
+	if (   controller > 3
+	    || parameter > 3)
 	{
-		case 0:
-			if (parameter == 0)
-			{
-				setModWheelRange(value, nTG);
-			}
-			else
-			{
-				value=constrain(value, 0, 1);
-				nBits=m_nModulationWheelTarget[nTG];
-				value == 1 ?  nBits |= 1 << (parameter-1) : nBits &= ~(1 << (parameter-1)); 
-				setModWheelTarget(nBits , nTG); 
-			}
-		break;
-		
-		case 1:
-			if (parameter == 0)
-			{
-				setFootControllerRange(value, nTG);
-			}
-			else
-			{
-				value=constrain(value, 0, 1);
-				nBits=m_nFootControlTarget[nTG];
-				value == 1 ?  nBits |= 1 << (parameter-1) : nBits &= ~(1 << (parameter-1)); 
-				setFootControllerTarget(nBits , nTG); 
-			}
-		break;	
+		return;
+	}
 
-		case 2:
-			if (parameter == 0)
-			{
-				setBreathControllerRange(value, nTG);
-			}
-			else
-			{
-				value=constrain(value, 0, 1);
-				nBits=m_nBreathControlTarget[nTG];
-				value == 1 ?  nBits |= 1 << (parameter-1) : nBits &= ~(1 << (parameter-1));
-				setBreathControllerTarget(nBits , nTG); 
-			}
-		break;			
-		
-		case 3:
-			if (parameter == 0)
-			{
-				setAftertouchRange(value, nTG);
-			}
-			else
-			{
-				value=constrain(value, 0, 1);
-				nBits=m_nAftertouchTarget[nTG];
-				value == 1 ?  nBits |= 1 << (parameter-1) : nBits &= ~(1 << (parameter-1));
-				setAftertouchTarget(nBits , nTG); 
-			}
-		break;	
-		default:
-		break;
+	// the parameters of each controller are in the order range, pitch, amplitude, EG bias
+	TTGParameter Range = (TTGParameter) (TGParameterMWRange + controller*4);
+	TTGParameter FirstTarget = (TTGParameter) (Range + 1);
+
+	if (parameter == 0)
+	{
+		switch (controller)
+		{
+		case 0:	setModWheelRange (value, nTG);		break;
+		case 1:	setFootControllerRange (value, nTG);	break;
+		case 2:	setBreathControllerRange (value, nTG);	break;
+		case 3:	setAftertouchRange (value, nTG);	break;
+		}
+
+		return;
+	}
+
+	value = constrain (value, 0, 1);
+	uint8_t nBits = GetControllerTarget (FirstTarget, nTG);
+	value == 1 ?  nBits |= 1 << (parameter-1) : nBits &= ~(1 << (parameter-1));
+
+	switch (controller)
+	{
+	case 0:	setModWheelTarget (nBits, nTG);		break;
+	case 1:	setFootControllerTarget (nBits, nTG);	break;
+	case 2:	setBreathControllerTarget (nBits, nTG);	break;
+	case 3:	setAftertouchTarget (nBits, nTG);	break;
 	}
 }
 
 unsigned CMiniDexed::getModController (unsigned controller, unsigned parameter, uint8_t nTG)
 {
-	unsigned nBits;
-	switch (controller)
+	if (   controller > 3
+	    || parameter > 3)
 	{
-		case 0:
-			if (parameter == 0)
-			{
-			    return m_nModulationWheelRange[nTG];
-			}
-			else
-			{
-	
-				nBits=m_nModulationWheelTarget[nTG];
-				nBits &= 1 << (parameter-1);				
-				return (nBits != 0 ? 1 : 0) ; 
-			}
-		break;
-		
-		case 1:
-			if (parameter == 0)
-			{
-				return m_nFootControlRange[nTG];
-			}
-			else
-			{
-				nBits=m_nFootControlTarget[nTG];
-				nBits &= 1 << (parameter-1)	;			
-				return (nBits != 0 ? 1 : 0) ; 
-			}
-		break;	
+		return 0;
+	}
 
-		case 2:
-			if (parameter == 0)
-			{
-				return m_nBreathControlRange[nTG];
-			}
-			else
-			{
-				nBits=m_nBreathControlTarget[nTG];	
-				nBits &= 1 << (parameter-1)	;			
-				return (nBits != 0 ? 1 : 0) ; 
-			}
-		break;			
-		
-		case 3:
-			if (parameter == 0)
-			{
-				return m_nAftertouchRange[nTG];
-			}
-			else
-			{
-				nBits=m_nAftertouchTarget[nTG];
-				nBits &= 1 << (parameter-1)	;			
-				return (nBits != 0 ? 1 : 0) ; 
-			}
-		break;	
-		
-		default:
-			return 0;
-		break;
+	return m_TGParameters.Get (TGParameterMWRange + controller*4 + parameter, nTG);
+}
+
+// FirstTarget is the pitch parameter of a controller, followed by amplitude and EG bias
+void CMiniDexed::SetControllerTarget (TTGParameter FirstTarget, unsigned nTarget, unsigned nTG)
+{
+	nTarget = constrain ((int) nTarget, 0, 7);
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		m_TGParameters.Set (FirstTarget + i, (nTarget >> i) & 1, nTG);
 	}
-	
+}
+
+unsigned CMiniDexed::GetControllerTarget (TTGParameter FirstTarget, unsigned nTG)
+{
+	unsigned nTarget = 0;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		nTarget |= m_TGParameters.Get (FirstTarget + i, nTG) << i;
+	}
+
+	return nTarget;
 }
@@ -28,7 +28,13 @@
 #include "midikeyboard.h"
 #include "pckeyboard.h"
 #include "serialmididevice.h"
+#include "midifileplayer.h"
 #include "perftimer.h"
+#include "miditrace.h"
+#include "latencymeter.h"
+#include "synthsnapshot.h"
+#include "synthmorph.h"
+#include "parameterstore.h"
 #include <fatfs/ff.h>
 #include <stdint.h>
 #include <string>
@@ -68,12 +74,18 @@ public:
 	void BankSelectLSB (unsigned nBankLSB, unsigned nTG);
 	void ProgramChange (unsigned nProgram, unsigned nTG);
 	void ProgramChangePerformance (unsigned nProgram);
+	// performance bank, selected with Bank Select on the Performance Select Channel
+	void PerformanceBankSelectMSB (unsigned nBankMSB);
+	void PerformanceBankSelectLSB (unsigned nBankLSB);
 	void SetVolume (unsigned nVolume, unsigned nTG);
 	void SetPan (unsigned nPan, unsigned nTG);			// 0 .. 127
 	void SetMasterTune (int nMasterTune, unsigned nTG);		// -99 .. 99
 	void SetCutoff (int nCutoff, unsigned nTG);			// 0 .. 99
 	void SetResonance (int nResonance, unsigned nTG);		// 0 .. 99
 	void SetMIDIChannel (uint8_t uchChannel, unsigned nTG);
+	void SetNoteLimitLow (unsigned nNote, unsigned nTG);		// 0 .. 127
+	void SetNoteLimitHigh (unsigned nNote, unsigned nTG);		// 0 .. 127
+	void SetNoteShift (int nShift, unsigned nTG);
 
 	void keyup (int16_t pitch, unsigned nTG);
 	void keydown (int16_t pitch, uint8_t velocity, unsigned nTG);
@@ -108,6 +120,34 @@ public:
 	void loadVoiceParameters(const uint8_t* data, uint8_t nTG);
 	void setVoiceDataElement(uint8_t data, uint8_t number, uint8_t nTG);
 	void getSysExVoiceDump(uint8_t* dest, uint8_t nTG);
+	void BankBulkDump (const uint8_t *pMessage, size_t nLength, unsigned nTG);
+
+	// A bank bulk dump, which is received in pieces by a MIDI driver
+	// (see CMIDIDevice::BankDumpBegin()), is written to the voice loader as
+	// it arrives. Ends with BankDumpEnd() or BankDumpAbort().
+	bool BankDumpStart (void);			// returns false, if receiver is busy
+	void BankDumpWrite (const uint8_t *pData, size_t nLength);
+	void BankDumpEnd (unsigned nTG);		// selects the received bank on nTG
+	void BankDumpAbort (void);
+
+	// Voice search by name, may be called from MIDI interrupt context.
+	// Request: F0 7D 01 mode(0: contains, 1: starts with) name(1-10 chars) F7
+	// Reply:   F0 7D 02 count { bank MSB, bank LSB, voice(0-31), name(10 chars) } F7
+	// The reply is sent from Process() to the requesting device.
+	static const unsigned MaxVoiceSearchMatches = 16;	// per reply
+	void VoiceSearchRequest (const uint8_t *pMessage, size_t nLength,
+				 CMIDIDevice *pDevice, unsigned nCable);
+
+	// Binary snapshot of the whole synthesizer (see synthsnapshot.h), e.g. for
+	// A/B compare or undo. Restoring a snapshot does not access the SD card.
+	void GetSnapshot (CSynthSnapshot *pSnapshot);
+	bool SetSnapshot (const CSynthSnapshot &rSnapshot);	// false if invalid
+
+	// Snapshot over SysEx, may be called from MIDI interrupt context.
+	// Request: F0 7D 03 F7
+	// Dump:    F0 7D 04 snapshot F7 (sent as reply and received to restore it)
+	void SnapshotSysEx (const uint8_t *pMessage, size_t nLength,
+			    CMIDIDevice *pDevice, unsigned nCable);
 
 	void setModController (unsigned controller, unsigned parameter, uint8_t value, uint8_t nTG);
 	unsigned getModController (unsigned controller, unsigned parameter, uint8_t nTG);
@@ -129,6 +169,17 @@ public:
 	unsigned GetPerformanceSelectChannel (void);
 	void SetPerformanceSelectChannel (unsigned uCh);
 
+	// Morph between two stored performances with a single controller. The
+	// first performance is loaded and the morph is set up by Process(), while
+	// the morphed parameters are updated by ProcessSound() once per chunk.
+	// The morph ends, when another performance is selected.
+	void SetMorphPerformances (unsigned nFromID, unsigned nToID);
+	void StopMorph (void);
+	void SetMorphPosition (unsigned nPosition);	// 0 .. 127, may be called from MIDI interrupt context
+
+	// SysEx: F0 7D 05 from(MSB, LSB) to(MSB, LSB) F7, may be called from MIDI interrupt context
+	void MorphSysEx (const uint8_t *pMessage, size_t nLength);
+
 	// Must match the order in CUIMenu::TParameter
 	enum TParameter
 	{
@@ -153,7 +204,8 @@ public:
 	bool DeletePerformance(unsigned nID);
 	bool DoDeletePerformance(void);
 
-	// Must match the order in CUIMenu::TGParameter
+	// Must match the order in CUIMenu::TGParameter. These are the stable IDs
+	// in CParameterStore, new parameters are added before TGParameterUnknown.
 	enum TTGParameter
 	{
 		TGParameterVoiceBank,
@@ -193,13 +245,33 @@ public:
 		TGParameterATPitch,
 		TGParameterATAmplitude,
 		TGParameterATEGBias,
-		
+
+		TGParameterNoteLimitLow,
+		TGParameterNoteLimitHigh,
+		TGParameterNoteShift,
+
 		TGParameterUnknown
 	};
 
 	void SetTGParameter (TTGParameter Parameter, int nValue, unsigned nTG);
 	int GetTGParameter (TTGParameter Parameter, unsigned nTG);
 
+	struct TTGParameterChange
+	{
+		TTGParameter Parameter;
+		int nValue;
+		unsigned nTG;
+	};
+
+	// applies all changes within one parameter update
+	void SetTGParameters (const TTGParameterChange *pChanges, unsigned nChanges);
+
+	// Parameter changes between these calls update the reverb only once at
+	// the end, the UI is notified once too. The calls can be nested, the
+	// update is per core. TG changes are applied by ProcessSound() anyway.
+	void BeginParameterUpdate (void);
+	void EndParameterUpdate (void);
+
 	// access (global or OP-related) parameter of the active voice of a TG
 	static const unsigned NoOP = 6;		// for global parameters
 	void SetVoiceParameter (uint8_t uchOffset, uint8_t uchValue, unsigned nOP, unsigned nTG);
@@ -213,12 +285,90 @@ public:
 	void setMasterVolume (float32_t vol);
 
 private:
+	void SetControllerTarget (TTGParameter FirstTarget, unsigned nTarget, unsigned nTG);
+	unsigned GetControllerTarget (TTGParameter FirstTarget, unsigned nTG);
+
+	// Change bits in m_TGParameters after the TG parameters, which request
+	// a refresh of the TG by ApplyTGParameters()
+	enum TTGRefresh
+	{
+		TGRefreshControllers = TGParameterUnknown,
+		TGRefreshVoice,
+		TGRefreshUnknown
+	};
+
+	void ParameterChanged (void);			// notifies the UI
+	void RefreshVoice (unsigned nTG);
+	void ApplyTGParameters (void);			// called from ProcessSound() only
+	void ApplyReverbParameter (TParameter Parameter);
+
+	struct TParameterUpdate
+	{
+		unsigned nDepth;
+		bool bChanged;				// the UI must be notified
+		bool bReverbChanged;
+	};
+
+	TParameterUpdate *GetParameterUpdate (void);
+
 	int16_t ApplyNoteLimits (int16_t pitch, unsigned nTG);	// returns < 0 to ignore note
 	uint8_t m_uchOPMask[CConfig::ToneGenerators];
 	void LoadPerformanceParameters(void); 
+	void SetPerformanceParameters (const CPerformanceConfig::TPerformance &rPerformance);
+	void SetTGPerformanceParameters (const CPerformanceConfig::TPerformance &rPerformance, unsigned nTG);
+	void SetEffectPerformanceParameters (const CPerformanceConfig::TPerformance &rPerformance);
 	void ProcessSound (void);
 
+	void SetPendingVoice (const uint8_t *pData, unsigned nTG);
+	void CancelPendingVoice (unsigned nTG);
+	void FlushPendingVoice (unsigned nTG);
+	void GetVoiceData (uint8_t *pData, unsigned nTG);	// including a pending voice
+	void SwapVoices (void);				// called from ProcessSound() only
+	void ProcessVoiceSearch (void);
+	void ProcessSnapshotSysEx (void);
+	void ApplyVoiceFade (float32_t *pBuffer, unsigned nFrames, unsigned nTG);
+
+	void SwapPerformance (void);			// called from ProcessSound() only
+
+	void DoSetMorphPerformances (void);
+	void ProcessMorph (unsigned nFrames);		// called from ProcessSound() only
+	void ApplySnapshotValue (unsigned nOffset, uint8_t uchValue);
+
+	// Returns false, if the performance is not available. *pComplete is
+	// false, while a bank of the performance has to be loaded.
+	bool GetPerformanceSnapshot (unsigned nID, CSynthSnapshot *pSnapshot, bool *pComplete);
+
+	// Boot jobs do not access the SD card, they run on core 1 in parallel
+	// to the SD accesses of core 0 (on core 0 without multi-core support).
+	enum TBootJob
+	{
+		BootJobNone,
+		BootJobSetupTGs,
+		BootJobApplyPerformance,
+		BootJobFinished
+	};
+
+	void StartBootJob (TBootJob Job);
+	void WaitBootJob (void);			// records the job in the boot profile
+	void RunBootJob (TBootJob Job);
+	static const char *GetBootJobName (TBootJob Job);
+
+	// the rest of the boot with fast start, after the sound has been started
+	enum TDeferredBoot
+	{
+		DeferredBootNone,
+		DeferredBootVoiceBanks,
+		DeferredBootPerformanceList
+	};
+
+	void ProcessDeferredBoot (void);
+
+	void ListPerformances (void);
+	void RetryProgramChanges (void);
+
 #ifdef ARM_ALLOW_MULTI_CORE
+	void RunBootJobs (void);			// on core 1, until the sound starts
+
 	enum TCoreStatus
 	{
 		CoreStatusInit,
@@ -236,42 +386,26 @@ private:
 
 	CDexedAdapter *m_pTG[CConfig::ToneGenerators];
 
-	unsigned m_nVoiceBankID[CConfig::ToneGenerators];
+	// values of the TG parameters, applied to the TGs by ProcessSound()
+	CParameterStore m_TGParameters;
 	unsigned m_nVoiceBankIDMSB[CConfig::ToneGenerators];
-	unsigned m_nProgram[CConfig::ToneGenerators];
-	unsigned m_nVolume[CConfig::ToneGenerators];
-	unsigned m_nPan[CConfig::ToneGenerators];
-	int m_nMasterTune[CConfig::ToneGenerators];
-	int m_nCutoff[CConfig::ToneGenerators];
-	int m_nResonance[CConfig::ToneGenerators];
-	unsigned m_nMIDIChannel[CConfig::ToneGenerators];
-	unsigned m_nPitchBendRange[CConfig::ToneGenerators];	
-	unsigned m_nPitchBendStep[CConfig::ToneGenerators];	
-	unsigned m_nPortamentoMode[CConfig::ToneGenerators];	
-	unsigned m_nPortamentoGlissando[CConfig::ToneGenerators];	
-	unsigned m_nPortamentoTime[CConfig::ToneGenerators];	
-	bool m_bMonoMode[CConfig::ToneGenerators]; 
-				
-	unsigned m_nModulationWheelRange[CConfig::ToneGenerators];
-	unsigned m_nModulationWheelTarget[CConfig::ToneGenerators];
-	unsigned m_nFootControlRange[CConfig::ToneGenerators];
-	unsigned m_nFootControlTarget[CConfig::ToneGenerators];
-	unsigned m_nBreathControlRange[CConfig::ToneGenerators];	
-	unsigned m_nBreathControlTarget[CConfig::ToneGenerators];	
-	unsigned m_nAftertouchRange[CConfig::ToneGenerators];	
-	unsigned m_nAftertouchTarget[CConfig::ToneGenerators];
-		
-	unsigned m_nNoteLimitLow[CConfig::ToneGenerators];
-	unsigned m_nNoteLimitHigh[CConfig::ToneGenerators];
-	int m_nNoteShift[CConfig::ToneGenerators];
-
-	unsigned m_nReverbSend[CConfig::ToneGenerators];
+	volatile int m_nPendingProgram[CConfig::ToneGenerators];	// waits for its bank, -1 for none
   
 	uint8_t m_nRawVoiceData[156]; 
+
+	// voice selected by ProgramChange(), which is swapped in by ProcessSound()
+	// at the next chunk boundary, after the TG has optionally been faded out
+	uint8_t m_PendingVoice[CConfig::ToneGenerators][156];
+	volatile bool m_bVoicePending[CConfig::ToneGenerators];
+	CSpinLock m_VoiceSwapSpinLock;
+	float32_t m_fVoiceFadeGain[CConfig::ToneGenerators];	// used by ProcessSound() only
+	float32_t m_fVoiceFadeStep;				// per sample, 0 for no fade
 	
 	
 	float32_t nMasterVolume;
 
+	CMIDITrace m_MIDITrace;		// must be constructed before the MIDI devices
+
 	CUserInterface m_UI;
 	CSysExFileLoader m_SysExFileLoader;
 	CPerformanceConfig m_PerformanceConfig;
@@ -280,6 +414,20 @@ private:
 	CPCKeyboard m_PCKeyboard;
 	CSerialMIDIDevice m_SerialMIDI;
 	bool m_bUseSerial;
+	CMIDIFilePlayer m_MIDIFilePlayer;
+
+	// pending SysEx voice search, handed over to the main loop
+	char m_VoiceSearchQuery[CVoiceNameIndex::NameLength+1];
+	bool m_bVoiceSearchPrefix;
+	unsigned m_nVoiceSearchCable;
+	CMIDIDevice *m_pVoiceSearchDevice;		// nullptr if none
+
+	// pending SysEx snapshot request and received snapshot
+	unsigned m_nSnapshotRequestCable;
+	CMIDIDevice *m_pSnapshotRequestDevice;		// nullptr if none
+	CSynthSnapshot m_ReceivedSnapshot;
+	bool m_bSnapshotReceived;
+	uint8_t m_SnapshotDump[CSynthSnapshot::SysExLength];	// main loop only
 
 	CSoundBaseDevice *m_pSoundDevice;
 	bool m_bChannelsSwapped;
@@ -293,8 +441,11 @@ private:
 #endif
 
 	CPerformanceTimer m_GetChunkTimer;
+	CPerformanceTimer m_VoiceSwapTimer;		// audio core only
 	bool m_bProfileEnabled;
 
+	CLatencyMeter m_LatencyMeter;
+
 	AudioEffectPlateReverb* reverb;
 	AudioStereoMixer<CConfig::ToneGenerators>* tg_mixer;
 	AudioStereoMixer<CConfig::ToneGenerators>* reverb_send_mixer;
@@ -309,6 +460,31 @@ private:
 	unsigned m_nDeletePerformanceID;
 	bool m_bLoadPerformanceBusy;
 	bool m_bSaveAsDeault;
+	unsigned m_nPerformanceBankMSB;
+	unsigned m_nPerformanceBank;		// PERFORMANCES_PER_BANK performances each
+
+	// the performance, which is switched to by ProcessSound()
+	CPerformanceConfig::TPerformance m_SwitchPerformance;
+	uint8_t m_SwitchVoice[CConfig::ToneGenerators][NUM_VOICE_PARAM];
+	unsigned m_nSwitchBank[CConfig::ToneGenerators];
+	unsigned m_nSwitchTG;				// next TG to be switched
+	volatile bool m_bPerformanceSwitchPending;
+
+	CSynthMorph m_Morph;
+	CSpinLock m_MorphSpinLock;
+	unsigned m_nMorphFromID;
+	unsigned m_nMorphToID;
+	volatile bool m_bSetMorphPerformances;
+	volatile unsigned m_nMorphTarget;	// 0 .. CSynthMorph::MaxPosition
+	unsigned m_nMorphPosition;
+	unsigned m_nMorphRampFrames;		// for the whole range
+
+	volatile TBootJob m_BootJob;
+	TBootJob m_StartedBootJob;		// core 0 only
+	bool m_bPerformanceLoaded;		// at boot time
+	TDeferredBoot m_DeferredBoot;
+
+	TParameterUpdate m_ParameterUpdate[CORES];
 };
 
 #endif
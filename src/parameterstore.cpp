@@ -0,0 +1,99 @@
+//
+// parameterstore.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "parameterstore.h"
+#include <assert.h>
+
+CParameterStore::CParameterStore (void)
+{
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		for (unsigned i = 0; i < MaxParameters; i++)
+		{
+			m_nValue[nTG][i] = 0;
+		}
+
+		for (unsigned i = 0; i < ChangeWords; i++)
+		{
+			m_nChanged[nTG][i] = 0;
+		}
+	}
+}
+
+bool CParameterStore::Set (unsigned nParameter, int nValue, unsigned nTG)
+{
+	assert (nParameter < MaxParameters);
+	assert (nTG < CConfig::ToneGenerators);
+
+	if (__atomic_exchange_n (&m_nValue[nTG][nParameter], nValue, __ATOMIC_RELAXED) == nValue)
+	{
+		return false;
+	}
+
+	// the release orders the new value before the change bit
+	__atomic_fetch_or (&m_nChanged[nTG][nParameter / 32], 1U << (nParameter % 32), __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void CParameterStore::MarkChanged (unsigned nParameter, unsigned nTG)
+{
+	assert (nParameter < MaxParameters);
+	assert (nTG < CConfig::ToneGenerators);
+
+	__atomic_fetch_or (&m_nChanged[nTG][nParameter / 32], 1U << (nParameter % 32), __ATOMIC_RELEASE);
+}
+
+int CParameterStore::Get (unsigned nParameter, unsigned nTG) const
+{
+	assert (nParameter < MaxParameters);
+	assert (nTG < CConfig::ToneGenerators);
+
+	return __atomic_load_n (&m_nValue[nTG][nParameter], __ATOMIC_RELAXED);
+}
+
+bool CParameterStore::TakeChanges (unsigned nTG, TChanges *pChanges)
+{
+	assert (nTG < CConfig::ToneGenerators);
+	assert (pChanges);
+
+	u32 nAny = 0;
+	for (unsigned i = 0; i < ChangeWords; i++)
+	{
+		// quick check first, most TGs do not change in a chunk
+		if (__atomic_load_n (&m_nChanged[nTG][i], __ATOMIC_RELAXED) == 0)
+		{
+			pChanges->nWord[i] = 0;
+
+			continue;
+		}
+
+		pChanges->nWord[i] = __atomic_exchange_n (&m_nChanged[nTG][i], 0, __ATOMIC_ACQUIRE);
+		nAny |= pChanges->nWord[i];
+	}
+
+	return nAny != 0;
+}
+
+bool CParameterStore::IsChanged (const TChanges &rChanges, unsigned nParameter)
+{
+	assert (nParameter < MaxParameters);
+
+	return !!(rChanges.nWord[nParameter / 32] & (1U << (nParameter % 32)));
+}
@@ -0,0 +1,63 @@
+//
+// parameterstore.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _parameterstore_h
+#define _parameterstore_h
+
+#include "config.h"
+#include <circle/types.h>
+
+// Values of the parameters of all TGs, addressed by a stable ID per parameter
+// (CMiniDexed::TTGParameter). The values are read and written with atomic
+// accesses, so that they can be used from any core and from interrupt context
+// without a lock. Each write, which changes a value, sets the bit of the
+// parameter in the change bitmap of its TG. The audio core takes the bitmaps
+// once per chunk and applies the changed values to the sound engine.
+class CParameterStore
+{
+public:
+	static const unsigned MaxParameters = 64;
+	static const unsigned ChangeWords = MaxParameters / 32;
+
+	struct TChanges
+	{
+		u32 nWord[ChangeWords];
+	};
+
+public:
+	CParameterStore (void);
+
+	// returns true, if the value has changed
+	bool Set (unsigned nParameter, int nValue, unsigned nTG);
+	int Get (unsigned nParameter, unsigned nTG) const;
+
+	// sets the change bit only, for parameters without a value (e.g. requests)
+	void MarkChanged (unsigned nParameter, unsigned nTG);
+
+	// takes the change bitmap of the TG and clears it, returns false if empty
+	bool TakeChanges (unsigned nTG, TChanges *pChanges);
+
+	static bool IsChanged (const TChanges &rChanges, unsigned nParameter);
+
+private:
+	int m_nValue[CConfig::ToneGenerators][MaxParameters];
+	u32 m_nChanged[CConfig::ToneGenerators][ChangeWords];
+};
+
+#endif
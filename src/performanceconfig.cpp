@@ -23,164 +23,509 @@
 #include <circle/logger.h>
 #include "performanceconfig.h"
 #include "mididevice.h"
+#include "voicedatacodec.h"
 #include <cstring> 
 #include <algorithm>
 
 LOGMODULE ("Performance");
 
+static_assert (NUM_VOICE_PARAM == CVoiceDataCodec::VoiceDataSize, "Voice data size mismatch");
+
 CPerformanceConfig::CPerformanceConfig (FATFS *pFileSystem)
-:	m_Properties ("performance.ini", pFileSystem)
+:	m_Properties ("performance.ini", pFileSystem),
+	m_Performance (),
+	m_bVoiceDataBlob (false),
+	m_bDirty (true),
+	m_bSaveActive (false),
+	m_nSavePos (0),
+	m_nSaveID (0)
 {
 	m_pFileSystem = pFileSystem; 
+
+	// performance.ini only, until ListPerformances() has been called
+	nLastFileIndex = 0;
+	m_Index.push_back ({"performance.ini", GetDisplayName ("performance.ini"), TableNotRead, nullptr});
 }
 
 CPerformanceConfig::~CPerformanceConfig (void)
 {
+	FlushSave ();
+
+	for (TIndexEntry &rEntry : m_Index)
+	{
+		FreeIndexEntry (&rEntry);
+	}
 }
 
 bool CPerformanceConfig::Load (void)
 {
+	FlushSave ();
+
+	RecoverBackup ("SD:/" + GetPerformancePath (nActualPerformance));
+
 	if (!m_Properties.Load ())
 	{
 		return false;
 	}
 
-	bool bResult = false;
+	ParseProperties (&m_Properties, &m_Performance);
+	m_bDirty = false;
+
+	return m_Performance.bMIDIChannelSet;
+}
+
+bool CPerformanceConfig::LoadPerformance (unsigned nID, TPerformance *pPerformance)
+{
+	assert (nID < m_Index.size ());
+	assert (pPerformance);
+
+	RecoverBackup ("SD:/" + GetPerformancePath (nID));
+
+	CPropertiesFatFsFile Properties (GetPerformancePath (nID).c_str (), m_pFileSystem);
+	if (!Properties.Load ())
+	{
+		return false;
+	}
+
+	ParseProperties (&Properties, pPerformance);
+
+	return true;
+}
+
+const CPerformanceConfig::TPerformance *CPerformanceConfig::GetPerformance (void) const
+{
+	return &m_Performance;
+}
+
+// rPerformance must be the content of the file of the actual performance
+void CPerformanceConfig::SetPerformance (const TPerformance &rPerformance)
+{
+	m_Performance = rPerformance;
+	m_bDirty = false;
+}
+
+const CPerformanceConfig::TPerformance *CPerformanceConfig::GetStoredPerformance (unsigned nID)
+{
+	assert (nID < m_Index.size ());
+	TIndexEntry &rEntry = m_Index[nID];
+
+	if (rEntry.TableState == TableNotRead)
+	{
+		ReadTableEntry (nID);
+	}
+
+	return rEntry.TableState == TableValid ? rEntry.pPerformance : nullptr;
+}
+
+// Reads one performance per call, the neighbours of the actual one first,
+// then the other performances of its bank. Performances of other banks are
+// read on first use only, so that the table keeps small with many files.
+void CPerformanceConfig::ReadTableStep (void)
+{
+	unsigned nPerformances = m_Index.size ();
+
+	unsigned Neighbour[2] = {nActualPerformance+1, nActualPerformance-1};
+	for (unsigned i = 0; i < 2; i++)
+	{
+		if (   Neighbour[i] < nPerformances
+		    && m_Index[Neighbour[i]].TableState == TableNotRead)
+		{
+			ReadTableEntry (Neighbour[i]);
+
+			return;
+		}
+	}
+
+	unsigned nFirst = nActualPerformance / PERFORMANCES_PER_BANK * PERFORMANCES_PER_BANK;
+	unsigned nLast = std::min (nFirst + PERFORMANCES_PER_BANK, nPerformances);
+	for (unsigned nID = nFirst; nID < nLast; nID++)
+	{
+		if (m_Index[nID].TableState == TableNotRead)
+		{
+			ReadTableEntry (nID);
+
+			return;
+		}
+	}
+}
+
+void CPerformanceConfig::ReadTableEntry (unsigned nID)
+{
+	assert (nID < m_Index.size ());
+	TIndexEntry &rEntry = m_Index[nID];
+
+	if (!rEntry.pPerformance)
+	{
+		rEntry.pPerformance = new TPerformance ();
+		assert (rEntry.pPerformance);
+	}
+
+	rEntry.TableState = LoadPerformance (nID, rEntry.pPerformance) ? TableValid : TableInvalid;
+}
+
+void CPerformanceConfig::FreeIndexEntry (TIndexEntry *pEntry)
+{
+	assert (pEntry);
+
+	delete pEntry->pPerformance;
+	pEntry->pPerformance = nullptr;
+	pEntry->TableState = TableNotRead;
+}
+
+void CPerformanceConfig::ParseProperties (CPropertiesFatFsFile *pProperties, TPerformance *pPerformance)
+{
+	assert (pProperties);
+	assert (pPerformance);
+
+	pPerformance->bMIDIChannelSet = false;
 
 	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
 	{
 		CString PropertyName;
 
 		PropertyName.Format ("BankNumber%u", nTG+1);
-		m_nBankNumber[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nBankNumber[nTG] = pProperties->GetNumber (PropertyName, 0);
 
 		PropertyName.Format ("VoiceNumber%u", nTG+1);
-		m_nVoiceNumber[nTG] = m_Properties.GetNumber (PropertyName, 1);
-		if (m_nVoiceNumber[nTG] > 0)
+		pPerformance->nVoiceNumber[nTG] = pProperties->GetNumber (PropertyName, 1);
+		if (pPerformance->nVoiceNumber[nTG] > 0)
 		{
-			m_nVoiceNumber[nTG]--;
+			pPerformance->nVoiceNumber[nTG]--;
 		}
 
 		PropertyName.Format ("MIDIChannel%u", nTG+1);
-		unsigned nMIDIChannel = m_Properties.GetNumber (PropertyName, 255);
+		unsigned nMIDIChannel = pProperties->GetNumber (PropertyName, 255);
 		if (nMIDIChannel == 0)
 		{
-			m_nMIDIChannel[nTG] = CMIDIDevice::Disabled;
+			pPerformance->nMIDIChannel[nTG] = CMIDIDevice::Disabled;
 		}
 		else if (nMIDIChannel <= CMIDIDevice::Channels)
 		{
-			m_nMIDIChannel[nTG] = nMIDIChannel-1;
-			bResult = true;
+			pPerformance->nMIDIChannel[nTG] = nMIDIChannel-1;
+			pPerformance->bMIDIChannelSet = true;
 		}
 		else
 		{
-			m_nMIDIChannel[nTG] = CMIDIDevice::OmniMode;
-			bResult = true;
+			pPerformance->nMIDIChannel[nTG] = CMIDIDevice::OmniMode;
+			pPerformance->bMIDIChannelSet = true;
 		}
 
 		PropertyName.Format ("Volume%u", nTG+1);
-		m_nVolume[nTG] = m_Properties.GetNumber (PropertyName, 100);
+		pPerformance->nVolume[nTG] = pProperties->GetNumber (PropertyName, 100);
 
 		PropertyName.Format ("Pan%u", nTG+1);
-		m_nPan[nTG] = m_Properties.GetNumber (PropertyName, 64);
+		pPerformance->nPan[nTG] = pProperties->GetNumber (PropertyName, 64);
 
 		PropertyName.Format ("Detune%u", nTG+1);
-		m_nDetune[nTG] = m_Properties.GetSignedNumber (PropertyName, 0);
+		pPerformance->nDetune[nTG] = pProperties->GetSignedNumber (PropertyName, 0);
 
 		PropertyName.Format ("Cutoff%u", nTG+1);
-		m_nCutoff[nTG] = m_Properties.GetNumber (PropertyName, 99);
+		pPerformance->nCutoff[nTG] = pProperties->GetNumber (PropertyName, 99);
 
 		PropertyName.Format ("Resonance%u", nTG+1);
-		m_nResonance[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nResonance[nTG] = pProperties->GetNumber (PropertyName, 0);
 
 		PropertyName.Format ("NoteLimitLow%u", nTG+1);
-		m_nNoteLimitLow[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nNoteLimitLow[nTG] = pProperties->GetNumber (PropertyName, 0);
 
 		PropertyName.Format ("NoteLimitHigh%u", nTG+1);
-		m_nNoteLimitHigh[nTG] = m_Properties.GetNumber (PropertyName, 127);
+		pPerformance->nNoteLimitHigh[nTG] = pProperties->GetNumber (PropertyName, 127);
 
 		PropertyName.Format ("NoteShift%u", nTG+1);
-		m_nNoteShift[nTG] = m_Properties.GetSignedNumber (PropertyName, 0);
+		pPerformance->nNoteShift[nTG] = pProperties->GetSignedNumber (PropertyName, 0);
 
 		PropertyName.Format ("ReverbSend%u", nTG+1);
-		m_nReverbSend[nTG] = m_Properties.GetNumber (PropertyName, 50);
+		pPerformance->nReverbSend[nTG] = pProperties->GetNumber (PropertyName, 50);
 		
 		PropertyName.Format ("PitchBendRange%u", nTG+1);
-		m_nPitchBendRange[nTG] = m_Properties.GetNumber (PropertyName, 2);
+		pPerformance->nPitchBendRange[nTG] = pProperties->GetNumber (PropertyName, 2);
 
 		PropertyName.Format ("PitchBendStep%u", nTG+1);
-		m_nPitchBendStep[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nPitchBendStep[nTG] = pProperties->GetNumber (PropertyName, 0);
 
 		PropertyName.Format ("PortamentoMode%u", nTG+1);
-		m_nPortamentoMode[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nPortamentoMode[nTG] = pProperties->GetNumber (PropertyName, 0);
 
 		PropertyName.Format ("PortamentoGlissando%u", nTG+1);
-		m_nPortamentoGlissando[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nPortamentoGlissando[nTG] = pProperties->GetNumber (PropertyName, 0);
 
 		PropertyName.Format ("PortamentoTime%u", nTG+1);
-		m_nPortamentoTime[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nPortamentoTime[nTG] = pProperties->GetNumber (PropertyName, 0);
 		
-		PropertyName.Format ("VoiceData%u", nTG+1); 
-		m_nVoiceDataTxt[nTG] = m_Properties.GetString (PropertyName, "");
+		// the blob is preferred, if both formats are present
+		PropertyName.Format ("VoiceBlob%u", nTG+1);
+		const char *pVoiceBlob = pProperties->GetString (PropertyName, "");
+		PropertyName.Format ("VoiceData%u", nTG+1);
+		const char *pVoiceData = pProperties->GetString (PropertyName, "");
+		pPerformance->bVoiceDataFilled[nTG] =
+			   CVoiceDataCodec::DecodeBlob (pVoiceBlob, pPerformance->VoiceData[nTG])
+			|| CVoiceDataCodec::DecodeHex (pVoiceData, pPerformance->VoiceData[nTG]);
 		
 		PropertyName.Format ("MonoMode%u", nTG+1);
-		m_bMonoMode[nTG] = m_Properties.GetNumber (PropertyName, 0) != 0;
+		pPerformance->bMonoMode[nTG] = pProperties->GetNumber (PropertyName, 0) != 0;
 				
 		PropertyName.Format ("ModulationWheelRange%u", nTG+1);
-		m_nModulationWheelRange[nTG] = m_Properties.GetNumber (PropertyName, 99); 
+		pPerformance->nModulationWheelRange[nTG] = pProperties->GetNumber (PropertyName, 99); 
 		
 		PropertyName.Format ("ModulationWheelTarget%u", nTG+1);
-		m_nModulationWheelTarget[nTG] = m_Properties.GetNumber (PropertyName, 1);
+		pPerformance->nModulationWheelTarget[nTG] = pProperties->GetNumber (PropertyName, 1);
 		
 		PropertyName.Format ("FootControlRange%u", nTG+1);
-		m_nFootControlRange[nTG] = m_Properties.GetNumber (PropertyName, 99); 
+		pPerformance->nFootControlRange[nTG] = pProperties->GetNumber (PropertyName, 99); 
 		
 		PropertyName.Format ("FootControlTarget%u", nTG+1);
-		m_nFootControlTarget[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nFootControlTarget[nTG] = pProperties->GetNumber (PropertyName, 0);
 		
 		PropertyName.Format ("BreathControlRange%u", nTG+1);
-		m_nBreathControlRange[nTG] = m_Properties.GetNumber (PropertyName, 99); 
+		pPerformance->nBreathControlRange[nTG] = pProperties->GetNumber (PropertyName, 99); 
 		
 		PropertyName.Format ("BreathControlTarget%u", nTG+1);
-		m_nBreathControlTarget[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nBreathControlTarget[nTG] = pProperties->GetNumber (PropertyName, 0);
 		
 		PropertyName.Format ("AftertouchRange%u", nTG+1);
-		m_nAftertouchRange[nTG] = m_Properties.GetNumber (PropertyName, 99); 
+		pPerformance->nAftertouchRange[nTG] = pProperties->GetNumber (PropertyName, 99); 
 		
 		PropertyName.Format ("AftertouchTarget%u", nTG+1);
-		m_nAftertouchTarget[nTG] = m_Properties.GetNumber (PropertyName, 0);
+		pPerformance->nAftertouchTarget[nTG] = pProperties->GetNumber (PropertyName, 0);
 		
 		}
 
-	m_bCompressorEnable = m_Properties.GetNumber ("CompressorEnable", 1) != 0;
+	pPerformance->bCompressorEnable = pProperties->GetNumber ("CompressorEnable", 1) != 0;
 
-	m_bReverbEnable = m_Properties.GetNumber ("ReverbEnable", 1) != 0;
-	m_nReverbSize = m_Properties.GetNumber ("ReverbSize", 70);
-	m_nReverbHighDamp = m_Properties.GetNumber ("ReverbHighDamp", 50);
-	m_nReverbLowDamp = m_Properties.GetNumber ("ReverbLowDamp", 50);
-	m_nReverbLowPass = m_Properties.GetNumber ("ReverbLowPass", 30);
-	m_nReverbDiffusion = m_Properties.GetNumber ("ReverbDiffusion", 65);
-	m_nReverbLevel = m_Properties.GetNumber ("ReverbLevel", 99);
+	pPerformance->bReverbEnable = pProperties->GetNumber ("ReverbEnable", 1) != 0;
+	pPerformance->nReverbSize = pProperties->GetNumber ("ReverbSize", 70);
+	pPerformance->nReverbHighDamp = pProperties->GetNumber ("ReverbHighDamp", 50);
+	pPerformance->nReverbLowDamp = pProperties->GetNumber ("ReverbLowDamp", 50);
+	pPerformance->nReverbLowPass = pProperties->GetNumber ("ReverbLowPass", 30);
+	pPerformance->nReverbDiffusion = pProperties->GetNumber ("ReverbDiffusion", 65);
+	pPerformance->nReverbLevel = pProperties->GetNumber ("ReverbLevel", 99);
 
-	return bResult;
 }
 
+// Only starts the save. The file is written by SaveStep() from the main loop.
 bool CPerformanceConfig::Save (void)
 {
-	m_Properties.RemoveAll ();
+	FlushSave ();
+
+	assert (nActualPerformance < m_Index.size ());
+	TIndexEntry &rEntry = m_Index[nActualPerformance];
+	if (   !m_bDirty
+	    && rEntry.TableState == TableValid)
+	{
+		LOGDBG ("Performance %u unchanged, not saved", nActualPerformance);
+
+		return true;
+	}
+
+	m_SavePath = "SD:/" + GetPerformancePath (nActualPerformance);
+	std::string TempPath = m_SavePath + ".tmp";
+
+	FRESULT Result = f_open (&m_SaveFile, TempPath.c_str (), FA_WRITE | FA_CREATE_ALWAYS);
+	if (Result != FR_OK)
+	{
+		LOGERR ("Cannot create %s (%d)", TempPath.c_str (), Result);
+
+		return false;
+	}
+
+	Serialize (m_Performance, &m_SaveText);
+	m_nSavePos = 0;
+	m_nSaveID = nActualPerformance;
+	m_bSaveActive = true;
+
+	// the table must match the file
+	if (!rEntry.pPerformance)
+	{
+		rEntry.pPerformance = new TPerformance;
+		assert (rEntry.pPerformance);
+	}
+	*rEntry.pPerformance = m_Performance;
+	rEntry.pPerformance->bMIDIChannelSet = false;
+	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
+	{
+		if (m_Performance.nMIDIChannel[nTG] != CMIDIDevice::Disabled)
+		{
+			rEntry.pPerformance->bMIDIChannelSet = true;
+		}
+	}
+	rEntry.TableState = TableValid;
+
+	m_bDirty = false;
+
+	return true;
+}
+
+// Writes the next chunk of a pending save. When the temporary file is
+// complete, it replaces the performance file, so that a failed write does
+// not destroy it. The previous file is renamed to .bak before and deleted
+// afterwards, so that there is always one complete file (see RecoverBackup()).
+void CPerformanceConfig::SaveStep (void)
+{
+	if (!m_bSaveActive)
+	{
+		return;
+	}
+
+	unsigned nBytes = m_SaveText.length () - m_nSavePos;
+	if (nBytes > SaveChunkSize)
+	{
+		nBytes = SaveChunkSize;
+	}
+
+	if (nBytes > 0)
+	{
+		UINT nWritten;
+		if (   f_write (&m_SaveFile, m_SaveText.c_str () + m_nSavePos, nBytes, &nWritten) != FR_OK
+		    || nWritten != nBytes)
+		{
+			FinishSave (false);
+
+			return;
+		}
+
+		m_nSavePos += nBytes;
+
+		return;
+	}
+
+	FinishSave (true);
+}
+
+bool CPerformanceConfig::IsSaving (void) const
+{
+	return m_bSaveActive;
+}
+
+void CPerformanceConfig::FlushSave (void)
+{
+	while (m_bSaveActive)
+	{
+		SaveStep ();
+	}
+}
+
+void CPerformanceConfig::FinishSave (bool bOK)
+{
+	assert (m_bSaveActive);
+	m_bSaveActive = false;
+
+	std::string TempPath = m_SavePath + ".tmp";
+
+	if (f_close (&m_SaveFile) != FR_OK)
+	{
+		bOK = false;
+	}
+
+	if (bOK)
+	{
+		std::string BackupPath = m_SavePath + ".bak";
+		f_unlink (BackupPath.c_str ());
+
+		FRESULT Result = f_rename (m_SavePath.c_str (), BackupPath.c_str ());
+		bOK =    (Result == FR_OK || Result == FR_NO_FILE)
+		      && f_rename (TempPath.c_str (), m_SavePath.c_str ()) == FR_OK;
+
+		if (bOK)
+		{
+			f_unlink (BackupPath.c_str ());
+		}
+		else if (Result == FR_OK)
+		{
+			f_rename (BackupPath.c_str (), m_SavePath.c_str ());
+		}
+	}
+
+	if (!bOK)
+	{
+		LOGERR ("Cannot save %s", m_SavePath.c_str ());
+
+		f_unlink (TempPath.c_str ());
+
+		// the file has the previous content or is missing
+		assert (m_nSaveID < m_Index.size ());
+		m_Index[m_nSaveID].TableState = TableNotRead;
+		if (m_nSaveID == nActualPerformance)
+		{
+			m_bDirty = true;
+		}
+	}
+	else
+	{
+		LOGDBG ("%s saved", m_SavePath.c_str ());
+	}
+
+	m_SaveText.clear ();
+}
+
+// If the power failed during FinishSave(), the .bak file is either the only
+// complete file or the new file has been renamed into place already.
+void CPerformanceConfig::RecoverBackup (const std::string &rPath)
+{
+	std::string BackupPath = rPath + ".bak";
+
+	FILINFO FileInfo;
+	if (f_stat (BackupPath.c_str (), &FileInfo) != FR_OK)
+	{
+		return;
+	}
+
+	if (f_stat (rPath.c_str (), &FileInfo) == FR_OK)
+	{
+		f_unlink (BackupPath.c_str ());
+	}
+	else
+	{
+		LOGWARN ("Restoring %s from backup", rPath.c_str ());
+
+		f_rename (BackupPath.c_str (), rPath.c_str ());
+	}
+}
+
+void CPerformanceConfig::AppendNumber (std::string *pText, const char *pName, unsigned nValue)
+{
+	CString Value;
+	Value.Format ("%u", nValue);
+
+	AppendString (pText, pName, Value);
+}
+
+void CPerformanceConfig::AppendSignedNumber (std::string *pText, const char *pName, int nValue)
+{
+	CString Value;
+	Value.Format ("%d", nValue);
+
+	AppendString (pText, pName, Value);
+}
+
+// same format as written by CPropertiesFatFsFile
+void CPerformanceConfig::AppendString (std::string *pText, const char *pName, const char *pValue)
+{
+	assert (pText);
+	assert (pName);
+	assert (pValue);
+
+	*pText += pName;
+	*pText += '=';
+	*pText += pValue;
+	*pText += '\n';
+}
+void CPerformanceConfig::Serialize (const TPerformance &rPerformance, std::string *pText) const
+{
+	assert (pText);
+	pText->clear ();
 
 	for (unsigned nTG = 0; nTG < CConfig::ToneGenerators; nTG++)
 	{
 		CString PropertyName;
 
 		PropertyName.Format ("BankNumber%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nBankNumber[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nBankNumber[nTG]);
 
 		PropertyName.Format ("VoiceNumber%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nVoiceNumber[nTG]+1);
+		AppendNumber (pText, PropertyName, rPerformance.nVoiceNumber[nTG]+1);
 
 		PropertyName.Format ("MIDIChannel%u", nTG+1);
-		unsigned nMIDIChannel = m_nMIDIChannel[nTG];
+		unsigned nMIDIChannel = rPerformance.nMIDIChannel[nTG];
 		if (nMIDIChannel < CMIDIDevice::Channels)
 		{
 			nMIDIChannel++;
@@ -193,546 +538,581 @@ bool CPerformanceConfig::Save (void)
 		{
 			nMIDIChannel = 0;
 		}
-		m_Properties.SetNumber (PropertyName, nMIDIChannel);
+		AppendNumber (pText, PropertyName, nMIDIChannel);
 
 		PropertyName.Format ("Volume%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nVolume[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nVolume[nTG]);
 
 		PropertyName.Format ("Pan%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nPan[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nPan[nTG]);
 
 		PropertyName.Format ("Detune%u", nTG+1);
-		m_Properties.SetSignedNumber (PropertyName, m_nDetune[nTG]);
+		AppendSignedNumber (pText, PropertyName, rPerformance.nDetune[nTG]);
 
 		PropertyName.Format ("Cutoff%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nCutoff[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nCutoff[nTG]);
 
 		PropertyName.Format ("Resonance%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nResonance[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nResonance[nTG]);
 
 		PropertyName.Format ("NoteLimitLow%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nNoteLimitLow[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nNoteLimitLow[nTG]);
 
 		PropertyName.Format ("NoteLimitHigh%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nNoteLimitHigh[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nNoteLimitHigh[nTG]);
 
 		PropertyName.Format ("NoteShift%u", nTG+1);
-		m_Properties.SetSignedNumber (PropertyName, m_nNoteShift[nTG]);
+		AppendSignedNumber (pText, PropertyName, rPerformance.nNoteShift[nTG]);
 
 		PropertyName.Format ("ReverbSend%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nReverbSend[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nReverbSend[nTG]);
 		
 		PropertyName.Format ("PitchBendRange%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nPitchBendRange[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nPitchBendRange[nTG]);
 
 		PropertyName.Format ("PitchBendStep%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nPitchBendStep[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nPitchBendStep[nTG]);
 
 		PropertyName.Format ("PortamentoMode%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nPortamentoMode[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nPortamentoMode[nTG]);
 
 		PropertyName.Format ("PortamentoGlissando%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nPortamentoGlissando[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nPortamentoGlissando[nTG]);
 
 		PropertyName.Format ("PortamentoTime%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nPortamentoTime[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nPortamentoTime[nTG]);
 		
-		PropertyName.Format ("VoiceData%u", nTG+1);
-		char *cstr = &m_nVoiceDataTxt[nTG][0];
-		m_Properties.SetString (PropertyName, cstr);
+		if (rPerformance.bVoiceDataFilled[nTG])
+		{
+			if (m_bVoiceDataBlob)
+			{
+				char VoiceBlob[CVoiceDataCodec::BlobLength+1];
+				CVoiceDataCodec::EncodeBlob (rPerformance.VoiceData[nTG], VoiceBlob);
+				PropertyName.Format ("VoiceBlob%u", nTG+1);
+				AppendString (pText, PropertyName, VoiceBlob);
+			}
+			else
+			{
+				char VoiceData[CVoiceDataCodec::HexLength+1];
+				CVoiceDataCodec::EncodeHex (rPerformance.VoiceData[nTG], VoiceData);
+				PropertyName.Format ("VoiceData%u", nTG+1);
+				AppendString (pText, PropertyName, VoiceData);
+			}
+		}
+		else
+		{
+			PropertyName.Format ("VoiceData%u", nTG+1);
+			AppendString (pText, PropertyName, "");
+		}
 		
 		PropertyName.Format ("MonoMode%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_bMonoMode[nTG] ? 1 : 0);
+		AppendNumber (pText, PropertyName, rPerformance.bMonoMode[nTG] ? 1 : 0);
 				
 		PropertyName.Format ("ModulationWheelRange%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nModulationWheelRange[nTG]);
+		AppendNumber (pText, PropertyName, rPerformance.nModulationWheelRange[nTG]);
 	
 		PropertyName.Format ("ModulationWheelTarget%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nModulationWheelTarget[nTG]);	
+		AppendNumber (pText, PropertyName, rPerformance.nModulationWheelTarget[nTG]);	
 			
 		PropertyName.Format ("FootControlRange%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nFootControlRange[nTG]);	
+		AppendNumber (pText, PropertyName, rPerformance.nFootControlRange[nTG]);	
 		
 		PropertyName.Format ("FootControlTarget%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nFootControlTarget[nTG]);	
+		AppendNumber (pText, PropertyName, rPerformance.nFootControlTarget[nTG]);	
 		
 		PropertyName.Format ("BreathControlRange%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nBreathControlRange[nTG]);	
+		AppendNumber (pText, PropertyName, rPerformance.nBreathControlRange[nTG]);	
 		
 		PropertyName.Format ("BreathControlTarget%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nBreathControlTarget[nTG]);	
+		AppendNumber (pText, PropertyName, rPerformance.nBreathControlTarget[nTG]);	
 		
 		PropertyName.Format ("AftertouchRange%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nAftertouchRange[nTG]);	
+		AppendNumber (pText, PropertyName, rPerformance.nAftertouchRange[nTG]);	
 		
 		PropertyName.Format ("AftertouchTarget%u", nTG+1);
-		m_Properties.SetNumber (PropertyName, m_nAftertouchTarget[nTG]);			
+		AppendNumber (pText, PropertyName, rPerformance.nAftertouchTarget[nTG]);			
 
 		}
 
-	m_Properties.SetNumber ("CompressorEnable", m_bCompressorEnable ? 1 : 0);
+	AppendNumber (pText, "CompressorEnable", rPerformance.bCompressorEnable ? 1 : 0);
 
-	m_Properties.SetNumber ("ReverbEnable", m_bReverbEnable ? 1 : 0);
-	m_Properties.SetNumber ("ReverbSize", m_nReverbSize);
-	m_Properties.SetNumber ("ReverbHighDamp", m_nReverbHighDamp);
-	m_Properties.SetNumber ("ReverbLowDamp", m_nReverbLowDamp);
-	m_Properties.SetNumber ("ReverbLowPass", m_nReverbLowPass);
-	m_Properties.SetNumber ("ReverbDiffusion", m_nReverbDiffusion);
-	m_Properties.SetNumber ("ReverbLevel", m_nReverbLevel);
-
-	return m_Properties.Save ();
+	AppendNumber (pText, "ReverbEnable", rPerformance.bReverbEnable ? 1 : 0);
+	AppendNumber (pText, "ReverbSize", rPerformance.nReverbSize);
+	AppendNumber (pText, "ReverbHighDamp", rPerformance.nReverbHighDamp);
+	AppendNumber (pText, "ReverbLowDamp", rPerformance.nReverbLowDamp);
+	AppendNumber (pText, "ReverbLowPass", rPerformance.nReverbLowPass);
+	AppendNumber (pText, "ReverbDiffusion", rPerformance.nReverbDiffusion);
+	AppendNumber (pText, "ReverbLevel", rPerformance.nReverbLevel);
 }
 
 unsigned CPerformanceConfig::GetBankNumber (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nBankNumber[nTG];
+	return m_Performance.nBankNumber[nTG];
 }
 
 unsigned CPerformanceConfig::GetVoiceNumber (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nVoiceNumber[nTG];
+	return m_Performance.nVoiceNumber[nTG];
 }
 
 unsigned CPerformanceConfig::GetMIDIChannel (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nMIDIChannel[nTG];
+	return m_Performance.nMIDIChannel[nTG];
 }
 
 unsigned CPerformanceConfig::GetVolume (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nVolume[nTG];
+	return m_Performance.nVolume[nTG];
 }
 
 unsigned CPerformanceConfig::GetPan (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nPan[nTG];
+	return m_Performance.nPan[nTG];
 }
 
 int CPerformanceConfig::GetDetune (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nDetune[nTG];
+	return m_Performance.nDetune[nTG];
 }
 
 unsigned CPerformanceConfig::GetCutoff (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nCutoff[nTG];
+	return m_Performance.nCutoff[nTG];
 }
 
 unsigned CPerformanceConfig::GetResonance (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nResonance[nTG];
+	return m_Performance.nResonance[nTG];
 }
 
 unsigned CPerformanceConfig::GetNoteLimitLow (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nNoteLimitLow[nTG];
+	return m_Performance.nNoteLimitLow[nTG];
 }
 
 unsigned CPerformanceConfig::GetNoteLimitHigh (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nNoteLimitHigh[nTG];
+	return m_Performance.nNoteLimitHigh[nTG];
 }
 
 int CPerformanceConfig::GetNoteShift (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nNoteShift[nTG];
+	return m_Performance.nNoteShift[nTG];
 }
 
 unsigned CPerformanceConfig::GetReverbSend (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nReverbSend[nTG];
+	return m_Performance.nReverbSend[nTG];
 }
 
 void CPerformanceConfig::SetBankNumber (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nBankNumber[nTG] = nValue;
+	Update (&m_Performance.nBankNumber[nTG], nValue);
 }
 
 void CPerformanceConfig::SetVoiceNumber (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nVoiceNumber[nTG] = nValue;
+	Update (&m_Performance.nVoiceNumber[nTG], nValue);
 }
 
 void CPerformanceConfig::SetMIDIChannel (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nMIDIChannel[nTG] = nValue;
+	Update (&m_Performance.nMIDIChannel[nTG], nValue);
 }
 
 void CPerformanceConfig::SetVolume (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nVolume[nTG] = nValue;
+	Update (&m_Performance.nVolume[nTG], nValue);
 }
 
 void CPerformanceConfig::SetPan (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPan[nTG] = nValue;
+	Update (&m_Performance.nPan[nTG], nValue);
 }
 
 void CPerformanceConfig::SetDetune (int nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nDetune[nTG] = nValue;
+	Update (&m_Performance.nDetune[nTG], nValue);
 }
 
 void CPerformanceConfig::SetCutoff (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nCutoff[nTG] = nValue;
+	Update (&m_Performance.nCutoff[nTG], nValue);
 }
 
 void CPerformanceConfig::SetResonance (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nResonance[nTG] = nValue;
+	Update (&m_Performance.nResonance[nTG], nValue);
 }
 
 void CPerformanceConfig::SetNoteLimitLow (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nNoteLimitLow[nTG] = nValue;
+	Update (&m_Performance.nNoteLimitLow[nTG], nValue);
 }
 
 void CPerformanceConfig::SetNoteLimitHigh (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nNoteLimitHigh[nTG] = nValue;
+	Update (&m_Performance.nNoteLimitHigh[nTG], nValue);
 }
 
 void CPerformanceConfig::SetNoteShift (int nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nNoteShift[nTG] = nValue;
+	Update (&m_Performance.nNoteShift[nTG], nValue);
 }
 
 void CPerformanceConfig::SetReverbSend (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nReverbSend[nTG] = nValue;
+	Update (&m_Performance.nReverbSend[nTG], nValue);
 }
 
 bool CPerformanceConfig::GetCompressorEnable (void) const
 {
-	return m_bCompressorEnable;
+	return m_Performance.bCompressorEnable;
 }
 
 bool CPerformanceConfig::GetReverbEnable (void) const
 {
-	return m_bReverbEnable;
+	return m_Performance.bReverbEnable;
 }
 
 unsigned CPerformanceConfig::GetReverbSize (void) const
 {
-	return m_nReverbSize;
+	return m_Performance.nReverbSize;
 }
 
 unsigned CPerformanceConfig::GetReverbHighDamp (void) const
 {
-	return m_nReverbHighDamp;
+	return m_Performance.nReverbHighDamp;
 }
 
 unsigned CPerformanceConfig::GetReverbLowDamp (void) const
 {
-	return m_nReverbLowDamp;
+	return m_Performance.nReverbLowDamp;
 }
 
 unsigned CPerformanceConfig::GetReverbLowPass (void) const
 {
-	return m_nReverbLowPass;
+	return m_Performance.nReverbLowPass;
 }
 
 unsigned CPerformanceConfig::GetReverbDiffusion (void) const
 {
-	return m_nReverbDiffusion;
+	return m_Performance.nReverbDiffusion;
 }
 
 unsigned CPerformanceConfig::GetReverbLevel (void) const
 {
-	return m_nReverbLevel;
+	return m_Performance.nReverbLevel;
 }
 
 void CPerformanceConfig::SetCompressorEnable (bool bValue)
 {
-	m_bCompressorEnable = bValue;
+	Update (&m_Performance.bCompressorEnable, bValue);
 }
 
 void CPerformanceConfig::SetReverbEnable (bool bValue)
 {
-	m_bReverbEnable = bValue;
+	Update (&m_Performance.bReverbEnable, bValue);
 }
 
 void CPerformanceConfig::SetReverbSize (unsigned nValue)
 {
-	m_nReverbSize = nValue;
+	Update (&m_Performance.nReverbSize, nValue);
 }
 
 void CPerformanceConfig::SetReverbHighDamp (unsigned nValue)
 {
-	m_nReverbHighDamp = nValue;
+	Update (&m_Performance.nReverbHighDamp, nValue);
 }
 
 void CPerformanceConfig::SetReverbLowDamp (unsigned nValue)
 {
-	m_nReverbLowDamp = nValue;
+	Update (&m_Performance.nReverbLowDamp, nValue);
 }
 
 void CPerformanceConfig::SetReverbLowPass (unsigned nValue)
 {
-	m_nReverbLowPass = nValue;
+	Update (&m_Performance.nReverbLowPass, nValue);
 }
 
 void CPerformanceConfig::SetReverbDiffusion (unsigned nValue)
 {
-	m_nReverbDiffusion = nValue;
+	Update (&m_Performance.nReverbDiffusion, nValue);
 }
 
 void CPerformanceConfig::SetReverbLevel (unsigned nValue)
 {
-	m_nReverbLevel = nValue;
+	Update (&m_Performance.nReverbLevel, nValue);
 }
 // Pitch bender and portamento:
 void CPerformanceConfig::SetPitchBendRange (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPitchBendRange[nTG] = nValue;
+	Update (&m_Performance.nPitchBendRange[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetPitchBendRange (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nPitchBendRange[nTG];
+	return m_Performance.nPitchBendRange[nTG];
 }
 
 
 void CPerformanceConfig::SetPitchBendStep (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPitchBendStep[nTG] = nValue;
+	Update (&m_Performance.nPitchBendStep[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetPitchBendStep (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nPitchBendStep[nTG];
+	return m_Performance.nPitchBendStep[nTG];
 }
 
 
 void CPerformanceConfig::SetPortamentoMode (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPortamentoMode[nTG] = nValue;
+	Update (&m_Performance.nPortamentoMode[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetPortamentoMode (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nPortamentoMode[nTG];
+	return m_Performance.nPortamentoMode[nTG];
 }
 
 
 void CPerformanceConfig::SetPortamentoGlissando (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPortamentoGlissando[nTG] = nValue;
+	Update (&m_Performance.nPortamentoGlissando[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetPortamentoGlissando (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nPortamentoGlissando[nTG];
+	return m_Performance.nPortamentoGlissando[nTG];
 }
 
 
 void CPerformanceConfig::SetPortamentoTime (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nPortamentoTime[nTG] = nValue;
+	Update (&m_Performance.nPortamentoTime[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetPortamentoTime (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nPortamentoTime[nTG];
+	return m_Performance.nPortamentoTime[nTG];
 }
 
 void CPerformanceConfig::SetMonoMode (bool bValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_bMonoMode[nTG] = bValue;
+	Update (&m_Performance.bMonoMode[nTG], bValue);
 }
 
 bool CPerformanceConfig::GetMonoMode (unsigned nTG) const
 {
-	return m_bMonoMode[nTG];
+	return m_Performance.bMonoMode[nTG];
 }
 
 void CPerformanceConfig::SetModulationWheelRange (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nModulationWheelRange[nTG] = nValue;
+	Update (&m_Performance.nModulationWheelRange[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetModulationWheelRange (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nModulationWheelRange[nTG];
+	return m_Performance.nModulationWheelRange[nTG];
 }
 
 void CPerformanceConfig::SetModulationWheelTarget (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nModulationWheelTarget[nTG] = nValue;
+	Update (&m_Performance.nModulationWheelTarget[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetModulationWheelTarget (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nModulationWheelTarget[nTG];
+	return m_Performance.nModulationWheelTarget[nTG];
 }
 
 void CPerformanceConfig::SetFootControlRange (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nFootControlRange[nTG] = nValue;
+	Update (&m_Performance.nFootControlRange[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetFootControlRange (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nFootControlRange[nTG];
+	return m_Performance.nFootControlRange[nTG];
 }
 
 void CPerformanceConfig::SetFootControlTarget (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nFootControlTarget[nTG] = nValue;
+	Update (&m_Performance.nFootControlTarget[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetFootControlTarget (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nFootControlTarget[nTG];
+	return m_Performance.nFootControlTarget[nTG];
 }
 
 void CPerformanceConfig::SetBreathControlRange (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nBreathControlRange[nTG] = nValue;
+	Update (&m_Performance.nBreathControlRange[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetBreathControlRange (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nBreathControlRange[nTG];
+	return m_Performance.nBreathControlRange[nTG];
 }
 
 void CPerformanceConfig::SetBreathControlTarget (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nBreathControlTarget[nTG] = nValue;
+	Update (&m_Performance.nBreathControlTarget[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetBreathControlTarget (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nBreathControlTarget[nTG];
+	return m_Performance.nBreathControlTarget[nTG];
 }
 
 void CPerformanceConfig::SetAftertouchRange (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nAftertouchRange[nTG] = nValue;
+	Update (&m_Performance.nAftertouchRange[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetAftertouchRange (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nAftertouchRange[nTG];
+	return m_Performance.nAftertouchRange[nTG];
 }
 
 void CPerformanceConfig::SetAftertouchTarget (unsigned nValue, unsigned nTG)
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nAftertouchTarget[nTG] = nValue;
+	Update (&m_Performance.nAftertouchTarget[nTG], nValue);
 }
 
 unsigned CPerformanceConfig::GetAftertouchTarget (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	return m_nAftertouchTarget[nTG];
+	return m_Performance.nAftertouchTarget[nTG];
 }
 
 void CPerformanceConfig::SetVoiceDataToTxt (const uint8_t *pData, unsigned nTG)  
 {
 	assert (nTG < CConfig::ToneGenerators);
-	m_nVoiceDataTxt[nTG] = "";
-	char nDtoH[]="0123456789ABCDEF";
-	for (int i = 0; i < NUM_VOICE_PARAM; i++)
+	assert (pData);
+	if (   !m_Performance.bVoiceDataFilled[nTG]
+	    || memcmp (m_Performance.VoiceData[nTG], pData, NUM_VOICE_PARAM) != 0)
 	{
-	m_nVoiceDataTxt[nTG]  += nDtoH[(pData[i] & 0xF0)/16];
-	m_nVoiceDataTxt[nTG]  += nDtoH[pData[i] & 0x0F]  ;
-	if ( i < (NUM_VOICE_PARAM-1)  ) 
-    	{
-     	 m_nVoiceDataTxt[nTG] += " ";
-    	}
+		memcpy (m_Performance.VoiceData[nTG], pData, NUM_VOICE_PARAM);
+		m_Performance.bVoiceDataFilled[nTG] = true;
+		m_bDirty = true;
 	}
 }
 
-uint8_t *CPerformanceConfig::GetVoiceDataFromTxt (unsigned nTG) 
+void CPerformanceConfig::SetVoiceDataBlob (bool bBlob)
+{
+	m_bVoiceDataBlob = bBlob;
+}
+
+const uint8_t *CPerformanceConfig::GetVoiceDataFromTxt (unsigned nTG) const
 {
 	assert (nTG < CConfig::ToneGenerators);
-	static uint8_t pData[NUM_VOICE_PARAM];
-	std::string nHtoD="0123456789ABCDEF";
-	 
- 	for (int i=0; i<NUM_VOICE_PARAM * 3; i=i+3)
-	{
-  	pData[i/3] = ((nHtoD.find(toupper(m_nVoiceDataTxt[nTG][i]),0) * 16 + nHtoD.find(toupper(m_nVoiceDataTxt[nTG][i+1]),0))) & 0xFF ;
-	} 
-  
-	return pData;
+	return m_Performance.VoiceData[nTG];
 }
 
-bool CPerformanceConfig::VoiceDataFilled(unsigned nTG) 
+bool CPerformanceConfig::VoiceDataFilled(unsigned nTG) const
 {
-	return (strcmp(m_nVoiceDataTxt[nTG].c_str(),"") != 0) ;
+	assert (nTG < CConfig::ToneGenerators);
+	return m_Performance.bVoiceDataFilled[nTG];
 }
 
 std::string CPerformanceConfig::GetPerformanceFileName(unsigned nID)
 {
-	return m_nPerformanceFileName[nID];
+	assert (nID < m_Index.size ());
+	return m_Index[nID].FileName;
 }
 
-std::string CPerformanceConfig::GetPerformanceName(unsigned nID)
+const std::string &CPerformanceConfig::GetPerformanceName(unsigned nID) const
 {
-	if(nID == 0) // in order to assure retrocompatibility
+	assert (nID < m_Index.size ());
+	return m_Index[nID].Name;
+}
+
+// "NNNNNN_Name.ini" is displayed as "Name"
+std::string CPerformanceConfig::GetDisplayName (const std::string &rFileName)
+{
+	if (rFileName == "performance.ini") // in order to assure retrocompatibility
 	{
 		return "Default";
 	}
-	else
+
+	return rFileName.substr(0,rFileName.length()-4).substr(7,14);
+}
+
+unsigned CPerformanceConfig::GetFileIndex (const std::string &rFileName)
+{
+	unsigned nIndex = 0;
+	for (unsigned i = 0; i < 6 && i < rFileName.length (); i++)
 	{
-		return m_nPerformanceFileName[nID].substr(0,m_nPerformanceFileName[nID].length()-4).substr(7,14);
+		char chChar = rFileName[i];
+		if (chChar < '0' || chChar > '9')
+		{
+			return 0;
+		}
+
+		nIndex = nIndex*10 + chChar-'0';
 	}
+
+	return nIndex;
 }
 
 unsigned CPerformanceConfig::GetLastPerformance()
 {
-	return nLastPerformance;
+	return m_Index.size ();
 }
 
 unsigned CPerformanceConfig::GetActualPerformanceID()
@@ -752,7 +1132,7 @@ bool CPerformanceConfig::GetInternalFolderOk()
 
 bool CPerformanceConfig::CheckFreePerformanceSlot(void)
 {
-	if (nLastPerformance < NUM_PERFORMANCES)
+	if (m_Index.size () < NUM_PERFORMANCES)
 	{
 		// There is a free slot...
 		return true;
@@ -765,7 +1145,9 @@ bool CPerformanceConfig::CheckFreePerformanceSlot(void)
 
 bool CPerformanceConfig::CreateNewPerformanceFile(void)
 {
-	if (nLastPerformance >= NUM_PERFORMANCES) {
+	FlushSave ();
+
+	if (m_Index.size () >= NUM_PERFORMANCES) {
 		// No space left for new performances
 		LOGWARN ("No space left for new performance");
 		return false;
@@ -773,7 +1155,6 @@ bool CPerformanceConfig::CreateNewPerformanceFile(void)
 
 	std::string sPerformanceName = NewPerformanceName;
 	NewPerformanceName=""; 
-	nActualPerformance=nLastPerformance;
 	std::string nFileName;
 	std::string nPath;
 	std::string nIndex = "000000";
@@ -793,7 +1174,7 @@ bool CPerformanceConfig::CreateNewPerformanceFile(void)
 		nFileName +=sPerformanceName.substr(0,14);
 	}
 	nFileName += ".ini";
-	m_nPerformanceFileName[nLastPerformance]= nFileName;
+	TIndexEntry Entry {nFileName, GetDisplayName (nFileName), TableNotRead, nullptr};	// read when it is saved
 	
 	nPath = "SD:/" ;
 	nPath += PERFORMANCE_DIR;
@@ -804,30 +1185,34 @@ bool CPerformanceConfig::CreateNewPerformanceFile(void)
 	FRESULT Result = f_open (&File, nFileName.c_str(), FA_WRITE | FA_CREATE_ALWAYS);
 	if (Result != FR_OK)
 	{
-		m_nPerformanceFileName[nLastPerformance]=nullptr;
 		return false;
 	}
 
 	if (f_close (&File) != FR_OK)
 	{
-		m_nPerformanceFileName[nLastPerformance]=nullptr;
 		return false;
 	}
 	
-	nLastPerformance++;
+	// the file index is the highest one, so it is appended usually
+	auto Pos = std::lower_bound (m_Index.begin () + 1, m_Index.end (), Entry,
+				     [] (const TIndexEntry &rEntry1, const TIndexEntry &rEntry2)
+				     { return rEntry1.FileName < rEntry2.FileName; });
+	nActualPerformance = m_Index.insert (Pos, Entry) - m_Index.begin ();
 	new (&m_Properties) CPropertiesFatFsFile(nFileName.c_str(), m_pFileSystem);
+	m_bDirty = true;
 	
 	return true;
 }
 
 bool CPerformanceConfig::ListPerformances()
 {
+	FlushSave ();
+
 	nInternalFolderOk=false;
 	nExternalFolderOk=false; // for future USB implementation
-	nLastPerformance=0;
 	nLastFileIndex=0;
-   	m_nPerformanceFileName[nLastPerformance++]="performance.ini"; // in order to assure retrocompatibility
 	
+	std::vector<std::string> FileNames;
 	unsigned nPIndex;
     DIR Directory;
 	FILINFO FileInfo;
@@ -848,10 +1233,26 @@ bool CPerformanceConfig::ListPerformances()
 	
 	if (nInternalFolderOk)
 	{
+	// restore performances, which have been left as backup only
+	std::vector<std::string> BackupNames;
+	Result = f_findfirst (&Directory, &FileInfo, "SD:/" PERFORMANCE_DIR, "*.ini.bak");
+	while (Result == FR_OK && FileInfo.fname[0])
+	{
+		BackupNames.push_back (FileInfo.fname);
+
+		Result = f_findnext (&Directory, &FileInfo);
+	}
+	f_closedir (&Directory);
+
+	for (const std::string &rBackupName : BackupNames)
+	{
+		RecoverBackup ("SD:/" PERFORMANCE_DIR "/" + rBackupName.substr (0, rBackupName.length ()-4));
+	}
+
 	Result = f_findfirst (&Directory, &FileInfo, "SD:/" PERFORMANCE_DIR, "*.ini");
 		for (unsigned i = 0; Result == FR_OK && FileInfo.fname[0]; i++)
 		{
-			if (nLastPerformance >= NUM_PERFORMANCES) {
+			if (FileNames.size () >= NUM_PERFORMANCES-1) {
 				LOGNOTE ("Skipping performance %s", FileInfo.fname);
 			} else {
 				if (!(FileInfo.fattrib & (AM_HID | AM_SYS)))  
@@ -860,13 +1261,13 @@ bool CPerformanceConfig::ListPerformances()
 					size_t nLen = FileName.length();
 					if (   nLen > 8 && nLen <26	 && strcmp(FileName.substr(6,1).c_str(), "_")==0)
 					{			
-						nPIndex=stoi(FileName.substr(0,6));
+						nPIndex=GetFileIndex(FileName);
 						if(nPIndex > nLastFileIndex)
 						{
 							nLastFileIndex=nPIndex;
 						}
 
-						m_nPerformanceFileName[nLastPerformance++]= FileName;
+						FileNames.push_back (FileName);
 					}	
 				}
 			}
@@ -874,13 +1275,56 @@ bool CPerformanceConfig::ListPerformances()
 			Result = f_findnext (&Directory, &FileInfo);
 		}
 		// sort by performance number-name
-		if (nLastPerformance > 2)
+		std::sort (FileNames.begin (), FileNames.end ());
+	}
+
+	// Merge the sorted lists, the known performances keep their table entries.
+	// The default is always on first place.
+	std::string ActualFileName = m_Index[nActualPerformance].FileName;
+	std::vector<TIndexEntry> Index;
+	Index.reserve (FileNames.size () + 1);
+	Index.push_back (m_Index[0]);
+	nActualPerformance = 0;
+
+	unsigned nOld = 1;
+	unsigned nAdded = 0;
+	unsigned nRemoved = 0;
+	for (const std::string &rFileName : FileNames)
+	{
+		while (   nOld < m_Index.size ()
+		       && m_Index[nOld].FileName < rFileName)
+		{
+			FreeIndexEntry (&m_Index[nOld++]);
+			nRemoved++;
+		}
+
+		if (   nOld < m_Index.size ()
+		    && m_Index[nOld].FileName == rFileName)
+		{
+			Index.push_back (m_Index[nOld++]);
+		}
+		else
 		{
-		sort (m_nPerformanceFileName+1, m_nPerformanceFileName + nLastPerformance); // default is always on first place. %%%%%%%%%%%%%%%%
+			Index.push_back ({rFileName, GetDisplayName (rFileName), TableNotRead, nullptr});
+			nAdded++;
+		}
+
+		if (rFileName == ActualFileName)
+		{
+			nActualPerformance = Index.size ()-1;
 		}
 	}
-	
-	LOGNOTE ("Number of Performances: %d", nLastPerformance);
+
+	for (; nOld < m_Index.size (); nOld++)
+	{
+		FreeIndexEntry (&m_Index[nOld]);
+		nRemoved++;
+	}
+
+	m_Index.swap (Index);
+
+	LOGNOTE ("Number of Performances: %u", (unsigned) m_Index.size ());
+	LOGDBG ("%u performances added, %u removed", nAdded, nRemoved);
 	
 	return nInternalFolderOk;
 }   
@@ -889,17 +1333,25 @@ bool CPerformanceConfig::ListPerformances()
 void CPerformanceConfig::SetNewPerformance (unsigned nID)
 {
 		nActualPerformance=nID;
-		std::string FileN = "";
-		if (nID != 0) // in order to assure retrocompatibility
-		{
-			FileN += PERFORMANCE_DIR;
-			FileN += "/";
-		}
-		FileN += m_nPerformanceFileName[nID];
-		new (&m_Properties) CPropertiesFatFsFile(FileN.c_str(), m_pFileSystem);
+		new (&m_Properties) CPropertiesFatFsFile(GetPerformancePath (nID).c_str(), m_pFileSystem);
+		m_bDirty = true;		// until the content of the file is set or loaded
 		
 }
 
+std::string CPerformanceConfig::GetPerformancePath (unsigned nID) const
+{
+	std::string FileN = "";
+	if (nID != 0) // in order to assure retrocompatibility
+	{
+		FileN += PERFORMANCE_DIR;
+		FileN += "/";
+	}
+	assert (nID < m_Index.size ());
+	FileN += m_Index[nID].FileName;
+
+	return FileN;
+}
+
 std::string CPerformanceConfig::GetNewPerformanceDefaultName(void)
 {
 	std::string nIndex = "000000";
@@ -925,27 +1377,29 @@ bool CPerformanceConfig::DeletePerformance(unsigned nID)
 {
 	bool bOK = false;
 	if(nID == 0){return bOK;} // default (performance.ini at root directory) can't be deleted
+	assert (nID < m_Index.size ());
+	FlushSave ();
 	DIR Directory;
 	FILINFO FileInfo;
 	std::string FileN = "SD:/";
 	FileN += PERFORMANCE_DIR;
 
 	
-	FRESULT Result = f_findfirst (&Directory, &FileInfo, FileN.c_str(), m_nPerformanceFileName[nID].c_str());
+	FRESULT Result = f_findfirst (&Directory, &FileInfo, FileN.c_str(), m_Index[nID].FileName.c_str());
 	if (Result == FR_OK && FileInfo.fname[0])
 	{
 		FileN += "/";
-		FileN += m_nPerformanceFileName[nID];
+		FileN += m_Index[nID].FileName;
 		Result=f_unlink (FileN.c_str());
 		if (Result == FR_OK)
 		{
 			SetNewPerformance(0);
 			nActualPerformance =0;
 			//nMenuSelectedPerformance=0;
-			m_nPerformanceFileName[nID]="ZZZZZZ";
-			sort (m_nPerformanceFileName+1, m_nPerformanceFileName + nLastPerformance); // test si va con -1 o no
-			--nLastPerformance;
-			m_nPerformanceFileName[nLastPerformance]=nullptr;
+
+			// the following performances move down by one
+			FreeIndexEntry (&m_Index[nID]);
+			m_Index.erase (m_Index.begin () + nID);
 			bOK=true;
 		}
 	}
@@ -26,19 +26,90 @@
 #include "config.h"
 #include <fatfs/ff.h>
 #include <Properties/propertiesfatfsfile.h>
+#include <string>
+#include <vector>
 #define NUM_VOICE_PARAM 156
 #define PERFORMANCE_DIR "performance" 
-#define NUM_PERFORMANCES 256
+#define NUM_PERFORMANCES 16384		// maximum number, including performance.ini
+#define PERFORMANCES_PER_BANK 128	// performance bank (Bank Select) and table page
 
 class CPerformanceConfig	// Performance configuration
 {
+public:
+	static const unsigned SaveChunkSize = 512;	// bytes written per SaveStep()
+
+	// all settings of a performance, which can be copied and kept in RAM
+	struct TPerformance
+	{
+		unsigned nBankNumber[CConfig::ToneGenerators];
+		unsigned nVoiceNumber[CConfig::ToneGenerators];
+		unsigned nMIDIChannel[CConfig::ToneGenerators];
+		unsigned nVolume[CConfig::ToneGenerators];
+		unsigned nPan[CConfig::ToneGenerators];
+		int nDetune[CConfig::ToneGenerators];
+		unsigned nCutoff[CConfig::ToneGenerators];
+		unsigned nResonance[CConfig::ToneGenerators];
+		unsigned nNoteLimitLow[CConfig::ToneGenerators];
+		unsigned nNoteLimitHigh[CConfig::ToneGenerators];
+		int nNoteShift[CConfig::ToneGenerators];
+		int nReverbSend[CConfig::ToneGenerators];
+		unsigned nPitchBendRange[CConfig::ToneGenerators];
+		unsigned nPitchBendStep[CConfig::ToneGenerators];
+		unsigned nPortamentoMode[CConfig::ToneGenerators];
+		unsigned nPortamentoGlissando[CConfig::ToneGenerators];
+		unsigned nPortamentoTime[CConfig::ToneGenerators];
+		uint8_t VoiceData[CConfig::ToneGenerators][NUM_VOICE_PARAM];
+		bool bVoiceDataFilled[CConfig::ToneGenerators];
+		bool bMonoMode[CConfig::ToneGenerators];
+
+		unsigned nModulationWheelRange[CConfig::ToneGenerators];
+		unsigned nModulationWheelTarget[CConfig::ToneGenerators];
+		unsigned nFootControlRange[CConfig::ToneGenerators];
+		unsigned nFootControlTarget[CConfig::ToneGenerators];
+		unsigned nBreathControlRange[CConfig::ToneGenerators];
+		unsigned nBreathControlTarget[CConfig::ToneGenerators];
+		unsigned nAftertouchRange[CConfig::ToneGenerators];
+		unsigned nAftertouchTarget[CConfig::ToneGenerators];
+
+		bool bCompressorEnable;
+		bool bReverbEnable;
+		unsigned nReverbSize;
+		unsigned nReverbHighDamp;
+		unsigned nReverbLowDamp;
+		unsigned nReverbLowPass;
+		unsigned nReverbDiffusion;
+		unsigned nReverbLevel;
+
+		bool bMIDIChannelSet;		// at least one TG has a MIDI channel
+	};
+
 public:
 	CPerformanceConfig (FATFS *pFileSystem);
 	~CPerformanceConfig (void);
 
 	bool Load (void);
 
-	bool Save (void);
+	// reads performance nID into *pPerformance, without changing the actual one
+	bool LoadPerformance (unsigned nID, TPerformance *pPerformance);
+
+	const TPerformance *GetPerformance (void) const;
+	void SetPerformance (const TPerformance &rPerformance);
+
+	// The performance files are parsed once into a table in RAM, so that
+	// selecting a performance does not access the SD card afterwards. The
+	// table is filled by ReadTableStep() from the main loop for the bank of
+	// the actual performance, a performance, which has not been read yet, is
+	// read on first use.
+	const TPerformance *GetStoredPerformance (unsigned nID);	// nullptr on error
+	void ReadTableStep (void);
+
+	// Save() is done only, if a setting has changed since the performance has
+	// been loaded or saved. The file is written by SaveStep() from the main loop
+	// into a temporary file, which replaces the performance file, when complete.
+	bool Save (void);				// false, if the save cannot be started
+	void SaveStep (void);
+	bool IsSaving (void) const;
+	void FlushSave (void);				// completes a pending save
 
 	// TG#
 	unsigned GetBankNumber (unsigned nTG) const;		// 0 .. 127
@@ -87,7 +158,7 @@ public:
 	void SetPortamentoGlissando (unsigned nValue, unsigned nTG);
 	void SetPortamentoTime (unsigned nValue, unsigned nTG);
 	void SetVoiceDataToTxt (const uint8_t *pData, unsigned nTG); 
-	uint8_t *GetVoiceDataFromTxt (unsigned nTG);
+	const uint8_t *GetVoiceDataFromTxt (unsigned nTG) const;
 	void SetMonoMode (bool bOKValue, unsigned nTG); 
 
 	void SetModulationWheelRange (unsigned nValue, unsigned nTG);
@@ -118,12 +189,16 @@ public:
 	void SetReverbDiffusion (unsigned nValue);
 	void SetReverbLevel (unsigned nValue);
 
-	bool VoiceDataFilled(unsigned nTG);
+	bool VoiceDataFilled(unsigned nTG) const;
+	// save the voices as base64 blob instead of hex (both are loaded)
+	void SetVoiceDataBlob (bool bBlob);
+	// The performance index is sorted by file name. If it is listed again,
+	// the known performances are kept with their table entries.
 	bool ListPerformances(); 
 	//std::string m_DirName;
 	void SetNewPerformance (unsigned nID);
 	std::string GetPerformanceFileName(unsigned nID);
-	std::string GetPerformanceName(unsigned nID);
+	const std::string &GetPerformanceName(unsigned nID) const;	// for display
 	unsigned GetLastPerformance();
 	void SetActualPerformanceID(unsigned nID);
 	unsigned GetActualPerformanceID();
@@ -134,57 +209,76 @@ public:
 	bool DeletePerformance(unsigned nID);
 	bool CheckFreePerformanceSlot(void);
 
+private:
+	std::string GetPerformancePath (unsigned nID) const;
+	static void ParseProperties (CPropertiesFatFsFile *pProperties, TPerformance *pPerformance);
+
+	void Serialize (const TPerformance &rPerformance, std::string *pText) const;
+	static void AppendNumber (std::string *pText, const char *pName, unsigned nValue);
+	static void AppendSignedNumber (std::string *pText, const char *pName, int nValue);
+	static void AppendString (std::string *pText, const char *pName, const char *pValue);
+
+	void FinishSave (bool bOK);
+	static void RecoverBackup (const std::string &rPath);	// rPath with "SD:/"
+
+	template <typename TField, typename TValue>
+	void Update (TField *pField, TValue Value)
+	{
+		if (*pField != (TField) Value)
+		{
+			*pField = (TField) Value;
+			m_bDirty = true;
+		}
+	}
+
+	void ReadTableEntry (unsigned nID);
+
+	static std::string GetDisplayName (const std::string &rFileName);
+	static unsigned GetFileIndex (const std::string &rFileName);	// 0 if none
+
+private:
+	enum TTableState : uint8_t
+	{
+		TableNotRead,
+		TableValid,
+		TableInvalid			// file cannot be read
+	};
+
+	struct TIndexEntry
+	{
+		std::string FileName;
+		std::string Name;
+		TTableState TableState;
+		TPerformance *pPerformance;	// table entry, allocated on first read
+	};
+
+	static void FreeIndexEntry (TIndexEntry *pEntry);
+
 private:
 	CPropertiesFatFsFile m_Properties;
 
-	unsigned m_nBankNumber[CConfig::ToneGenerators];
-	unsigned m_nVoiceNumber[CConfig::ToneGenerators];
-	unsigned m_nMIDIChannel[CConfig::ToneGenerators];
-	unsigned m_nVolume[CConfig::ToneGenerators];
-	unsigned m_nPan[CConfig::ToneGenerators];
-	int m_nDetune[CConfig::ToneGenerators];
-	unsigned m_nCutoff[CConfig::ToneGenerators];
-	unsigned m_nResonance[CConfig::ToneGenerators];
-	unsigned m_nNoteLimitLow[CConfig::ToneGenerators];
-	unsigned m_nNoteLimitHigh[CConfig::ToneGenerators];
-	int m_nNoteShift[CConfig::ToneGenerators];
-	int m_nReverbSend[CConfig::ToneGenerators];
-	unsigned m_nPitchBendRange[CConfig::ToneGenerators];
-	unsigned m_nPitchBendStep[CConfig::ToneGenerators];
-	unsigned m_nPortamentoMode[CConfig::ToneGenerators];
-	unsigned m_nPortamentoGlissando[CConfig::ToneGenerators];
-	unsigned m_nPortamentoTime[CConfig::ToneGenerators];
-	std::string m_nVoiceDataTxt[CConfig::ToneGenerators]; 
-	bool m_bMonoMode[CConfig::ToneGenerators]; 
-
-	unsigned m_nModulationWheelRange[CConfig::ToneGenerators];
-	unsigned m_nModulationWheelTarget[CConfig::ToneGenerators];
-	unsigned m_nFootControlRange[CConfig::ToneGenerators];	
-	unsigned m_nFootControlTarget[CConfig::ToneGenerators];	
-	unsigned m_nBreathControlRange[CConfig::ToneGenerators];	
-	unsigned m_nBreathControlTarget[CConfig::ToneGenerators];	
-	unsigned m_nAftertouchRange[CConfig::ToneGenerators];	
-	unsigned m_nAftertouchTarget[CConfig::ToneGenerators];	
-
-	unsigned nLastPerformance;  
+	TPerformance m_Performance;
+	bool m_bVoiceDataBlob;
+	bool m_bDirty;				// m_Performance differs from the file
+
+	bool m_bSaveActive;
+	FIL m_SaveFile;
+	std::string m_SavePath;			// the temporary file has ".tmp" appended
+	std::string m_SaveText;
+	unsigned m_nSavePos;
+	unsigned m_nSaveID;
+
+	// performance.ini first, followed by the files in PERFORMANCE_DIR
+	std::vector<TIndexEntry> m_Index;
+
 	unsigned nLastFileIndex;
 	unsigned nActualPerformance = 0;  
 	//unsigned nMenuSelectedPerformance = 0; 
-	std::string m_nPerformanceFileName[NUM_PERFORMANCES];
 	FATFS *m_pFileSystem; 
 
 	bool nInternalFolderOk=false;
 	bool nExternalFolderOk=false; // for future USB implementation
 	std::string NewPerformanceName="";
-	
-	bool m_bCompressorEnable;
-	bool m_bReverbEnable;
-	unsigned m_nReverbSize;
-	unsigned m_nReverbHighDamp;
-	unsigned m_nReverbLowDamp;
-	unsigned m_nReverbLowPass;
-	unsigned m_nReverbDiffusion;
-	unsigned m_nReverbLevel;
 };
 
 #endif
@@ -24,6 +24,7 @@
 #include <circle/logger.h>
 #include <cstring>
 #include "serialmididevice.h"
+#include "miditrace.h"
 #include <assert.h>
 
 LOGMODULE("serialmididevice");
@@ -35,6 +36,7 @@ CSerialMIDIDevice::CSerialMIDIDevice (CMiniDexed *pSynthesizer, CInterruptSystem
 	m_Serial (pInterrupt, TRUE),
 	m_nSerialState (0),
 	m_nSysEx (0),
+	m_bBankDump (false),
 	m_SendBuffer (&m_Serial)
 {
 	AddDevice ("ttyS1");
@@ -71,16 +73,19 @@ void CSerialMIDIDevice::Process (void)
 		return;
 	}
 
-        if (m_pConfig->GetMIDIDumpEnabled ())
+	if (m_pConfig->GetMIDIDumpEnabled ())
 	{
-		printf("Incoming MIDI data:");
-		for (uint16_t i = 0; i < nResult; i++)
+		for (int i = 0; i < nResult; i += CMIDITrace::MaxDataBytes)
 		{
-			if((i % 8) == 0)
-				printf("\n%04d:",i);
-			printf(" 0x%02x",Buffer[i]);
+			size_t nLength = nResult - i;
+			if (nLength > CMIDITrace::MaxDataBytes)
+			{
+				nLength = CMIDITrace::MaxDataBytes;
+			}
+
+			CMIDITrace::Get ()->Write (CMIDITrace::RecordSerialData, "ttyS1", 0,
+						   &Buffer[i], nLength);
 		}
-		printf("\n");
 	}
 
 	// Process MIDI messages
@@ -94,6 +99,12 @@ void CSerialMIDIDevice::Process (void)
 		if(uchData == 0xF0)
 		{
 			// SYSEX found
+			if (m_bBankDump)
+			{
+				BankDumpAbort ();
+				m_bBankDump = false;
+				m_nSysEx = 0;
+			}
 			m_SerialMessage[m_nSysEx++]=uchData;
 			continue;
 		}
@@ -104,6 +115,27 @@ void CSerialMIDIDevice::Process (void)
 			MIDIMessageHandler (&uchData, 1);
 			continue;
 		}
+		else if (m_bBankDump)
+		{
+			// a bank dump is written to the voice loader as it arrives
+			if (uchData == 0xF7)
+			{
+				BankDumpData (&uchData, 1);
+				BankDumpEnd ();
+			}
+			else if ((uchData & 0x80) == 0x80)
+			{
+				BankDumpAbort ();
+			}
+			else
+			{
+				BankDumpData (&uchData, 1);
+				continue;
+			}
+			m_bBankDump = false;
+			m_nSysEx = 0;
+			continue;
+		}
 		else if(m_nSysEx > 0)
 		{
 			m_SerialMessage[m_nSysEx++]=uchData;
@@ -113,6 +145,11 @@ void CSerialMIDIDevice::Process (void)
 					MIDIMessageHandler (m_SerialMessage, m_nSysEx);
 				m_nSysEx = 0;
 			}
+			else if (   m_nSysEx == BankDumpHeaderLength
+				 && BankDumpBegin (m_SerialMessage, 0))
+			{
+				m_bBankDump = true;
+			}
 			continue;
 		}
 		else
@@ -30,7 +30,6 @@
 #include <circle/writebuffer.h>
 #include <circle/types.h>
 
-#define MAX_DX7_SYSEX_LENGTH 4104
 #define MAX_MIDI_MESSAGE MAX_DX7_SYSEX_LENGTH
 
 class CMiniDexed;
@@ -53,6 +52,7 @@ private:
 	CSerialDevice m_Serial;
 	unsigned m_nSerialState;
 	unsigned m_nSysEx;
+	bool m_bBankDump;			// SysEx in progress is streamed
 	u8 m_SerialMessage[MAX_MIDI_MESSAGE];
 
 	CWriteBufferDevice m_SendBuffer;
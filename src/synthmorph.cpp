@@ -0,0 +1,215 @@
+//
+// synthmorph.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "synthmorph.h"
+#include <stddef.h>
+#include <assert.h>
+
+CSynthMorph::CSynthMorph (void)
+:	m_nEntries (0)
+{
+}
+
+void CSynthMorph::Setup (const CSynthSnapshot &rFrom, const CSynthSnapshot &rTo)
+{
+	const u8 *pFrom = reinterpret_cast<const u8 *> (&rFrom);
+	const u8 *pTo = reinterpret_cast<const u8 *> (&rTo);
+
+	m_nEntries = 0;
+	for (unsigned nOffset = 0; nOffset < CSynthSnapshot::Size; nOffset++)
+	{
+		if (pFrom[nOffset] == pTo[nOffset])
+		{
+			continue;
+		}
+
+		TKind Kind = GetKind (nOffset);
+		if (Kind == KindFixed)
+		{
+			continue;
+		}
+
+		TEntry *pEntry = &m_Entries[m_nEntries++];
+		pEntry->nOffset = nOffset;
+		pEntry->uchValue = pFrom[nOffset];
+		pEntry->bStep = Kind == KindStep;
+
+		if (Kind == KindLinearSigned)
+		{
+			pEntry->nFrom = (s8) pFrom[nOffset];
+			pEntry->nDelta = (s8) pTo[nOffset] - pEntry->nFrom;
+		}
+		else
+		{
+			pEntry->nFrom = pFrom[nOffset];
+			pEntry->nDelta = pTo[nOffset] - pEntry->nFrom;
+		}
+	}
+}
+
+void CSynthMorph::Clear (void)
+{
+	m_nEntries = 0;
+}
+
+bool CSynthMorph::IsActive (void) const
+{
+	return m_nEntries > 0;
+}
+
+unsigned CSynthMorph::GetParameterCount (void) const
+{
+	return m_nEntries;
+}
+
+unsigned CSynthMorph::Update (unsigned nPosition)
+{
+	assert (nPosition <= MaxPosition);
+
+	unsigned nChanges = 0;
+	for (unsigned i = 0; i < m_nEntries; i++)
+	{
+		TEntry *pEntry = &m_Entries[i];
+
+		int nValue;
+		if (pEntry->bStep)
+		{
+			nValue = pEntry->nFrom + (nPosition >= MaxPosition/2 ? pEntry->nDelta : 0);
+		}
+		else
+		{
+			// rounded to the nearest value
+			int nScaled = pEntry->nDelta * (int) nPosition;
+			nValue = pEntry->nFrom + (nScaled >= 0 ?  (int) ((nScaled + MaxPosition/2) / MaxPosition)
+							       : -(int) ((-nScaled + MaxPosition/2) / MaxPosition));
+		}
+
+		u8 uchValue = (u8) nValue;
+		if (uchValue != pEntry->uchValue)
+		{
+			pEntry->uchValue = uchValue;
+
+			m_Changes[nChanges].nOffset = pEntry->nOffset;
+			m_Changes[nChanges].uchValue = uchValue;
+			nChanges++;
+		}
+	}
+
+	return nChanges;
+}
+
+const CSynthMorph::TChange *CSynthMorph::GetChanges (void) const
+{
+	return m_Changes;
+}
+
+CSynthMorph::TKind CSynthMorph::GetKind (unsigned nOffset)
+{
+	typedef CSynthSnapshot::TToneGenerator TTG;
+
+	if (nOffset < offsetof (CSynthSnapshot, TG))
+	{
+		return KindFixed;			// header
+	}
+
+	unsigned nTGOffset = nOffset - offsetof (CSynthSnapshot, TG);
+	if (nTGOffset < sizeof (TTG) * CConfig::ToneGenerators)
+	{
+		unsigned nField = nTGOffset % sizeof (TTG);
+		if (nField < CSynthSnapshot::VoiceDataSize)
+		{
+			return GetVoiceParameterKind (nField);
+		}
+
+		switch (nField)
+		{
+		case offsetof (TTG, nBankMSB):		// the voice data is morphed
+		case offsetof (TTG, nBankLSB):
+		case offsetof (TTG, nProgram):
+			return KindFixed;
+
+		case offsetof (TTG, nVolume):
+		case offsetof (TTG, nPan):
+		case offsetof (TTG, nCutoff):
+		case offsetof (TTG, nResonance):
+		case offsetof (TTG, nReverbSend):
+		case offsetof (TTG, nPortamentoTime):
+		case offsetof (TTG, nModulationWheelRange):
+		case offsetof (TTG, nFootControlRange):
+		case offsetof (TTG, nBreathControlRange):
+		case offsetof (TTG, nAftertouchRange):
+			return KindLinear;
+
+		case offsetof (TTG, nMasterTune):
+			return KindLinearSigned;
+
+		default:
+			return KindStep;
+		}
+	}
+
+	switch (nOffset)
+	{
+	case offsetof (CSynthSnapshot, bCompressorEnable):
+	case offsetof (CSynthSnapshot, bReverbEnable):
+		return KindStep;
+
+	default:
+		return KindLinear;
+	}
+}
+
+// nParameter is the offset in the voice data (unpacked format)
+CSynthMorph::TKind CSynthMorph::GetVoiceParameterKind (unsigned nParameter)
+{
+	if (nParameter < 6*21)				// operators
+	{
+		switch (nParameter % 21)
+		{
+		case 11:				// left curve
+		case 12:				// right curve
+		case 17:				// oscillator mode
+		case 18:				// frequency coarse
+			return KindStep;
+
+		default:
+			return KindLinear;
+		}
+	}
+
+	if (nParameter >= 145 && nParameter < 155)	// name
+	{
+		return KindFixed;
+	}
+
+	switch (nParameter)
+	{
+	case 134:					// algorithm
+	case 136:					// oscillator key sync
+	case 141:					// LFO key sync
+	case 142:					// LFO wave
+		return KindStep;
+
+	case 155:					// operator enable
+		return KindStep;
+
+	default:
+		return KindLinear;
+	}
+}
@@ -0,0 +1,84 @@
+//
+// synthmorph.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _synthmorph_h
+#define _synthmorph_h
+
+#include "synthsnapshot.h"
+#include <circle/types.h>
+
+// Interpolation between two snapshots of the synthesizer. Setup() compares
+// the snapshots and keeps an entry only for the parameters, which differ, so
+// that the cost of Update() depends on the number of these parameters only.
+// Continuous parameters are interpolated linearly, all other parameters
+// (e.g. algorithm, MIDI channel, controller targets) switch in the middle.
+class CSynthMorph
+{
+public:
+	static const unsigned MaxPosition = 127 << 7;	// controller value << 7
+
+	struct TChange
+	{
+		u16 nOffset;				// in CSynthSnapshot
+		u8 uchValue;
+	};
+
+public:
+	CSynthMorph (void);
+
+	void Setup (const CSynthSnapshot &rFrom, const CSynthSnapshot &rTo);	// at position 0
+	void Clear (void);
+
+	bool IsActive (void) const;
+	unsigned GetParameterCount (void) const;	// which differ
+
+	// returns the number of parameters, which have changed their value since
+	// the last call, the changes are returned by GetChanges()
+	unsigned Update (unsigned nPosition);		// 0 .. MaxPosition
+	const TChange *GetChanges (void) const;
+
+private:
+	enum TKind
+	{
+		KindFixed,				// not morphed
+		KindStep,
+		KindLinear,
+		KindLinearSigned
+	};
+
+	struct TEntry
+	{
+		u16 nOffset;
+		u8 uchValue;				// actual value
+		bool bStep;
+		int nFrom;
+		int nDelta;
+	};
+
+	static TKind GetKind (unsigned nOffset);
+	static TKind GetVoiceParameterKind (unsigned nParameter);
+
+private:
+	unsigned m_nEntries;
+	TEntry m_Entries[CSynthSnapshot::Size];
+
+	TChange m_Changes[CSynthSnapshot::Size];
+};
+
+#endif
@@ -0,0 +1,119 @@
+//
+// synthsnapshot.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "synthsnapshot.h"
+#include <string.h>
+#include <assert.h>
+
+static_assert (sizeof (CSynthSnapshot) == CSynthSnapshot::Size, "CSynthSnapshot must not have padding");
+
+static const u8 Magic[4] = {'M', 'D', 'S', 'S'};
+
+void CSynthSnapshot::SetHeader (void)
+{
+	memcpy (this->Magic, ::Magic, sizeof ::Magic);
+	nVersion = Version;
+	nToneGenerators = CConfig::ToneGenerators;
+	Reserved[0] = 0;
+	Reserved[1] = 0;
+}
+
+bool CSynthSnapshot::IsValid (void) const
+{
+	return    memcmp (this->Magic, ::Magic, sizeof ::Magic) == 0
+	       && nVersion == Version
+	       && nToneGenerators == CConfig::ToneGenerators;
+}
+
+// Each group of 7 bytes is sent as one byte with their MSBs (bit 6 for the
+// first byte), followed by the 7 bytes with the MSB cleared.
+unsigned CSynthSnapshot::ToSysEx (u8 *pBuffer) const
+{
+	assert (pBuffer);
+
+	const u8 *pData = reinterpret_cast<const u8 *> (this);
+	unsigned nSize = sizeof *this;
+
+	unsigned nLength = 0;
+	pBuffer[nLength++] = 0xF0;
+	pBuffer[nLength++] = 0x7D;		// non-commercial
+	pBuffer[nLength++] = 0x04;		// snapshot
+
+	for (unsigned i = 0; i < nSize; i += 7)
+	{
+		u8 *pMSBs = &pBuffer[nLength++];
+		*pMSBs = 0;
+
+		for (unsigned j = 0; j < 7 && i+j < nSize; j++)
+		{
+			u8 uchByte = pData[i+j];
+			*pMSBs |= (uchByte >> 7) << (6-j);
+			pBuffer[nLength++] = uchByte & 0x7F;
+		}
+	}
+
+	pBuffer[nLength++] = 0xF7;
+	assert (nLength == SysExLength);
+
+	return nLength;
+}
+
+bool CSynthSnapshot::FromSysEx (const u8 *pMessage, size_t nLength)
+{
+	assert (pMessage);
+
+	if (   nLength < 5
+	    || pMessage[0] != 0xF0
+	    || pMessage[1] != 0x7D
+	    || pMessage[2] != 0x04
+	    || pMessage[nLength-1] != 0xF7)
+	{
+		return false;
+	}
+
+	const u8 *pSysEx = &pMessage[3];
+	unsigned nSysExLength = nLength - 4;
+
+	u8 *pData = reinterpret_cast<u8 *> (this);
+	unsigned nSize = sizeof *this;
+
+	unsigned nPos = 0;
+	for (unsigned i = 0; i < nSize; i += 7)
+	{
+		if (nPos >= nSysExLength)
+		{
+			return false;
+		}
+
+		u8 uchMSBs = pSysEx[nPos++];
+
+		for (unsigned j = 0; j < 7 && i+j < nSize; j++)
+		{
+			if (nPos >= nSysExLength)
+			{
+				return false;
+			}
+
+			pData[i+j] = pSysEx[nPos++] | (((uchMSBs >> (6-j)) & 1) << 7);
+		}
+	}
+
+	return    nPos == nSysExLength
+	       && IsValid ();
+}
@@ -0,0 +1,98 @@
+//
+// synthsnapshot.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _synthsnapshot_h
+#define _synthsnapshot_h
+
+#include "config.h"
+#include <circle/types.h>
+#include <stddef.h>
+
+// State of the whole synthesizer (voices, TG settings and effects) in a fixed
+// binary layout. It is produced and restored by CMiniDexed without parsing,
+// can be kept in RAM (e.g. for A/B compare or undo) and sent as SysEx. All
+// fields are bytes, so that the layout has no padding and does not depend on
+// the byte order.
+class CSynthSnapshot
+{
+public:
+	static const u8 Version = 1;
+	static const unsigned VoiceDataSize = 156;		// unpacked format
+
+	struct TToneGenerator
+	{
+		u8 VoiceData[VoiceDataSize];
+		u8 nBankMSB;
+		u8 nBankLSB;
+		u8 nProgram;
+		u8 nMIDIChannel;
+		u8 nVolume;
+		u8 nPan;
+		s8 nMasterTune;
+		u8 nCutoff;
+		u8 nResonance;
+		u8 nNoteLimitLow;
+		u8 nNoteLimitHigh;
+		s8 nNoteShift;
+		u8 nReverbSend;
+		u8 nPitchBendRange;
+		u8 nPitchBendStep;
+		u8 nPortamentoMode;
+		u8 nPortamentoGlissando;
+		u8 nPortamentoTime;
+		u8 bMonoMode;
+		u8 nModulationWheelRange;
+		u8 nModulationWheelTarget;
+		u8 nFootControlRange;
+		u8 nFootControlTarget;
+		u8 nBreathControlRange;
+		u8 nBreathControlTarget;
+		u8 nAftertouchRange;
+		u8 nAftertouchTarget;
+	};
+
+public:
+	void SetHeader (void);
+	bool IsValid (void) const;				// checks the header
+
+	// SysEx: F0 7D 04 <snapshot, 7 bytes in 8 bytes each> F7
+	static const unsigned Size = 8 + sizeof (TToneGenerator) * CConfig::ToneGenerators + 8;
+	static const unsigned SysExLength = 4 + Size + (Size + 6) / 7;
+	unsigned ToSysEx (u8 *pBuffer) const;			// pBuffer: SysExLength bytes
+	bool FromSysEx (const u8 *pMessage, size_t nLength);
+
+public:
+	u8 Magic[4];			// "MDSS"
+	u8 nVersion;
+	u8 nToneGenerators;
+	u8 Reserved[2];
+
+	TToneGenerator TG[CConfig::ToneGenerators];
+
+	u8 bCompressorEnable;
+	u8 bReverbEnable;
+	u8 nReverbSize;
+	u8 nReverbHighDamp;
+	u8 nReverbLowDamp;
+	u8 nReverbLowPass;
+	u8 nReverbDiffusion;
+	u8 nReverbLevel;
+};
+
+#endif
@@ -19,12 +19,13 @@
 //
 #include "sysexfileloader.h"
 #include <stdio.h>
-#include <dirent.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <assert.h>
+#include <algorithm>
 #include <circle/logger.h>
+#include <circle/synchronize.h>
 #include "voices.c"
 
 LOGMODULE ("syxfile");
@@ -62,309 +63,1332 @@ uint8_t CSysExFileLoader::s_DefaultVoice[SizeSingleVoice] =	// INIT VOICE
 };
 
 CSysExFileLoader::CSysExFileLoader (const char *pDirName)
-:	m_DirName (pDirName)
+:	m_DirName (pDirName),
+	m_bHeaderlessSysExVoices (false),
+	m_nLookupHint (0),
+	m_LoadState (LoadStateIdle),
+	m_bLoading (false),
+	m_nCacheClock (0),
+	m_nDuplicateBanks (0),
+	m_nVoiceCacheHits (0),
+	m_nVoiceCacheMisses (0),
+	m_nLastStatsTicks (0),
+	m_nNameScanPos (0),
+	m_nReceiveBytes (0),
+	m_uchReceiveSum (0),
+	m_bReceiveError (false),
+	m_bReceiving (false),
+	m_nSaveBankID (-1),
+	m_pSaveFile (nullptr),
+	m_nSaveOffset (0)
 {
 	m_DirName += "/voice";
-	m_nNumHighestBank = 0;
 
-	for (unsigned i = 0; i <= MaxVoiceBankID; i++)
+	m_BankIndex.reserve (1);
+
+	assert (sizeof(TVoiceBank) == VoiceSysExHdrSize + VoiceSysExSize);
+
+	m_pCacheBank = new TVoiceBank[MaxCachedBanks];
+	assert (m_pCacheBank);
+
+	for (unsigned i = 0; i < MaxCachedBanks; i++)
+	{
+		m_nCacheBankID[i] = -1;
+		m_nCacheBankHash[i] = 0;
+		m_nCacheLastUsed[i] = 0;
+	}
+
+	InvalidateVoiceCache ();
+
+	m_pReadBank = new TVoiceBank;
+	assert (m_pReadBank);
+
+	for (unsigned i = 0; i < MaxBankRequests; i++)
+	{
+		m_nBankRequest[i] = -1;
+	}
+
+	m_nPrefetchBank[0] = -1;
+	m_nPrefetchBank[1] = -1;
+
+	// allocated here, because bulk dumps may be received from interrupt context
+	m_pReceiveBank = new TVoiceBank;
+	assert (m_pReceiveBank);
+}
+
+CSysExFileLoader::~CSysExFileLoader (void)
+{
+	if (m_pSaveFile)
+	{
+		fclose (m_pSaveFile);
+	}
+
+	delete [] m_pCacheBank;
+	delete m_pReadBank;
+	delete m_pReceiveBank;
+}
+
+void CSysExFileLoader::Load (bool bHeaderlessSysExVoices)
+{
+	LoadStart (bHeaderlessSysExVoices);
+
+	while (!LoadStep ())
+	{
+		// just continue
+	}
+}
+
+void CSysExFileLoader::LoadStart (bool bHeaderlessSysExVoices)
+{
+	assert (m_LoadState == LoadStateIdle);
+
+	m_bHeaderlessSysExVoices = bHeaderlessSysExVoices;
+
+	// BankDumpStart() sets m_bReceiving first and tests m_bLoading then,
+	// so that one of both sides sees the other one
+	__atomic_store_n (&m_bLoading, true, __ATOMIC_SEQ_CST);
+
+	m_LoadState = LoadStateWaitReceiver;
+}
+
+bool CSysExFileLoader::LoadStep (void)
+{
+	switch (m_LoadState)
+	{
+	case LoadStateWaitReceiver:
+		// the received bank is an entry of the current index, which is dropped
+		if (__atomic_load_n (&m_bReceiving, __ATOMIC_SEQ_CST))
+		{
+			break;
+		}
+
+		if (m_nSaveBankID >= 0)
+		{
+			SaveBankStep ();
+
+			break;
+		}
+
+		// The new index is built aside and published at once at the end,
+		// because GetVoice() may be called from interrupt context meanwhile.
+		m_LoadIndex.clear ();
+		m_LoadNamePool.clear ();
+
+		if (LoadPack (&m_LoadIndex, &m_LoadNamePool))
+		{
+			m_LoadState = LoadStatePublish;
+		}
+		else
+		{
+			std::string DirName ("SD:");
+			DirName += m_DirName;
+
+			if (m_DirIndex.ScanStart (DirName.c_str (), GetIndexCacheName ().c_str ()))
+			{
+				m_LoadState = LoadStateScan;
+			}
+			else
+			{
+				LOGWARN ("Directory %s not found", m_DirName.c_str ());
+
+				m_LoadState = LoadStatePublish;
+			}
+		}
+		break;
+
+	case LoadStateScan:
+		if (m_DirIndex.ScanStep ())
+		{
+			AddScannedFiles (&m_LoadIndex, &m_LoadNamePool);
+			m_DirIndex.Clear ();
+
+			m_LoadState = LoadStatePublish;
+		}
+		break;
+
+	case LoadStatePublish:
+		PublishIndex ();
+
+		m_LoadState = LoadStateIdle;
+		__atomic_store_n (&m_bLoading, false, __ATOMIC_RELEASE);
+
+		return true;
+
+	default:
+		assert (0);
+		break;
+	}
+
+	return false;
+}
+
+void CSysExFileLoader::PublishIndex (void)
+{
+	m_VoiceNames.Clear ();
+	m_nNameScanPos = 0;
+	m_BankHashes.clear ();
+	m_VoiceHashes.clear ();
+	m_nDuplicateBanks = 0;
+
+	m_LoadIndex.reserve (m_LoadIndex.size ()+1);	// room for a bank bulk dump
+
+	// the bank IDs may refer to other files now
+	m_SpinLock.Acquire ();
+	m_BankIndex.swap (m_LoadIndex);
+	m_NamePool.swap (m_LoadNamePool);
+	m_nLookupHint = 0;
+	InvalidateVoiceCache ();
+	m_SpinLock.Release ();
+
+	m_LoadIndex.clear ();
+	m_LoadIndex.shrink_to_fit ();
+	m_LoadNamePool.clear ();
+	m_LoadNamePool.shrink_to_fit ();
+
+	LOGDBG ("%u Banks found. Highest Bank found: #%u", (unsigned) m_BankIndex.size (), GetNumHighestBank ()+1);
+}
+
+void CSysExFileLoader::AddScannedFiles (std::vector<TBankIndexEntry> *pBankIndex, std::string *pNamePool)
+{
+	assert (pBankIndex);
+	assert (pNamePool);
+	std::vector<TBankIndexEntry> &rBankIndex = *pBankIndex;
+
+	// The file format is only checked on first use in ReadBank().
+	rBankIndex.reserve (m_DirIndex.GetFileCount ()+1);
+	for (unsigned i = 0; i < m_DirIndex.GetFileCount (); i++)
+	{
+		const CVoiceDirIndex::TFile &rFile = m_DirIndex.GetFile (i);
+
+		TBankIndexEntry Entry;
+		Entry.nBankID = rFile.nBankID;
+		Entry.nNameOffset = AddName (rFile.Path.c_str (), pNamePool);
+		Entry.pBank = nullptr;
+		Entry.nPackOffset = 0;
+		Entry.nDuplicateOf = BankNotRead;
+
+		rBankIndex.push_back (Entry);
+	}
+
+	// The directory order is arbitrary, sort by bank ID and drop duplicates.
+	// Stable sorting keeps the bank, which has been found first.
+	std::stable_sort (rBankIndex.begin (), rBankIndex.end (),
+			  [] (const TBankIndexEntry &rA, const TBankIndexEntry &rB)
+			  { return rA.nBankID < rB.nBankID; });
+
+	unsigned nBanks = 0;
+	for (unsigned i = 0; i < rBankIndex.size (); i++)
+	{
+		if (   nBanks > 0
+		    && rBankIndex[i].nBankID == rBankIndex[nBanks-1].nBankID)
+		{
+			LOGWARN ("Bank #%u already loaded", rBankIndex[i].nBankID+1);
+
+			continue;
+		}
+
+		rBankIndex[nBanks++] = rBankIndex[i];
+	}
+	rBankIndex.resize (nBanks);
+
+	// room for a bank bulk dump
+	rBankIndex.reserve (nBanks+1);
+}
+
+// uses the voice pack instead of the directory scan, if it is up to date
+bool CSysExFileLoader::LoadPack (std::vector<TBankIndexEntry> *pBankIndex, std::string *pNamePool)
+{
+	assert (pBankIndex);
+	assert (pNamePool);
+
+	std::string DirName ("SD:");
+	DirName += m_DirName;
+
+	std::string PackName (DirName);
+	PackName += ".pack";
+
+	if (!m_VoicePack.Open (PackName.c_str (), DirName.c_str ()))
+	{
+		return false;
+	}
+
+	// the pack index is sorted already
+	unsigned nBanks = m_VoicePack.GetBankCount ();
+	pBankIndex->reserve (nBanks+1);		// room for a bank bulk dump
+
+	for (unsigned i = 0; i < nBanks; i++)
+	{
+		TBankIndexEntry Entry;
+		Entry.nBankID = m_VoicePack.GetBankID (i);
+		Entry.nNameOffset = AddName (m_VoicePack.GetBankFileName (i), pNamePool);
+		Entry.pBank = nullptr;
+		Entry.nPackOffset = m_VoicePack.GetBankOffset (i);
+		Entry.nDuplicateOf = BankNotRead;
+
+		pBankIndex->push_back (Entry);
+	}
+
+	LOGDBG ("Using %s", PackName.c_str ());
+
+	return true;
+}
+
+std::string CSysExFileLoader::GetIndexCacheName (void) const
+{
+	// not in the voice directory, so that writing it does not change the directory
+	std::string Result ("SD:");
+	Result += m_DirName;
+	Result += ".index";
+
+	return Result;
+}
+
+bool CSysExFileLoader::ReadBank (unsigned nBankID)
+{
+	m_SpinLock.Acquire ();
+	int nIndex = FindBank (nBankID);
+	m_SpinLock.Release ();
+
+	if (nIndex < 0)
+	{
+		return false;
+	}
+
+	// the position is still valid, only the main loop removes entries
+	assert (!m_BankIndex[nIndex].pBank);
+
+	// a known duplicate of a cached bank is not read again
+	TVoiceBank *pBank = nullptr;
+	unsigned nOriginalID = m_BankIndex[nIndex].nDuplicateOf;
+	if (nOriginalID <= MaxVoiceBankID)
+	{
+		pBank = GetBank (nOriginalID);
+	}
+
+	if (!pBank)
+	{
+		if (!ReadBankData (nIndex, m_pReadBank))
+		{
+			return false;
+		}
+
+		uint64_t nHash = Hash (m_pReadBank->Voice, VoiceSysExSize);
+		RegisterBank (nIndex, m_pReadBank, nHash);
+
+		pBank = FindCachedBank (nHash, m_pReadBank);
+		if (!pBank)
+		{
+			unsigned nSlot = AllocCacheSlot ();
+			pBank = &m_pCacheBank[nSlot];
+			memcpy (pBank, m_pReadBank, sizeof (TVoiceBank));
+
+			m_nCacheBankID[nSlot] = nBankID;
+			m_nCacheBankHash[nSlot] = nHash;
+		}
+	}
+
+	m_SpinLock.Acquire ();
+	TouchCachedBank (pBank);
+	m_BankIndex[nIndex].pBank = pBank;
+	m_SpinLock.Release ();
+
+	LOGDBG ("Bank #%u loaded", nBankID+1);
+
+	return true;
+}
+
+bool CSysExFileLoader::ReadBankData (unsigned nIndex, TVoiceBank *pBank)
+{
+	assert (nIndex < m_BankIndex.size ());
+	assert (pBank);
+
+	std::string Filename (m_DirName);
+	Filename += "/";
+	Filename += GetBankFileName (nIndex);
+
+	bool bBankLoaded;
+	uint32_t nPackOffset = m_BankIndex[nIndex].nPackOffset;
+	if (nPackOffset != 0)
+	{
+		// packsysex.py has already validated the bank
+		bBankLoaded =    m_VoicePack.ReadBank (nPackOffset, pBank)
+			      && pBank->StatusStart == 0xF0
+			      && pBank->StatusEnd   == 0xF7;
+	}
+	else
+	{
+		bBankLoaded = ReadBankFile (Filename.c_str (), pBank);
+	}
+
+	if (!bBankLoaded)
+	{
+		LOGWARN ("%s: Invalid size or format", Filename.c_str ());
+
+		// do not try again
+		RemoveBank (nIndex);
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CSysExFileLoader::ReadBankFile (const char *pFileName, TVoiceBank *pBank)
+{
+	FILE *pFile = fopen (pFileName, "rb");
+	if (!pFile)
+	{
+		return false;
+	}
+
+	bool bBankLoaded = false;
+	if (   fread (pBank, VoiceSysExHdrSize+VoiceSysExSize, 1, pFile) == 1
+		&& pBank->StatusStart == 0xF0
+		&& pBank->CompanyID   == 0x43
+		&& pBank->Format      == 0x09
+		&& pBank->StatusEnd   == 0xF7)
+	{
+		bBankLoaded = true;
+	}
+	else if (m_bHeaderlessSysExVoices)
+	{
+		// Config says to accept headerless SysEx Voice Banks
+		// so reset file pointer and try again.
+		fseek (pFile, 0, SEEK_SET);
+		if (fread (pBank->Voice, VoiceSysExSize, 1, pFile) == 1)
+		{
+			// Add in the missing header items.
+			// Naturally it isn't possible to validate these!
+			pBank->StatusStart = 0xF0;
+			pBank->CompanyID   = 0x43;
+			pBank->Format      = 0x09;
+			pBank->ByteCountMS = 0x20;
+			pBank->ByteCountLS = 0x00;
+			pBank->Checksum    = 0x00;
+			pBank->StatusEnd   = 0xF7;
+
+			bBankLoaded = true;
+		}
+	}
+
+	fclose (pFile);
+
+	return bBankLoaded;
+}
+
+unsigned CSysExFileLoader::AllocCacheSlot (void)
+{
+	// m_nCacheLastUsed may be updated from GetVoice() meanwhile, this does not matter
+	unsigned nSlot = 0;
+	for (unsigned i = 0; i < MaxCachedBanks; i++)
+	{
+		if (m_nCacheBankID[i] < 0)
+		{
+			return i;
+		}
+
+		if (m_nCacheLastUsed[i] < m_nCacheLastUsed[nSlot])
+		{
+			nSlot = i;
+		}
+	}
+
+	// The bank is unpublished before its slot is overwritten. GetVoice() reads
+	// the bank with m_SpinLock held, so nobody uses the slot afterwards.
+	// Identical banks share the slot, so all entries have to be checked.
+	TVoiceBank *pBank = &m_pCacheBank[nSlot];
+
+	m_SpinLock.Acquire ();
+
+	for (TBankIndexEntry &rEntry : m_BankIndex)
+	{
+		if (rEntry.pBank == pBank)
+		{
+			rEntry.pBank = nullptr;
+		}
+	}
+	m_nCacheBankID[nSlot] = -1;
+
+	m_SpinLock.Release ();
+
+	return nSlot;
+}
+
+CSysExFileLoader::TVoiceBank *CSysExFileLoader::FindCachedBank (uint64_t nHash, const TVoiceBank *pBank)
+{
+	for (unsigned i = 0; i < MaxCachedBanks; i++)
+	{
+		if (   m_nCacheBankID[i] >= 0
+		    && m_nCacheBankHash[i] == nHash
+		    && memcmp (m_pCacheBank[i].Voice, pBank->Voice, VoiceSysExSize) == 0)
+		{
+			return &m_pCacheBank[i];
+		}
+	}
+
+	return nullptr;
+}
+
+// m_SpinLock must be held
+void CSysExFileLoader::TouchCachedBank (const TVoiceBank *pBank)
+{
+	if (   pBank >= m_pCacheBank
+	    && pBank < m_pCacheBank + MaxCachedBanks)
+	{
+		m_nCacheLastUsed[pBank - m_pCacheBank] = ++m_nCacheClock;
+	}
+}
+
+void CSysExFileLoader::RegisterBank (unsigned nIndex, const TVoiceBank *pBank, uint64_t nHash)
+{
+	assert (nIndex < m_BankIndex.size ());
+	TBankIndexEntry &rEntry = m_BankIndex[nIndex];
+	if (rEntry.nDuplicateOf != BankNotRead)
+	{
+		return;
+	}
+
+	auto Iterator = m_BankHashes.find (nHash);
+	if (   Iterator != m_BankHashes.end ()
+	    && Iterator->second != rEntry.nBankID)
+	{
+		// the voices can be found in the original bank already
+		rEntry.nDuplicateOf = Iterator->second;
+		m_nDuplicateBanks++;
+
+		LOGNOTE ("Bank #%u is identical to bank #%u", rEntry.nBankID+1, Iterator->second+1);
+
+		return;
+	}
+
+	m_BankHashes[nHash] = rEntry.nBankID;
+	rEntry.nDuplicateOf = BankUnique;
+
+	m_VoiceNames.AddBank (rEntry.nBankID, pBank->Voice[0]);
+
+	for (unsigned i = 0; i < VoicesPerBank; i++)
+	{
+		m_VoiceHashes.push_back (Hash (pBank->Voice[i], SizePackedVoice));
+	}
+}
+
+void CSysExFileLoader::ReportDuplicates (void)
+{
+	std::sort (m_VoiceHashes.begin (), m_VoiceHashes.end ());
+
+	unsigned nDuplicateVoices = 0;
+	for (unsigned i = 1; i < m_VoiceHashes.size (); i++)
+	{
+		if (m_VoiceHashes[i] == m_VoiceHashes[i-1])
+		{
+			nDuplicateVoices++;
+		}
+	}
+
+	LOGNOTE ("%u banks indexed, %u identical banks, %u duplicate voices in other banks",
+		 m_VoiceNames.GetBankCount () + m_nDuplicateBanks, m_nDuplicateBanks, nDuplicateVoices);
+
+	std::vector<uint64_t> ().swap (m_VoiceHashes);		// free memory
+}
+
+std::string CSysExFileLoader::GetBankName (unsigned nBankID)
+{
+	m_SpinLock.Acquire ();
+	int nIndex = FindBank (nBankID);
+	m_SpinLock.Release ();
+
+	if (nIndex >= 0)
+	{
+		// the name pool is accessed from the main loop only
+		std::string Result = GetBankFileName (nIndex);
+
+		size_t nPos = Result.rfind ('/');
+		if (nPos != std::string::npos)
+		{
+			Result.erase (0, nPos+1);	// remove subdirectory
+		}
+
+		size_t nLen = Result.length ();
+		if (nLen > 4)
+		{
+			Result.resize (nLen-4);		// remove file extension
+
+			unsigned nBank;
+			char BankName[30+1];
+			if (sscanf (Result.c_str (), "%u_%30s", &nBank, BankName) == 2)
+			{
+				Result = BankName;
+
+				return Result;
+			}
+		}
+	}
+
+	return "NO NAME";
+}
+
+unsigned CSysExFileLoader::GetNextBankUp (unsigned nBankID)
+{
+	// Find the next loaded bank "up" from the provided bank ID
+	m_SpinLock.Acquire ();
+
+	unsigned nSize = m_BankIndex.size ();
+	if (nSize == 0)
+	{
+		m_SpinLock.Release ();
+
+		// If we get here there are no banks!
+		return nBankID;
+	}
+
+	unsigned nPos = LowerBound (nBankID);
+	if (   nPos < nSize
+	    && m_BankIndex[nPos].nBankID == nBankID)
+	{
+		nPos++;
+	}
+
+	// Handle wrap-around
+	if (nPos >= nSize)
+	{
+		nPos = 0;
+	}
+
+	m_nLookupHint = nPos;
+	unsigned nResult = m_BankIndex[nPos].nBankID;
+
+	m_SpinLock.Release ();
+
+	return nResult;
+}
+
+unsigned CSysExFileLoader::GetNextBankDown (unsigned nBankID)
+{
+	// Find the next loaded bank "down" from the provided bank ID
+	m_SpinLock.Acquire ();
+
+	unsigned nSize = m_BankIndex.size ();
+	if (nSize == 0)
+	{
+		m_SpinLock.Release ();
+
+		// If we get here there are no banks!
+		return nBankID;
+	}
+
+	unsigned nPos = LowerBound (nBankID);
+
+	// Handle wrap-around
+	if (nPos == 0)
+	{
+		nPos = nSize;
+	}
+	nPos--;
+
+	m_nLookupHint = nPos;
+	unsigned nResult = m_BankIndex[nPos].nBankID;
+
+	m_SpinLock.Release ();
+
+	return nResult;
+}
+
+bool CSysExFileLoader::IsValidBank (unsigned nBankID)
+{
+	m_SpinLock.Acquire ();
+	bool bResult = FindBank (nBankID) >= 0;
+	m_SpinLock.Release ();
+
+	return bResult;
+}
+
+unsigned CSysExFileLoader::GetNumHighestBank (void)
+{
+	m_SpinLock.Acquire ();
+	unsigned nResult = m_BankIndex.empty () ? 0 : m_BankIndex.back ().nBankID;
+	m_SpinLock.Release ();
+
+	return nResult;
+}
+
+void CSysExFileLoader::RequestBank (unsigned nBankID)
+{
+	m_SpinLock.Acquire ();
+	int nIndex = FindBank (nBankID);
+	bool bRequired = nIndex >= 0 && !m_BankIndex[nIndex].pBank;
+	m_SpinLock.Release ();
+
+	if (!bRequired)
+	{
+		return;
+	}
+
+	for (unsigned i = 0; i < MaxBankRequests; i++)
+	{
+		if (m_nBankRequest[i] == (int) nBankID)
+		{
+			return;		// already pending
+		}
+	}
+
+	for (unsigned i = 0; i < MaxBankRequests; i++)
+	{
+		int nExpected = -1;
+		if (__atomic_compare_exchange_n (&m_nBankRequest[i], &nExpected, (int) nBankID, false,
+						 __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		{
+			return;
+		}
+	}
+
+	// all slots busy, the caller will request again
+}
+
+bool CSysExFileLoader::GetVoice (unsigned nBankID, unsigned nVoiceID, uint8_t *pVoiceData)
+{
+	if (   nBankID <= MaxVoiceBankID
+	    && nVoiceID < VoicesPerBank)
+	{
+		// The bank is read with m_SpinLock held, so that its cache slot
+		// cannot be reused meanwhile.
+		m_SpinLock.Acquire ();
+
+		// The contents of a bank ID do not change, so a decoded voice
+		// is still valid, after its bank has been evicted.
+		unsigned nKey = nBankID * VoicesPerBank + nVoiceID;
+		bool bFound = LookupVoice (nKey, pVoiceData);
+		if (!bFound)
+		{
+			TVoiceBank *pBank = GetCachedBank (nBankID);
+			if (pBank)
+			{
+				TouchCachedBank (pBank);
+
+				const uint8_t *pPackedData = pBank->Voice[nVoiceID];
+				uint32_t nHash = (uint32_t) Hash (pPackedData, SizePackedVoice);
+				if (!LookupVoiceData (nKey, pPackedData, nHash, pVoiceData))
+				{
+					DecodePackedVoice (pPackedData, pVoiceData);
+
+					StoreVoice (nKey, pPackedData, nHash, pVoiceData);
+					m_nVoiceCacheMisses++;
+				}
+				else
+				{
+					m_nVoiceCacheHits++;
+				}
+
+				bFound = true;
+			}
+		}
+		else
+		{
+			m_nVoiceCacheHits++;
+		}
+
+		bool bValidBank = bFound || FindBank (nBankID) >= 0;
+
+		m_SpinLock.Release ();
+
+		if (bFound)
+		{
+			return true;
+		}
+		else if (bValidBank)
+		{
+			RequestBank (nBankID);
+
+			return false;
+		}
+		else
+		{
+			// Use default voices_bank instead of s_DefaultVoice for bank 0,
+			// if the bank was not successfully loaded from disk.
+			if (nBankID == 0)
+			{
+				memcpy (pVoiceData, voices_bank[0][nVoiceID], SizeSingleVoice);
+
+				return true;
+			}
+		}
+	}
+
+	memcpy (pVoiceData, s_DefaultVoice, SizeSingleVoice);
+
+	return true;
+}
+
+bool CSysExFileLoader::BankDumpStart (void)
+{
+	// the receive bank is in use, until the last dump was saved
+	if (   m_nSaveBankID >= 0
+	    || __atomic_exchange_n (&m_bReceiving, true, __ATOMIC_SEQ_CST))
+	{
+		return false;
+	}
+
+	// the bank would be dropped with the old index by LoadStep()
+	if (__atomic_load_n (&m_bLoading, __ATOMIC_SEQ_CST))
 	{
-		m_pVoiceBank[i] = nullptr;
+		__atomic_store_n (&m_bReceiving, false, __ATOMIC_RELEASE);
+
+		return false;
 	}
+
+	m_nReceiveBytes = 0;
+	m_uchReceiveSum = 0;
+	m_bReceiveError = false;
+
+	return true;
 }
 
-CSysExFileLoader::~CSysExFileLoader (void)
+bool CSysExFileLoader::BankDumpWrite (const uint8_t *pData, size_t nLength)
 {
-	for (unsigned i = 0; i <= MaxVoiceBankID; i++)
+	assert (m_pReceiveBank);
+	uint8_t *pBank = reinterpret_cast<uint8_t *> (m_pReceiveBank);
+
+	for (size_t i = 0; i < nLength && !m_bReceiveError; i++)
 	{
-		delete m_pVoiceBank[i];
+		unsigned nPos = m_nReceiveBytes++;
+		if (nPos >= VoiceSysExHdrSize+VoiceSysExSize)
+		{
+			m_bReceiveError = true;
+
+			break;
+		}
+
+		uint8_t uchData = pData[i];
+		pBank[nPos] = uchData;
+
+		// the 4096 voice data bytes follow the 6 byte header
+		if (   nPos >= VoiceSysExHdrSize-2
+		    && nPos < VoiceSysExHdrSize-2 + VoiceSysExSize)
+		{
+			if (uchData & 0x80)
+			{
+				m_bReceiveError = true;
+			}
+
+			m_uchReceiveSum += uchData;
+		}
 	}
+
+	return !m_bReceiveError;
 }
 
-void CSysExFileLoader::Load (bool bHeaderlessSysExVoices)
+int CSysExFileLoader::BankDumpEnd (void)
+{
+	assert (m_bReceiving);
+
+	int nBankID = AddReceivedBank ();
+
+	// if the bank was added, m_nSaveBankID keeps the receive bank busy
+	__atomic_store_n (&m_bReceiving, false, __ATOMIC_RELEASE);
+
+	return nBankID;
+}
+
+void CSysExFileLoader::BankDumpAbort (void)
+{
+	assert (m_bReceiving);
+
+	__atomic_store_n (&m_bReceiving, false, __ATOMIC_RELEASE);
+}
+
+int CSysExFileLoader::AddReceivedBank (void)
 {
-	m_nNumHighestBank = 0;
-	m_nBanksLoaded = 0;
+	assert (m_pReceiveBank);
 
-    DIR *pDirectory = opendir (m_DirName.c_str ());
-	if (!pDirectory)
+	if (   m_bReceiveError
+	    || m_nReceiveBytes != VoiceSysExHdrSize+VoiceSysExSize
+	    || m_pReceiveBank->StatusStart != 0xF0
+	    || m_pReceiveBank->CompanyID   != 0x43
+	    || m_pReceiveBank->Format      != 0x09
+	    || m_pReceiveBank->ByteCountMS != 0x20
+	    || m_pReceiveBank->ByteCountLS != 0x00
+	    || m_pReceiveBank->StatusEnd   != 0xF7)
 	{
-		LOGWARN ("Directory %s not found", m_DirName.c_str ());
+		return -1;
+	}
 
-		return;
+	if (((m_uchReceiveSum + m_pReceiveBank->Checksum) & 0x7F) != 0)
+	{
+		LOGWARN ("Bank bulk dump: Checksum error");
+
+		return -1;
 	}
 
-	dirent *pEntry;
-	while ((pEntry = readdir (pDirectory)) != nullptr)
+	m_SpinLock.Acquire ();
+
+	// appending keeps the index sorted
+	unsigned nBankID = m_BankIndex.empty () ? 1 : m_BankIndex.back ().nBankID+1;
+	if (   nBankID > MaxVoiceBankID
+	    || m_BankIndex.size () >= m_BankIndex.capacity ())
 	{
-		LoadBank(m_DirName.c_str (), pEntry->d_name, bHeaderlessSysExVoices, 0);
+		m_SpinLock.Release ();
+
+		LOGWARN ("Bank bulk dump: No free bank");
+
+		return -1;
 	}
-	LOGDBG ("%u Banks loaded. Highest Bank loaded: #%u", m_nBanksLoaded, m_nNumHighestBank+1);
 
-	closedir (pDirectory);
+	// The bank can be used from now on, the file name is assigned and
+	// the file is written from Process(), when it is safe to access SD.
+	// Afterwards the bank is copied into the cache.
+	TBankIndexEntry Entry;
+	Entry.nBankID = nBankID;
+	Entry.nNameOffset = NoName;
+	Entry.pBank = m_pReceiveBank;
+	Entry.nPackOffset = 0;
+	Entry.nDuplicateOf = BankNotRead;
+
+	m_BankIndex.push_back (Entry);		// does not allocate
+
+	m_nSaveBankID = nBankID;
+
+	m_SpinLock.Release ();
+
+	return nBankID;
 }
 
-void CSysExFileLoader::LoadBank (const char * sDirName, const char * sBankName, bool bHeaderlessSysExVoices, unsigned nSubDirCount)
+void CSysExFileLoader::Process (void)
 {
-	unsigned nBank;
-	size_t nLen = strlen (sBankName);
-	
-	if (   nLen < 5						// "[NNNN]N[_name].syx"
-		|| strcasecmp (&sBankName[nLen-4], ".syx") != 0
-		|| sscanf (sBankName, "%u", &nBank) != 1)
+	// do one step per call only, to keep the main loop responsive
+	if (m_nSaveBankID >= 0)
 	{
-		// See if this is a subdirectory...
-		std::string Dirname (sDirName);
-		Dirname += "/";
-		Dirname += sBankName;
+		SaveBankStep ();
 
-		DIR *pDirectory = opendir (Dirname.c_str ());
-		if (pDirectory)
-		{
-			if (nSubDirCount >= MaxSubDirs)
-			{
-				LOGWARN ("Too many nested subdirectories: %s", sBankName);
-				return;
-			}
-	
-			LOGDBG ("Processing subdirectory %s", sBankName);
+		return;
+	}
 
-			dirent *pEntry;
-			while ((pEntry = readdir (pDirectory)) != nullptr)
-			{
-				LoadBank(Dirname.c_str (), pEntry->d_name, bHeaderlessSysExVoices, nSubDirCount+1);
-			}
-			closedir (pDirectory);
+	for (unsigned i = 0; i < MaxBankRequests; i++)
+	{
+		int nBankID = __atomic_load_n (&m_nBankRequest[i], __ATOMIC_ACQUIRE);
+		if (nBankID < 0)
+		{
+			continue;
 		}
-		else
+
+		if (   !GetBank (nBankID)
+		    && ReadBank (nBankID))
 		{
-			LOGWARN ("%s: Invalid filename format", sBankName);
+			// the neighbours will probably be selected next
+			m_nPrefetchBank[0] = GetNextBankUp (nBankID);
+			m_nPrefetchBank[1] = GetNextBankDown (nBankID);
 		}
 
+		__atomic_store_n (&m_nBankRequest[i], -1, __ATOMIC_RELEASE);
+
 		return;
 	}
-	
-	// File and UI handling requires banks to be 1..indexed.
-	// Internally (and via MIDI) we need 0..indexed.
-	// Any mention of a BankID internally is assumed to be 0..indexed.
-	unsigned nBankIdx = nBank - 1;
 
-	// BankIdx goes from 0 to MaxVoiceBankID inclusive
-	if (nBankIdx > MaxVoiceBankID)
+	for (unsigned i = 0; i < 2; i++)
 	{
-		LOGWARN ("Bank #%u is not supported", nBank);
+		int nBankID = m_nPrefetchBank[i];
+		if (nBankID < 0)
+		{
+			continue;
+		}
 
-		return;
+		m_nPrefetchBank[i] = -1;
+
+		if (!GetBank (nBankID))
+		{
+			ReadBank (nBankID);
+
+			return;
+		}
 	}
 
-	if (m_pVoiceBank[nBankIdx])
+	IndexNamesStep ();
+}
+
+void CSysExFileLoader::LoadRequestedBanks (void)
+{
+	assert (m_nSaveBankID < 0);
+
+	for (unsigned i = 0; i < MaxBankRequests; i++)
 	{
-		LOGWARN ("Bank #%u already loaded", nBank);
+		int nBankID = __atomic_load_n (&m_nBankRequest[i], __ATOMIC_ACQUIRE);
+		if (nBankID < 0)
+		{
+			continue;
+		}
 
-		return;
-	}
+		if (!GetBank (nBankID))
+		{
+			ReadBank (nBankID);
+		}
 
-	m_pVoiceBank[nBankIdx] = new TVoiceBank;
-	assert (m_pVoiceBank[nBankIdx]);
-	assert (sizeof(TVoiceBank) == VoiceSysExHdrSize + VoiceSysExSize);
+		__atomic_store_n (&m_nBankRequest[i], -1, __ATOMIC_RELEASE);
+	}
+}
 
-	std::string Filename (sDirName);
-	Filename += "/";
-	Filename += sBankName;
+unsigned CSysExFileLoader::FindVoices (const char *pQuery, bool bPrefix,
+				       CVoiceNameIndex::TMatch *pMatches, unsigned nMaxMatches) const
+{
+	return m_VoiceNames.Find (pQuery, bPrefix, pMatches, nMaxMatches);
+}
 
-	FILE *pFile = fopen (Filename.c_str (), "rb");
-	if (pFile)
+// collects the voice names of one bank, which has not been read yet
+void CSysExFileLoader::IndexNamesStep (void)
+{
+	while (m_nNameScanPos < m_BankIndex.size ())
 	{
-		bool bBankLoaded = false;
-		if (   fread (m_pVoiceBank[nBankIdx], VoiceSysExHdrSize+VoiceSysExSize, 1, pFile) == 1
-			&& m_pVoiceBank[nBankIdx]->StatusStart == 0xF0
-			&& m_pVoiceBank[nBankIdx]->CompanyID   == 0x43
-			&& m_pVoiceBank[nBankIdx]->Format      == 0x09
-			&& m_pVoiceBank[nBankIdx]->StatusEnd   == 0xF7)
+		unsigned nIndex = m_nNameScanPos++;
+		if (m_BankIndex[nIndex].nDuplicateOf != BankNotRead)
 		{
-			if (m_nBanksLoaded % 100 == 0)
-			{
-				LOGDBG ("Banks successfully loaded #%u", m_nBanksLoaded);
-			}
-			//LOGDBG ("Bank #%u successfully loaded", nBank);
+			continue;
+		}
 
-			m_BankFileName[nBankIdx] = sBankName;
-			if (nBankIdx > m_nNumHighestBank)
+		const TVoiceBank *pBank = GetBank (m_BankIndex[nIndex].nBankID);
+		if (!pBank)
+		{
+			if (!ReadBankData (nIndex, m_pReadBank))
 			{
-				// This is the bank ID of the highest loaded bank
-				m_nNumHighestBank = nBankIdx;
+				return;
 			}
-			m_nBanksLoaded++;
-			bBankLoaded = true;
+
+			pBank = m_pReadBank;
 		}
-		else if (bHeaderlessSysExVoices)
+
+		RegisterBank (nIndex, pBank, Hash (pBank->Voice, VoiceSysExSize));
+
+		if (m_nNameScanPos == m_BankIndex.size ())
 		{
-			// Config says to accept headerless SysEx Voice Banks
-			// so reset file pointer and try again.
-			fseek (pFile, 0, SEEK_SET);
-			if (fread (m_pVoiceBank[nBankIdx]->Voice, VoiceSysExSize, 1, pFile) == 1)
-			{
-				if (m_nBanksLoaded % 100 == 0)
-				{
-					LOGDBG ("Banks successfully loaded #%u", m_nBanksLoaded);
-				}
-				//LOGDBG ("Bank #%u successfully loaded (headerless)", nBank);
-
-				// Add in the missing header items.
-				// Naturally it isn't possible to validate these!
-				m_pVoiceBank[nBankIdx]->StatusStart = 0xF0;
-				m_pVoiceBank[nBankIdx]->CompanyID   = 0x43;
-				m_pVoiceBank[nBankIdx]->Format      = 0x09;
-				m_pVoiceBank[nBankIdx]->ByteCountMS = 0x20;
-				m_pVoiceBank[nBankIdx]->ByteCountLS = 0x00;
-				m_pVoiceBank[nBankIdx]->Checksum    = 0x00;
-				m_pVoiceBank[nBankIdx]->StatusEnd   = 0xF7;
-
-				m_BankFileName[nBankIdx] = sBankName;
-				if (nBankIdx > m_nNumHighestBank)
-				{
-					// This is the bank ID of the highest loaded bank
-					m_nNumHighestBank = nBankIdx;
-				}
-				bBankLoaded = true;
-				m_nBanksLoaded++;
-			}
+			ReportDuplicates ();
+		}
+
+		return;
+	}
+}
+
+void CSysExFileLoader::SaveBankStep (void)
+{
+	unsigned nBankID = m_nSaveBankID;
+
+	m_SpinLock.Acquire ();
+	int nIndex = FindBank (nBankID);
+	m_SpinLock.Release ();
+
+	assert (nIndex >= 0);
+	assert (m_BankIndex[nIndex].pBank == m_pReceiveBank);
+
+	if (!m_pSaveFile)
+	{
+		char BankName[30];
+		snprintf (BankName, sizeof BankName, "%04u_MIDI_Dump.syx", nBankID+1);
+		m_BankIndex[nIndex].nNameOffset = AddName (BankName, &m_NamePool);
+
+		std::string Filename (m_DirName);
+		Filename += "/";
+		Filename += BankName;
+
+		m_pSaveFile = fopen (Filename.c_str (), "wb");
+		if (!m_pSaveFile)
+		{
+			LOGERR ("%s: Cannot create file", Filename.c_str ());
+
+			CacheReceivedBank (nBankID);
+		}
+
+		m_nSaveOffset = 0;
+
+		return;
+	}
+
+	const uint8_t *pBank = reinterpret_cast<const uint8_t *> (m_pReceiveBank);
+	unsigned nSize = VoiceSysExHdrSize+VoiceSysExSize;
+
+	if (m_nSaveOffset < nSize)
+	{
+		unsigned nChunk = nSize - m_nSaveOffset;
+		if (nChunk > SaveChunkSize)
+		{
+			nChunk = SaveChunkSize;
 		}
 
-		if (!bBankLoaded)
+		if (fwrite (pBank + m_nSaveOffset, nChunk, 1, m_pSaveFile) == 1)
 		{
-			LOGWARN ("%s: Invalid size or format", Filename.c_str ());
+			m_nSaveOffset += nChunk;
 
-			delete m_pVoiceBank[nBankIdx];
-			m_pVoiceBank[nBankIdx] = nullptr;
+			return;
 		}
 
-		fclose (pFile);
+		LOGERR ("%s: Write error", GetBankFileName (nIndex));
 	}
 	else
 	{
-		delete m_pVoiceBank[nBankIdx];
-		m_pVoiceBank[nBankIdx] = nullptr;
+		LOGNOTE ("Bank #%u saved as %s", nBankID+1, GetBankFileName (nIndex));
 	}
+
+	fclose (m_pSaveFile);
+	m_pSaveFile = nullptr;
+
+	CacheReceivedBank (nBankID);
 }
 
-std::string CSysExFileLoader::GetBankName (unsigned nBankID)
+// moves the received bank into the cache, so that the receive bank is free again
+void CSysExFileLoader::CacheReceivedBank (unsigned nBankID)
 {
-	if (nBankID <= MaxVoiceBankID)
+	uint64_t nHash = Hash (m_pReceiveBank->Voice, VoiceSysExSize);
+
+	TVoiceBank *pBank = FindCachedBank (nHash, m_pReceiveBank);
+	if (!pBank)
 	{
-		std::string Result = m_BankFileName[nBankID];
+		unsigned nSlot = AllocCacheSlot ();
+		pBank = &m_pCacheBank[nSlot];
+		memcpy (pBank, m_pReceiveBank, sizeof (TVoiceBank));
 
-		size_t nLen = Result.length ();
-		if (nLen > 4)
+		m_nCacheBankID[nSlot] = nBankID;
+		m_nCacheBankHash[nSlot] = nHash;
+	}
+
+	m_SpinLock.Acquire ();
+
+	TouchCachedBank (pBank);
+
+	int nIndex = FindBank (nBankID);
+	assert (nIndex >= 0);
+	m_BankIndex[nIndex].pBank = pBank;
+
+	// make room for the next bulk dump, which may be appended from interrupt context
+	if (m_BankIndex.size () >= m_BankIndex.capacity ())
+	{
+		m_BankIndex.reserve (m_BankIndex.size ()+1);
+	}
+
+	m_nSaveBankID = -1;
+
+	m_SpinLock.Release ();
+
+	RegisterBank (nIndex, pBank, nHash);
+}
+
+void CSysExFileLoader::DumpVoiceCacheStats (unsigned nIntervalTicks)
+{
+	unsigned nTicks = CTimer::GetClockTicks ();
+	if (nTicks - m_nLastStatsTicks < nIntervalTicks)
+	{
+		return;
+	}
+	m_nLastStatsTicks = nTicks;
+
+	unsigned nHits = m_nVoiceCacheHits;		// may be incremented from GetVoice() meanwhile
+	unsigned nTotal = nHits + m_nVoiceCacheMisses;
+	if (nTotal > 0)
+	{
+		LOGNOTE ("Voice cache: %u of %u hits (%u%%)", nHits, nTotal, nHits*100 / nTotal);
+	}
+}
+
+// GetVoice() is called from the main loop, from MIDI interrupt context and
+// from core 1 (MIDI file player, boot), so m_SpinLock must be held here.
+bool CSysExFileLoader::LookupVoice (unsigned nKey, uint8_t *pVoiceData)
+{
+	bool bFound = false;
+
+	for (unsigned i = 0; i < VoiceCacheSize; i++)
+	{
+		if (m_VoiceCache[i].nKey == (int) nKey)
 		{
-			Result.resize (nLen-4);		// remove file extension
+			m_VoiceCache[i].nLastUsed = ++m_nCacheClock;
+			memcpy (pVoiceData, m_VoiceCache[i].Voice, SizeSingleVoice);
 
-			unsigned nBank;
-			char BankName[30+1];
-			if (sscanf (Result.c_str (), "%u_%30s", &nBank, BankName) == 2)
-			{
-				Result = BankName;
+			bFound = true;
 
-				return Result;
-			}
+			break;
 		}
 	}
 
-	return "NO NAME";
+	return bFound;
 }
 
-unsigned CSysExFileLoader::GetNextBankUp (unsigned nBankID)
+// finds a voice with the same packed data, which may be from another bank
+bool CSysExFileLoader::LookupVoiceData (unsigned nKey, const uint8_t *pPackedData, uint32_t nHash,
+					uint8_t *pVoiceData)
 {
-	// Find the next loaded bank "up" from the provided bank ID
-	for (unsigned id=nBankID+1; id <= m_nNumHighestBank; id++)
+	bool bFound = false;
+
+	for (unsigned i = 0; i < VoiceCacheSize; i++)
 	{
-		if (IsValidBank(id))
+		if (   m_VoiceCache[i].nKey >= 0
+		    && m_VoiceCache[i].nHash == nHash
+		    && memcmp (m_VoiceCache[i].Packed, pPackedData, SizePackedVoice) == 0)
 		{
-			return id;
+			m_VoiceCache[i].nKey = nKey;
+			m_VoiceCache[i].nLastUsed = ++m_nCacheClock;
+			memcpy (pVoiceData, m_VoiceCache[i].Voice, SizeSingleVoice);
+
+			bFound = true;
+
+			break;
 		}
 	}
-	
-	// Handle wrap-around
-	for (unsigned id=0; id<nBankID; id++)
+
+	return bFound;
+}
+
+void CSysExFileLoader::StoreVoice (unsigned nKey, const uint8_t *pPackedData, uint32_t nHash,
+				   const uint8_t *pVoiceData)
+{
+	unsigned nEntry = 0;
+	for (unsigned i = 0; i < VoiceCacheSize; i++)
 	{
-		if (IsValidBank(id))
+		if (m_VoiceCache[i].nKey < 0)
 		{
-			return id;
+			nEntry = i;
+
+			break;
+		}
+
+		if (m_VoiceCache[i].nLastUsed < m_VoiceCache[nEntry].nLastUsed)
+		{
+			nEntry = i;
 		}
 	}
-	
-	// If we get here there are no other banks!
-	return nBankID;
+
+	m_VoiceCache[nEntry].nKey = nKey;
+	m_VoiceCache[nEntry].nLastUsed = ++m_nCacheClock;
+	m_VoiceCache[nEntry].nHash = nHash;
+	memcpy (m_VoiceCache[nEntry].Packed, pPackedData, SizePackedVoice);
+	memcpy (m_VoiceCache[nEntry].Voice, pVoiceData, SizeSingleVoice);
 }
 
-unsigned CSysExFileLoader::GetNextBankDown (unsigned nBankID)
+void CSysExFileLoader::InvalidateVoiceCache (void)
 {
-	// Find the next loaded bank "down" from the provided bank ID
-	for (int id=((int)nBankID)-1; id >= 0; id--)
+	for (unsigned i = 0; i < VoiceCacheSize; i++)
 	{
-		if (IsValidBank((unsigned)id))
+		m_VoiceCache[i].nKey = -1;
+		m_VoiceCache[i].nLastUsed = 0;
+	}
+}
+
+// Binary search, which is skipped when navigating to a neighbour of the last lookup.
+unsigned CSysExFileLoader::LowerBound (unsigned nBankID)
+{
+	unsigned nSize = m_BankIndex.size ();
+
+	unsigned nHint = m_nLookupHint;
+	for (unsigned nPos = nHint > 0 ? nHint-1 : 0; nPos <= nHint+1 && nPos < nSize; nPos++)
+	{
+		if (   m_BankIndex[nPos].nBankID >= nBankID
+		    && (nPos == 0 || m_BankIndex[nPos-1].nBankID < nBankID))
 		{
-			return id;
+			return nPos;
 		}
 	}
 
-	// Handle wrap-around
-	for (unsigned id=m_nNumHighestBank; id>nBankID; id--)
+	unsigned nLow = 0;
+	unsigned nHigh = nSize;
+	while (nLow < nHigh)
 	{
-		if (IsValidBank(id))
+		unsigned nMid = (nLow + nHigh) / 2;
+		if (m_BankIndex[nMid].nBankID < nBankID)
+		{
+			nLow = nMid+1;
+		}
+		else
 		{
-			return id;
+			nHigh = nMid;
 		}
 	}
-	
-	// If we get here there are no other banks!
-	return nBankID;
+
+	return nLow;
 }
 
-bool CSysExFileLoader::IsValidBank (unsigned nBankID)
+int CSysExFileLoader::FindBank (unsigned nBankID)
 {
-	if (m_pVoiceBank[nBankID])
+	if (nBankID > MaxVoiceBankID)
 	{
-		// Use a valid "status start/end" as an indicator of a valid loaded bank
-		if ((m_pVoiceBank[nBankID]->StatusStart == 0xF0) &&
-			(m_pVoiceBank[nBankID]->StatusEnd == 0xF7))
-		{
-			return true;
-		}
+		return -1;
 	}
-	return false;
+
+	unsigned nPos = LowerBound (nBankID);
+	if (   nPos < m_BankIndex.size ()
+	    && m_BankIndex[nPos].nBankID == nBankID)
+	{
+		m_nLookupHint = nPos;
+
+		return nPos;
+	}
+
+	return -1;
 }
 
-unsigned CSysExFileLoader::GetNumHighestBank (void)
+CSysExFileLoader::TVoiceBank *CSysExFileLoader::GetCachedBank (unsigned nBankID)
+{
+	int nIndex = FindBank (nBankID);
+	if (nIndex < 0)
+	{
+		return nullptr;
+	}
+
+	return m_BankIndex[nIndex].pBank;
+}
+
+// The returned bank may be used from the main loop only, which is the only
+// one, which reuses cache slots.
+CSysExFileLoader::TVoiceBank *CSysExFileLoader::GetBank (unsigned nBankID)
 {
-	return m_nNumHighestBank;
+	m_SpinLock.Acquire ();
+	TVoiceBank *pBank = GetCachedBank (nBankID);
+	m_SpinLock.Release ();
+
+	return pBank;
 }
 
-void CSysExFileLoader::GetVoice (unsigned nBankID, unsigned nVoiceID, uint8_t *pVoiceData)
+const char *CSysExFileLoader::GetBankFileName (unsigned nIndex) const
 {
-	if (   nBankID <= MaxVoiceBankID
-	    && nVoiceID <= VoicesPerBank)
+	assert (nIndex < m_BankIndex.size ());
+	uint32_t nOffset = m_BankIndex[nIndex].nNameOffset;
+	if (nOffset == NoName)
 	{
-		if (IsValidBank(nBankID))
-		{
-			DecodePackedVoice (m_pVoiceBank[nBankID]->Voice[nVoiceID], pVoiceData);
+		return "";
+	}
 
-			return;
-		}
-		else
+	assert (nOffset < m_NamePool.size ());
+	return m_NamePool.c_str () + nOffset;
+}
+
+uint32_t CSysExFileLoader::AddName (const char *pName, std::string *pNamePool)
+{
+	assert (pNamePool);
+	uint32_t nOffset = pNamePool->size ();
+
+	pNamePool->append (pName);
+	pNamePool->push_back ('\0');
+
+	return nOffset;
+}
+
+void CSysExFileLoader::RemoveBank (unsigned nIndex)
+{
+	assert (nIndex < m_BankIndex.size ());
+	assert (!m_BankIndex[nIndex].pBank);
+
+	unsigned nBankID = m_BankIndex[nIndex].nBankID;
+	m_VoiceNames.RemoveBank (nBankID);
+	for (auto Iterator = m_BankHashes.begin (); Iterator != m_BankHashes.end (); ++Iterator)
+	{
+		if (Iterator->second == nBankID)
 		{
-			// Use default voices_bank instead of s_DefaultVoice for bank 0,
-			// if the bank was not successfully loaded from disk.
-			if (nBankID == 0)
-			{
-				memcpy (pVoiceData, voices_bank[0][nVoiceID], SizeSingleVoice);
+			m_BankHashes.erase (Iterator);		// duplicates read their own data now
 
-				return;
-			}
+			break;
 		}
 	}
 
-	memcpy (pVoiceData, s_DefaultVoice, SizeSingleVoice);
+	if (nIndex < m_nNameScanPos)
+	{
+		m_nNameScanPos--;
+	}
+
+	// GetVoice() and BankDumpEnd() must not see the index moving
+	m_SpinLock.Acquire ();
+	m_BankIndex.erase (m_BankIndex.begin () + nIndex);
+	m_nLookupHint = 0;
+	m_SpinLock.Release ();
 }
 
 // See: https://github.com/bwhitman/learnfm/blob/master/dx7db.py
@@ -439,3 +1463,17 @@ void CSysExFileLoader::DecodePackedVoice (const uint8_t *pPackedData, uint8_t *p
 		}
 	}
 }
+
+uint64_t CSysExFileLoader::Hash (const void *pData, size_t nLength)
+{
+	const uint8_t *p = static_cast<const uint8_t *> (pData);
+
+	uint64_t nHash = 0xCBF29CE484222325ULL;
+	while (nLength--)
+	{
+		nHash ^= *p++;
+		nHash *= 0x100000001B3ULL;
+	}
+
+	return nHash;
+}
@@ -23,8 +23,16 @@
 #define _sysexfileloader_h
 
 #include <stdint.h>
+#include <stdio.h>
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <circle/macros.h>
+#include <circle/timer.h>
+#include <circle/spinlock.h>
+#include "voicepack.h"
+#include "voiceindex.h"
+#include "voicenameindex.h"
 
 class CSysExFileLoader		// Loader for DX7 .syx files
 {
@@ -36,6 +44,10 @@ public:
 	static const unsigned VoiceSysExHdrSize = 8; // Additional (optional) Header/Footer bytes for bank of 32 voices
 	static const unsigned VoiceSysExSize = 4096; // Bank of 32 voices as per DX7 MIDI Spec
 	static const unsigned MaxSubDirs = 3; // Number of nested subdirectories supported.
+	static const unsigned SaveChunkSize = 512; // Bytes written to SD per call of Process()
+	static const unsigned MaxCachedBanks = 32; // Banks kept in RAM, the least recently used one is replaced
+	static const unsigned MaxBankRequests = 8; // Pending bank loads requested by GetVoice()
+	static const unsigned VoiceCacheSize = 64; // Decoded voices kept for repeated program changes
 
 	struct TVoiceBank
 	{
@@ -57,33 +69,192 @@ public:
 	CSysExFileLoader (const char *pDirName = "/sysex");
 	~CSysExFileLoader (void);
 
-	void Load (bool bHeaderlessSysExVoices = false);
+	// Builds the index of the available bank files only. The banks are read
+	// on demand by Process() into a cache of MaxCachedBanks banks. If there
+	// is an up-to-date voice pack (see voicepack.h), it is used instead.
+	// The directory scan is cached in a file (see voiceindex.h).
+	// Waits for a pending bank bulk dump to be saved first.
+	void Load (bool bHeaderlessSysExVoices = false);	// at boot time
+
+	// Load() in steps from the main loop, while the sound runs. Each step
+	// reads one directory at most. The old index stays valid, until the
+	// new one is complete. No bank dump is received meanwhile.
+	void LoadStart (bool bHeaderlessSysExVoices = false);
+	bool LoadStep (void);				// returns true when done
 
 	std::string GetBankName (unsigned nBankID);	// 0 .. MaxVoiceBankID
 	unsigned GetNumHighestBank (); // 0 .. MaxVoiceBankID
-	bool     IsValidBank (unsigned nBankID);
+	bool     IsValidBank (unsigned nBankID);	// bank exists, may not be in RAM yet
 	unsigned GetNextBankUp (unsigned nBankID);
 	unsigned GetNextBankDown (unsigned nBankID);
 
-	void GetVoice (unsigned nBankID,		// 0 .. MaxVoiceBankID
+	// Request the bank to be read into the cache, may be called from any context
+	void RequestBank (unsigned nBankID);
+
+	// Returns false, if the bank has not been read from SD yet. It has been
+	// requested then and the call should be repeated after Process().
+	bool GetVoice (unsigned nBankID,		// 0 .. MaxVoiceBankID
 		       unsigned nVoiceID,		// 0 .. 31
 		       uint8_t *pVoiceData);		// returns unpacked format (156 bytes)
 
+	// Receive a bank bulk dump (VoiceSysExHdrSize+VoiceSysExSize bytes), which
+	// may be written in pieces as it arrives. The checksum is verified on the fly.
+	// On success the bank can be used at once, the .syx file is written later
+	// from Process(), so that no caller has to wait for the SD card. Only one
+	// dump is received at a time, it ends with BankDumpEnd() or BankDumpAbort().
+	bool BankDumpStart (void);			// returns false, if receiver is busy
+	bool BankDumpWrite (const uint8_t *pData, size_t nLength);
+	int BankDumpEnd (void);				// returns the new bank ID or -1 on error
+	void BankDumpAbort (void);
+
+	void Process (void);				// called from the main loop only
+	void LoadRequestedBanks (void);			// at boot time, before the sound starts
+
+	// Searches the voice names of all banks, see CVoiceNameIndex::Find().
+	// The names are collected by Process() in the background after Load(),
+	// so the result may be incomplete shortly after boot. Main loop only.
+	unsigned FindVoices (const char *pQuery, bool bPrefix,
+			     CVoiceNameIndex::TMatch *pMatches, unsigned nMaxMatches) const;
+
+	void DumpVoiceCacheStats (unsigned nIntervalTicks = CLOCKHZ);	// for profiling
+
 private:
+	struct TBankIndexEntry
+	{
+		uint16_t nBankID;		// 0 .. MaxVoiceBankID
+		uint32_t nNameOffset;		// into m_NamePool, NoName if not assigned yet
+		TVoiceBank *pBank;		// nullptr, if not in RAM
+		uint32_t nPackOffset;		// bank data in the voice pack, 0 for .syx file
+		uint16_t nDuplicateOf;		// bank ID with the same voice data,
+						// BankUnique or BankNotRead
+	};
+
+	static const uint32_t NoName = 0xFFFFFFFF;
+	static const uint16_t BankUnique = 0xFFFE;
+	static const uint16_t BankNotRead = 0xFFFF;
+
+	// m_SpinLock must be held
+	unsigned LowerBound (unsigned nBankID);	// first index entry with ID >= nBankID
+	int FindBank (unsigned nBankID);	// returns position in m_BankIndex or -1
+	TVoiceBank *GetCachedBank (unsigned nBankID);	// nullptr, if not in RAM
+
+	TVoiceBank *GetBank (unsigned nBankID);	// nullptr, if not in RAM, acquires m_SpinLock
+	const char *GetBankFileName (unsigned nIndex) const;
+	static uint32_t AddName (const char *pName, std::string *pNamePool);
+	void RemoveBank (unsigned nIndex);
+
+	bool LoadPack (std::vector<TBankIndexEntry> *pBankIndex, std::string *pNamePool);
+	void AddScannedFiles (std::vector<TBankIndexEntry> *pBankIndex, std::string *pNamePool);
+	void PublishIndex (void);
+	std::string GetIndexCacheName (void) const;
+
+	bool ReadBank (unsigned nBankID);
+	bool ReadBankData (unsigned nIndex, TVoiceBank *pBank);	// removes bank on error
+	bool ReadBankFile (const char *pFileName, TVoiceBank *pBank);
+	unsigned AllocCacheSlot (void);			// evicts the least recently used bank
+	TVoiceBank *FindCachedBank (uint64_t nHash, const TVoiceBank *pBank);
+	void TouchCachedBank (const TVoiceBank *pBank);	// m_SpinLock must be held
+
+	// detects identical banks and collects the voice names on first read
+	void RegisterBank (unsigned nIndex, const TVoiceBank *pBank, uint64_t nHash);
+	void ReportDuplicates (void);
+
+	// m_SpinLock must be held
+	bool LookupVoice (unsigned nKey, uint8_t *pVoiceData);
+	bool LookupVoiceData (unsigned nKey, const uint8_t *pPackedData, uint32_t nHash,
+			      uint8_t *pVoiceData);
+	void StoreVoice (unsigned nKey, const uint8_t *pPackedData, uint32_t nHash,
+			 const uint8_t *pVoiceData);
+	void InvalidateVoiceCache (void);
+
+	int AddReceivedBank (void);			// returns the new bank ID or -1
+	void SaveBankStep (void);
+	void IndexNamesStep (void);
+	void CacheReceivedBank (unsigned nBankID);
+
 	static void DecodePackedVoice (const uint8_t *pPackedData, uint8_t *pDecodedData);
 
+	static uint64_t Hash (const void *pData, size_t nLength);	// FNV-1a
+
 private:
 	std::string m_DirName;
 	
-	unsigned m_nNumHighestBank;
-	unsigned m_nBanksLoaded;
+	bool m_bHeaderlessSysExVoices;
 
-	TVoiceBank *m_pVoiceBank[MaxVoiceBankID+1];
-	std::string m_BankFileName[MaxVoiceBankID+1];
+	// GetVoice() and BankDumpEnd() may be called from interrupt context and
+	// from other cores. m_SpinLock protects the bank index, the lookup hint,
+	// the cache slot assignment and the voice cache. Only the main loop moves
+	// index entries or reuses a cache slot, so it may read them without lock.
+	CSpinLock m_SpinLock;
+
+	// Sorted by nBankID. There is always room for one more entry, because
+	// BankDumpEnd() may append a bank from interrupt context.
+	std::vector<TBankIndexEntry> m_BankIndex;
+	unsigned m_nLookupHint;			// position of the last lookup
+
+	CVoicePack m_VoicePack;
+
+	std::string m_NamePool;			// file names relative to m_DirName, '\0' terminated,
+						// main loop only
+
+	enum TLoadState
+	{
+		LoadStateIdle,
+		LoadStateWaitReceiver,		// for the bank dump in progress to be saved
+		LoadStateScan,
+		LoadStatePublish
+	};
+
+	TLoadState m_LoadState;
+	bool m_bLoading;			// from LoadStart() until done, blocks bank dumps
+	CVoiceDirIndex m_DirIndex;
+	std::vector<TBankIndexEntry> m_LoadIndex;	// built aside
+	std::string m_LoadNamePool;
+
+	TVoiceBank *m_pCacheBank;			// MaxCachedBanks banks
+	int m_nCacheBankID[MaxCachedBanks];		// -1 if slot is free
+	uint64_t m_nCacheBankHash[MaxCachedBanks];	// identical banks share a slot
+	unsigned m_nCacheLastUsed[MaxCachedBanks];
+	unsigned m_nCacheClock;
+
+	std::unordered_map<uint64_t, uint16_t> m_BankHashes;	// hash of voice data -> bank ID
+	std::vector<uint64_t> m_VoiceHashes;		// of the unique banks, until reported
+	unsigned m_nDuplicateBanks;
+
+	// identical voices of different banks share an entry
+	struct TVoiceCacheEntry
+	{
+		int nKey;				// nBankID * VoicesPerBank + nVoiceID, -1 if free
+						// of the last bank, which used this entry
+		unsigned nLastUsed;
+		uint32_t nHash;				// of Packed
+		uint8_t Packed[SizePackedVoice];
+		uint8_t Voice[SizeSingleVoice];		// unpacked format
+	};
+
+	TVoiceCacheEntry m_VoiceCache[VoiceCacheSize];
+	unsigned m_nVoiceCacheHits;
+	unsigned m_nVoiceCacheMisses;
+	unsigned m_nLastStatsTicks;
+
+	CVoiceNameIndex m_VoiceNames;
+	unsigned m_nNameScanPos;		// next position in m_BankIndex to be indexed
+	TVoiceBank *m_pReadBank;		// read buffer, before a bank is cached
+
+	volatile int m_nBankRequest[MaxBankRequests];	// -1 if free
+	int m_nPrefetchBank[2];				// neighbours of the last requested bank
 
 	static uint8_t s_DefaultVoice[SizeSingleVoice];
-	
-	void LoadBank (const char * sDirName, const char * sBankName, bool bHeaderlessSysExVoices, unsigned nSubDirCount);
+
+	TVoiceBank *m_pReceiveBank;		// bank for the bulk dump receiver
+	unsigned m_nReceiveBytes;
+	uint8_t m_uchReceiveSum;
+	bool m_bReceiveError;
+	bool m_bReceiving;			// between BankDumpStart() and its end
+
+	volatile int m_nSaveBankID;		// bank to be written to SD, -1 for none
+	FILE *m_pSaveFile;
+	unsigned m_nSaveOffset;
 };
 
 #endif
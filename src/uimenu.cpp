@@ -61,6 +61,7 @@ const CUIMenu::TMenuItem CUIMenu::s_TGMenu[] =
 {
 	{"Voice",	EditProgramNumber},
 	{"Bank",	EditVoiceBankNumber},
+	{"Search",	SearchVoice},
 	{"Volume",	EditTGParameter,	0,	CMiniDexed::TGParameterVolume},
 #ifdef ARM_ALLOW_MULTI_CORE
 	{"Pan",		EditTGParameter,	0,	CMiniDexed::TGParameterPan},
@@ -252,7 +253,10 @@ const CUIMenu::TParameter CUIMenu::s_TGParameter[CMiniDexed::TGParameterUnknown]
 	{0, 99, 1}, //AT Range
 	{0, 1, 1, ToOnOff}, //AT Pitch
 	{0, 1, 1, ToOnOff}, //AT Amp
-	{0, 1, 1, ToOnOff} //AT EGBias	
+	{0, 1, 1, ToOnOff}, //AT EGBias
+	{0, 0, 0},											// TGParameterNoteLimitLow (not used in menus)
+	{0, 0, 0},											// TGParameterNoteLimitHigh (not used in menus)
+	{0, 0, 0}											// TGParameterNoteShift (not used in menus)
 };
 
 // must match DexedVoiceParameters in Synth_Dexed
@@ -645,6 +649,129 @@ void CUIMenu::EditProgramNumber (CUIMenu *pUIMenu, TMenuEvent Event)
 	}
 }
 
+void CUIMenu::SearchVoice (CUIMenu *pUIMenu, TMenuEvent Event)
+{
+	unsigned nTG = pUIMenu->m_nMenuStackParameter[pUIMenu->m_nCurrentMenuDepth-1];
+
+	string TG ("TG");
+	TG += to_string (nTG+1);
+
+	unsigned nPosition = pUIMenu->m_nSearchPosition;
+	unsigned nMatch = pUIMenu->m_nSearchMatch;
+	bool bSelectMatch = false;
+
+	switch (Event)
+	{
+	case MenuEventUpdate:
+		break;
+
+	case MenuEventSelect:
+		if (pUIMenu->m_bSearchBrowse)
+		{
+			pUIMenu->m_bSearchBrowse = false;	// edit the query again
+			break;
+		}
+
+		pUIMenu->m_nSearchMatches = pUIMenu->m_pMiniDexed->GetSysExFileLoader ()->FindVoices (
+			pUIMenu->m_SearchText.c_str (), false,
+			pUIMenu->m_SearchMatches, MaxSearchMatches);
+		if (pUIMenu->m_nSearchMatches == 0)
+		{
+			pUIMenu->m_pUI->DisplayWrite (TG.c_str (),
+						      pUIMenu->m_pParentMenu[pUIMenu->m_nCurrentMenuItem].Name,
+						      "No match", false, false);
+			return;
+		}
+
+		pUIMenu->m_bSearchBrowse = true;
+		nMatch = 0;
+		bSelectMatch = true;
+		break;
+
+	case MenuEventStepDown:
+		if (pUIMenu->m_bSearchBrowse)
+		{
+			if (nMatch > 0)
+			{
+				nMatch--;
+				bSelectMatch = true;
+			}
+		}
+		else if (pUIMenu->m_SearchText[nPosition] > ' ')
+		{
+			pUIMenu->m_SearchText[nPosition]--;
+		}
+		break;
+
+	case MenuEventStepUp:
+		if (pUIMenu->m_bSearchBrowse)
+		{
+			if (nMatch < pUIMenu->m_nSearchMatches-1)
+			{
+				nMatch++;
+				bSelectMatch = true;
+			}
+		}
+		else if (pUIMenu->m_SearchText[nPosition] < '~')
+		{
+			pUIMenu->m_SearchText[nPosition]++;
+		}
+		break;
+
+	case MenuEventPressAndStepDown:
+	case MenuEventPressAndStepUp:
+		if (pUIMenu->m_bSearchBrowse)
+		{
+			pUIMenu->TGShortcutHandler (Event);
+			return;
+		}
+
+		// move the cursor
+		if (Event == MenuEventPressAndStepDown)
+		{
+			if (nPosition > 0)
+			{
+				nPosition--;
+			}
+		}
+		else if (nPosition < CVoiceNameIndex::NameLength-1)
+		{
+			nPosition++;
+		}
+		pUIMenu->m_nSearchPosition = nPosition;
+		break;
+
+	default:
+		return;
+	}
+
+	pUIMenu->m_nSearchMatch = nMatch;
+
+	if (!pUIMenu->m_bSearchBrowse)
+	{
+		// \E[2;%dH	Cursor move to row %1 and column %2 (starting at 1)
+		string Value = pUIMenu->m_SearchText + " \E[?25h\E[2;" + to_string (nPosition + 2) + "H";
+
+		pUIMenu->m_pUI->DisplayWrite (TG.c_str (),
+					      pUIMenu->m_pParentMenu[pUIMenu->m_nCurrentMenuItem].Name,
+					      Value.c_str (), false, false);
+		return;
+	}
+
+	const CVoiceNameIndex::TMatch &rMatch = pUIMenu->m_SearchMatches[nMatch];
+	if (bSelectMatch)
+	{
+		pUIMenu->m_pMiniDexed->SetTGParameter (CMiniDexed::TGParameterVoiceBank, rMatch.nBankID, nTG);
+		pUIMenu->m_pMiniDexed->SetTGParameter (CMiniDexed::TGParameterProgram, rMatch.nVoiceID, nTG);
+	}
+
+	string Param = pUIMenu->m_pParentMenu[pUIMenu->m_nCurrentMenuItem].Name;
+	Param += " " + to_string (nMatch+1) + "/" + to_string (pUIMenu->m_nSearchMatches);
+
+	pUIMenu->m_pUI->DisplayWrite (TG.c_str (), Param.c_str (), rMatch.Name,
+				      nMatch > 0, nMatch < pUIMenu->m_nSearchMatches-1);
+}
+
 void CUIMenu::EditTGParameter (CUIMenu *pUIMenu, TMenuEvent Event)
 {
 	unsigned nTG = pUIMenu->m_nMenuStackParameter[pUIMenu->m_nCurrentMenuDepth-1];
@@ -23,6 +23,7 @@
 #ifndef _uimenu_h
 #define _uimenu_h
 
+#include "voicenameindex.h"
 #include <string>
 #include <circle/timer.h>
 
@@ -33,6 +34,7 @@ class CUIMenu
 {
 private:
 	static const unsigned MaxMenuDepth = 5;
+	static const unsigned MaxSearchMatches = 100;
 
 public:
 	enum TMenuEvent
@@ -83,6 +85,7 @@ private:
 	static void EditGlobalParameter (CUIMenu *pUIMenu, TMenuEvent Event);
 	static void EditVoiceBankNumber (CUIMenu *pUIMenu, TMenuEvent Event);
 	static void EditProgramNumber (CUIMenu *pUIMenu, TMenuEvent Event);
+	static void SearchVoice (CUIMenu *pUIMenu, TMenuEvent Event);
 	static void EditTGParameter (CUIMenu *pUIMenu, TMenuEvent Event);
 	static void EditVoiceParameter (CUIMenu *pUIMenu, TMenuEvent Event);
 	static void EditOPParameter (CUIMenu *pUIMenu, TMenuEvent Event);
@@ -171,6 +174,14 @@ private:
 	unsigned m_nSelectedPerformanceID =0;
 	bool m_bSplashShow=false;
 
+	// voice search: the query is edited first, Select shows the matches
+	std::string m_SearchText="          ";
+	unsigned m_nSearchPosition=0;
+	bool m_bSearchBrowse=false;
+	CVoiceNameIndex::TMatch m_SearchMatches[MaxSearchMatches];
+	unsigned m_nSearchMatches=0;
+	unsigned m_nSearchMatch=0;
+
 };
 
 #endif
@@ -37,6 +37,7 @@ CUserInterface::CUserInterface (CMiniDexed *pMiniDexed, CGPIOManager *pGPIOManag
 	m_pUIButtons (0),
 	m_pRotaryEncoder (0),
 	m_bSwitchPressed (false),
+	m_bUpdatePending (false),
 	m_Menu (this, pMiniDexed)
 {
 }
@@ -183,10 +184,28 @@ void CUserInterface::Process (void)
 	{
 		m_pUIButtons->Update();
 	}
+
+	if (m_bUpdatePending)
+	{
+		m_bUpdatePending = false;
+
+		m_Menu.EventHandler (CUIMenu::MenuEventUpdate);
+	}
 }
 
 void CUserInterface::ParameterChanged (void)
 {
+#ifdef ARM_ALLOW_MULTI_CORE
+	// The menu is not thread-safe. Changes from the sound cores (e.g. a
+	// performance switch) are shown by Process() on core 0.
+	if (CMultiCoreSupport::ThisCore () != 0)
+	{
+		m_bUpdatePending = true;
+
+		return;
+	}
+#endif
+
 	m_Menu.EventHandler (CUIMenu::MenuEventUpdate);
 }
 
@@ -82,6 +82,8 @@ private:
 	CKY040 *m_pRotaryEncoder;
 	bool m_bSwitchPressed;
 
+	volatile bool m_bUpdatePending;		// parameter changed on another core
+
 	CUIMenu m_Menu;
 };
 
@@ -0,0 +1,174 @@
+//
+// voicedatacodec.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "voicedatacodec.h"
+#include <assert.h>
+
+// the blob has no padding
+static_assert (CVoiceDataCodec::VoiceDataSize % 3 == 0, "Voice data size must be a multiple of 3");
+
+const char CVoiceDataCodec::s_HexDigit[16] =
+{
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+// -1 for invalid characters
+const s8 CVoiceDataCodec::s_HexValue[256] =
+{
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+const char CVoiceDataCodec::s_BlobDigit[64] =
+{
+	'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+	'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+	'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+	'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
+};
+
+// -1 for invalid characters
+const s8 CVoiceDataCodec::s_BlobValue[256] =
+{
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+void CVoiceDataCodec::EncodeHex (const u8 *pData, char *pText)
+{
+	assert (pData);
+	assert (pText);
+
+	for (unsigned i = 0; i < VoiceDataSize; i++)
+	{
+		*pText++ = s_HexDigit[pData[i] >> 4];
+		*pText++ = s_HexDigit[pData[i] & 0x0F];
+		*pText++ = ' ';
+	}
+
+	pText[-1] = '\0';		// replaces the last separator
+}
+
+bool CVoiceDataCodec::DecodeHex (const char *pText, u8 *pData)
+{
+	assert (pText);
+	assert (pData);
+
+	for (unsigned i = 0; i < VoiceDataSize; i++)
+	{
+		// a '\0' is invalid too, so the text cannot be overrun
+		int nHigh = s_HexValue[(u8) pText[0]];
+		if (nHigh < 0)
+		{
+			return false;
+		}
+
+		int nLow = s_HexValue[(u8) pText[1]];
+		if (nLow < 0)
+		{
+			return false;
+		}
+
+		pData[i] = (u8) (nHigh << 4 | nLow);
+
+		if (   i < VoiceDataSize-1
+		    && pText[2] == '\0')
+		{
+			return false;
+		}
+
+		pText += 3;
+	}
+
+	return true;
+}
+
+void CVoiceDataCodec::EncodeBlob (const u8 *pData, char *pText)
+{
+	assert (pData);
+	assert (pText);
+
+	for (unsigned i = 0; i < VoiceDataSize; i += 3)
+	{
+		u32 nValue = pData[i] << 16 | pData[i+1] << 8 | pData[i+2];
+
+		*pText++ = s_BlobDigit[(nValue >> 18) & 0x3F];
+		*pText++ = s_BlobDigit[(nValue >> 12) & 0x3F];
+		*pText++ = s_BlobDigit[(nValue >> 6) & 0x3F];
+		*pText++ = s_BlobDigit[nValue & 0x3F];
+	}
+
+	*pText = '\0';
+}
+
+bool CVoiceDataCodec::DecodeBlob (const char *pText, u8 *pData)
+{
+	assert (pText);
+	assert (pData);
+
+	for (unsigned i = 0; i < VoiceDataSize; i += 3)
+	{
+		u32 nValue = 0;
+		for (unsigned j = 0; j < 4; j++)
+		{
+			// a '\0' is invalid too, so the text cannot be overrun
+			int nDigit = s_BlobValue[(u8) *pText++];
+			if (nDigit < 0)
+			{
+				return false;
+			}
+
+			nValue = nValue << 6 | nDigit;
+		}
+
+		pData[i]   = (u8) (nValue >> 16);
+		pData[i+1] = (u8) (nValue >> 8);
+		pData[i+2] = (u8) nValue;
+	}
+
+	return *pText == '\0';
+}
@@ -0,0 +1,55 @@
+//
+// voicedatacodec.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _voicedatacodec_h
+#define _voicedatacodec_h
+
+#include <circle/types.h>
+
+// Text encodings of a voice in unpacked format (156 bytes) for the performance
+// files. The hex format ("XX XX ...") is the traditional one. The blob format
+// is base64 and less than half as long. Both codecs are table-driven and work
+// on buffers of the caller only, so that they can be used from any core.
+class CVoiceDataCodec
+{
+public:
+	static const unsigned VoiceDataSize = 156;
+	static const unsigned HexLength = VoiceDataSize*3 - 1;		// without '\0'
+	static const unsigned BlobLength = (VoiceDataSize+2) / 3 * 4;	// without '\0'
+
+public:
+	// pText: HexLength+1 bytes
+	static void EncodeHex (const u8 *pData, char *pText);
+	// false, if pText is too short or not hex, the separators are not checked
+	static bool DecodeHex (const char *pText, u8 *pData);
+
+	// pText: BlobLength+1 bytes
+	static void EncodeBlob (const u8 *pData, char *pText);
+	// false, if pText has not the exact length or is not base64
+	static bool DecodeBlob (const char *pText, u8 *pData);
+
+private:
+	static const char s_HexDigit[16];
+	static const s8 s_HexValue[256];
+
+	static const char s_BlobDigit[64];
+	static const s8 s_BlobValue[256];
+};
+
+#endif
@@ -0,0 +1,503 @@
+//
+// voiceindex.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "voiceindex.h"
+#include <circle/logger.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+LOGMODULE ("voiceindex");
+
+// The cache file starts with a header, followed by the directory records
+// and the file records. All numbers are little endian:
+//
+//	header:	u32 magic, u16 version, u16 reserved, u32 dirs, u32 files
+//	dir:	u32 entries, u32 total size, u32 hash, u32 first file, u32 file count,
+//		u16 path length, path
+//	file:	u16 bank ID, u16 path length, u32 size, u32 timestamp, path
+
+static void Put16 (std::string &rBuffer, u16 nValue)
+{
+	rBuffer += (char) (nValue & 0xFF);
+	rBuffer += (char) (nValue >> 8);
+}
+
+static void Put32 (std::string &rBuffer, u32 nValue)
+{
+	Put16 (rBuffer, nValue & 0xFFFF);
+	Put16 (rBuffer, nValue >> 16);
+}
+
+static bool Get16 (const u8 **ppData, const u8 *pEnd, u16 *pValue)
+{
+	if (pEnd - *ppData < 2)
+	{
+		return false;
+	}
+
+	*pValue = (*ppData)[0] | (*ppData)[1] << 8;
+	*ppData += 2;
+
+	return true;
+}
+
+static bool Get32 (const u8 **ppData, const u8 *pEnd, u32 *pValue)
+{
+	u16 nLow, nHigh;
+	if (   !Get16 (ppData, pEnd, &nLow)
+	    || !Get16 (ppData, pEnd, &nHigh))
+	{
+		return false;
+	}
+
+	*pValue = nLow | (u32) nHigh << 16;
+
+	return true;
+}
+
+static bool GetString (const u8 **ppData, const u8 *pEnd, unsigned nLength, std::string *pString)
+{
+	if ((unsigned) (pEnd - *ppData) < nLength)
+	{
+		return false;
+	}
+
+	pString->assign (reinterpret_cast<const char *> (*ppData), nLength);
+	*ppData += nLength;
+
+	return true;
+}
+
+CVoiceDirIndex::CVoiceDirIndex (void)
+:	m_nDirsScanned (0)
+{
+}
+
+CVoiceDirIndex::~CVoiceDirIndex (void)
+{
+}
+
+bool CVoiceDirIndex::Scan (const char *pDirName, const char *pCacheFileName)
+{
+	if (!ScanStart (pDirName, pCacheFileName))
+	{
+		return false;
+	}
+
+	while (!ScanStep ())
+	{
+		// just continue
+	}
+
+	return true;
+}
+
+bool CVoiceDirIndex::ScanStart (const char *pDirName, const char *pCacheFileName)
+{
+	assert (pDirName);
+	assert (pCacheFileName);
+
+	Clear ();
+
+	m_DirName = pDirName;
+	m_CacheFileName = pCacheFileName;
+
+	FILINFO FileInfo;
+	if (   f_stat (m_DirName.c_str (), &FileInfo) != FR_OK
+	    || !(FileInfo.fattrib & AM_DIR))
+	{
+		return false;
+	}
+
+	if (!ReadCache (pCacheFileName))
+	{
+		m_CachedDirs.clear ();
+		m_CachedFiles.clear ();
+	}
+
+	TPendingDir Dir = {"", 0};
+	m_PendingDirs.push_back (Dir);
+
+	return true;
+}
+
+bool CVoiceDirIndex::ScanStep (void)
+{
+	if (!m_PendingDirs.empty ())
+	{
+		TPendingDir Dir = m_PendingDirs.back ();
+		m_PendingDirs.pop_back ();
+
+		ScanDir (Dir.Path, Dir.nSubDirCount);
+
+		return false;
+	}
+
+	LOGDBG ("%u of %u directories read", m_nDirsScanned, (unsigned) m_Dirs.size ());
+
+	if (m_nDirsScanned > 0)
+	{
+		WriteCache (m_CacheFileName.c_str ());
+	}
+
+	m_CachedDirs.clear ();
+	m_CachedFiles.clear ();
+
+	return true;
+}
+
+unsigned CVoiceDirIndex::GetFileCount (void) const
+{
+	return m_Files.size ();
+}
+
+const CVoiceDirIndex::TFile &CVoiceDirIndex::GetFile (unsigned nIndex) const
+{
+	assert (nIndex < m_Files.size ());
+
+	return m_Files[nIndex];
+}
+
+void CVoiceDirIndex::Clear (void)
+{
+	m_Dirs.clear ();
+	m_Dirs.shrink_to_fit ();
+	m_Files.clear ();
+	m_Files.shrink_to_fit ();
+	m_PendingDirs.clear ();
+
+	m_nDirsScanned = 0;
+}
+
+void CVoiceDirIndex::ScanDir (const std::string &rPath, unsigned nSubDirCount)
+{
+	std::string DirName (m_DirName);
+	if (!rPath.empty ())
+	{
+		DirName += "/";
+		DirName += rPath;
+	}
+
+	DIR Directory;
+	if (f_opendir (&Directory, DirName.c_str ()) != FR_OK)
+	{
+		LOGWARN ("Directory %s not found", DirName.c_str ());
+
+		return;
+	}
+
+	TDir Dir;
+	Dir.Path = rPath;
+	Dir.nFirstFile = m_Files.size ();
+
+	// reading the entries is cheap compared to parsing their names
+	GetDirSignature (&Directory, &Dir);
+
+	const TDir *pCachedDir = nullptr;
+	for (const TDir &rCachedDir : m_CachedDirs)
+	{
+		if (   rCachedDir.Path == rPath
+		    && rCachedDir.nEntries == Dir.nEntries
+		    && rCachedDir.nTotalSize == Dir.nTotalSize
+		    && rCachedDir.nHash == Dir.nHash)
+		{
+			pCachedDir = &rCachedDir;
+
+			break;
+		}
+	}
+
+	std::vector<std::string> SubDirs;
+
+	if (pCachedDir)
+	{
+		for (unsigned i = 0; i < pCachedDir->nFileCount; i++)
+		{
+			m_Files.push_back (m_CachedFiles[pCachedDir->nFirstFile + i]);
+		}
+
+		// the subdirectories may have changed, even if this one did not
+		std::string Prefix (rPath);
+		if (!Prefix.empty ())
+		{
+			Prefix += "/";
+		}
+
+		for (const TDir &rCachedDir : m_CachedDirs)
+		{
+			if (   rCachedDir.Path.length () > Prefix.length ()
+			    && rCachedDir.Path.compare (0, Prefix.length (), Prefix) == 0
+			    && rCachedDir.Path.find ('/', Prefix.length ()) == std::string::npos)
+			{
+				SubDirs.push_back (rCachedDir.Path);
+			}
+		}
+	}
+	else
+	{
+		m_nDirsScanned++;
+
+		f_rewinddir (&Directory);
+
+		FILINFO FileInfo;
+		while (   f_readdir (&Directory, &FileInfo) == FR_OK
+		       && FileInfo.fname[0])
+		{
+			const char *pName = FileInfo.fname;
+
+			std::string Path (rPath);
+			if (!Path.empty ())
+			{
+				Path += "/";
+			}
+			Path += pName;
+
+			if (FileInfo.fattrib & AM_DIR)
+			{
+				if (nSubDirCount >= MaxSubDirs)
+				{
+					LOGWARN ("Too many nested subdirectories: %s", pName);
+
+					continue;
+				}
+
+				LOGDBG ("Processing subdirectory %s", pName);
+
+				SubDirs.push_back (Path);
+
+				continue;
+			}
+
+			unsigned nBank;
+			size_t nLen = strlen (pName);
+			if (   nLen < 5						// "[NNNN]N[_name].syx"
+			    || strcasecmp (&pName[nLen-4], ".syx") != 0
+			    || sscanf (pName, "%u", &nBank) != 1)
+			{
+				LOGWARN ("%s: Invalid filename format", pName);
+
+				continue;
+			}
+
+			// File and UI handling requires banks to be 1..indexed.
+			// Internally (and via MIDI) we need 0..indexed.
+			if (   nBank == 0
+			    || nBank-1 > MaxBankID)
+			{
+				LOGWARN ("Bank #%u is not supported", nBank);
+
+				continue;
+			}
+
+			if (FileInfo.fsize < MinFileSize)
+			{
+				LOGWARN ("%s: Invalid size or format", Path.c_str ());
+
+				continue;
+			}
+
+			TFile File;
+			File.nBankID = nBank-1;
+			File.nSize = FileInfo.fsize;
+			File.nTimeStamp = (u32) FileInfo.fdate << 16 | FileInfo.ftime;
+			File.Path = Path;
+
+			m_Files.push_back (File);
+		}
+	}
+
+	f_closedir (&Directory);
+
+	Dir.nFileCount = m_Files.size () - Dir.nFirstFile;
+	m_Dirs.push_back (Dir);
+
+	// pushed in reverse, so that they are read in directory order
+	for (auto it = SubDirs.rbegin (); it != SubDirs.rend (); ++it)
+	{
+		TPendingDir SubDir = {*it, nSubDirCount+1};
+		m_PendingDirs.push_back (SubDir);
+	}
+}
+
+void CVoiceDirIndex::GetDirSignature (DIR *pDirectory, TDir *pDir)
+{
+	assert (pDirectory);
+	assert (pDir);
+
+	pDir->nEntries = 0;
+	pDir->nTotalSize = 0;
+	pDir->nHash = 0;
+
+	FILINFO FileInfo;
+	while (   f_readdir (pDirectory, &FileInfo) == FR_OK
+	       && FileInfo.fname[0])
+	{
+		u32 nSize = FileInfo.fattrib & AM_DIR ? 0 : (u32) FileInfo.fsize;
+
+		// FNV-1a, the sum does not depend on the order of the entries
+		u32 nHash = 2166136261U;
+		for (const char *p = FileInfo.fname; *p; p++)
+		{
+			nHash = (nHash ^ (u8) *p) * 16777619U;
+		}
+
+		u8 Entry[8] = {(u8) nSize, (u8) (nSize >> 8), (u8) (nSize >> 16), (u8) (nSize >> 24),
+			       (u8) FileInfo.fdate, (u8) (FileInfo.fdate >> 8),
+			       (u8) FileInfo.ftime, (u8) (FileInfo.ftime >> 8)};
+		for (unsigned i = 0; i < sizeof Entry; i++)
+		{
+			nHash = (nHash ^ Entry[i]) * 16777619U;
+		}
+
+		pDir->nEntries++;
+		pDir->nTotalSize += nSize;
+		pDir->nHash += nHash;
+	}
+}
+
+bool CVoiceDirIndex::ReadCache (const char *pFileName)
+{
+	FIL File;
+	if (f_open (&File, pFileName, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return false;
+	}
+
+	unsigned nSize = f_size (&File);
+	u8 *pBuffer = new u8[nSize];
+	assert (pBuffer);
+
+	UINT nBytesRead;
+	bool bOK =    f_read (&File, pBuffer, nSize, &nBytesRead) == FR_OK
+		   && nBytesRead == nSize;
+
+	f_close (&File);
+
+	const u8 *pData = pBuffer;
+	const u8 *pEnd = pBuffer + nSize;
+
+	u32 nMagic, nDirs, nFiles;
+	u16 nVersion, nReserved;
+	bOK =    bOK
+	      && Get32 (&pData, pEnd, &nMagic)
+	      && Get16 (&pData, pEnd, &nVersion)
+	      && Get16 (&pData, pEnd, &nReserved)
+	      && Get32 (&pData, pEnd, &nDirs)
+	      && Get32 (&pData, pEnd, &nFiles)
+	      && nMagic == Magic
+	      && nVersion == Version;
+
+	for (unsigned i = 0; bOK && i < nDirs; i++)
+	{
+		TDir Dir;
+		u32 nFirstFile, nFileCount;
+		u16 nLength;
+		bOK =    Get32 (&pData, pEnd, &Dir.nEntries)
+		      && Get32 (&pData, pEnd, &Dir.nTotalSize)
+		      && Get32 (&pData, pEnd, &Dir.nHash)
+		      && Get32 (&pData, pEnd, &nFirstFile)
+		      && Get32 (&pData, pEnd, &nFileCount)
+		      && Get16 (&pData, pEnd, &nLength)
+		      && GetString (&pData, pEnd, nLength, &Dir.Path)
+		      && nFirstFile + nFileCount <= nFiles;
+
+		Dir.nFirstFile = nFirstFile;
+		Dir.nFileCount = nFileCount;
+
+		m_CachedDirs.push_back (Dir);
+	}
+
+	for (unsigned i = 0; bOK && i < nFiles; i++)
+	{
+		TFile File;
+		u16 nLength;
+		bOK =    Get16 (&pData, pEnd, &File.nBankID)
+		      && Get16 (&pData, pEnd, &nLength)
+		      && Get32 (&pData, pEnd, &File.nSize)
+		      && Get32 (&pData, pEnd, &File.nTimeStamp)
+		      && GetString (&pData, pEnd, nLength, &File.Path)
+		      && File.nBankID <= MaxBankID;
+
+		m_CachedFiles.push_back (File);
+	}
+
+	delete [] pBuffer;
+
+	if (!bOK)
+	{
+		LOGWARN ("%s: Invalid format", pFileName);
+	}
+
+	return bOK;
+}
+
+void CVoiceDirIndex::WriteCache (const char *pFileName)
+{
+	std::string Buffer;
+
+	Put32 (Buffer, Magic);
+	Put16 (Buffer, Version);
+	Put16 (Buffer, 0);
+	Put32 (Buffer, m_Dirs.size ());
+	Put32 (Buffer, m_Files.size ());
+
+	for (const TDir &rDir : m_Dirs)
+	{
+		Put32 (Buffer, rDir.nEntries);
+		Put32 (Buffer, rDir.nTotalSize);
+		Put32 (Buffer, rDir.nHash);
+		Put32 (Buffer, rDir.nFirstFile);
+		Put32 (Buffer, rDir.nFileCount);
+		Put16 (Buffer, rDir.Path.length ());
+		Buffer += rDir.Path;
+	}
+
+	for (const TFile &rFile : m_Files)
+	{
+		Put16 (Buffer, rFile.nBankID);
+		Put16 (Buffer, rFile.Path.length ());
+		Put32 (Buffer, rFile.nSize);
+		Put32 (Buffer, rFile.nTimeStamp);
+		Buffer += rFile.Path;
+	}
+
+	FIL File;
+	if (f_open (&File, pFileName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		LOGWARN ("%s: Cannot create file", pFileName);
+
+		return;
+	}
+
+	UINT nBytesWritten;
+	if (   f_write (&File, Buffer.data (), Buffer.size (), &nBytesWritten) != FR_OK
+	    || nBytesWritten != Buffer.size ())
+	{
+		LOGWARN ("%s: Write error", pFileName);
+
+		f_close (&File);
+		f_unlink (pFileName);
+
+		return;
+	}
+
+	f_close (&File);
+}
@@ -0,0 +1,107 @@
+//
+// voiceindex.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _voiceindex_h
+#define _voiceindex_h
+
+#include <circle/types.h>
+#include <fatfs/ff.h>
+#include <string>
+#include <vector>
+
+// Index of the bank files in the voice directory and its subdirectories.
+// The result of the last scan is kept in a cache file. On the next boot
+// the files of a directory are taken from the cache, if the number, the
+// total size and a hash of the names and times of its entries have not
+// changed, otherwise only this directory is parsed again. The timestamp of
+// a directory cannot be used for this, because neither FatFs nor Windows
+// update it on FAT, when a file is added. Delete the cache file to force
+// a complete scan.
+class CVoiceDirIndex
+{
+public:
+	static const u32 Magic = 0x58564D44;		// "DMVX"
+	static const u16 Version = 2;
+	static const unsigned MaxSubDirs = 3;		// same as CSysExFileLoader
+	static const unsigned MaxBankID = 16383;
+	static const unsigned MinFileSize = 4096;	// headerless bank
+
+	struct TFile
+	{
+		u16 nBankID;			// 0 .. MaxBankID
+		u32 nSize;
+		u32 nTimeStamp;			// FatFs fdate << 16 | ftime
+		std::string Path;		// relative to the voice directory
+	};
+
+public:
+	CVoiceDirIndex (void);
+	~CVoiceDirIndex (void);
+
+	// pDirName, pCacheFileName: FatFs paths ("SD:/sysex/voice")
+	bool Scan (const char *pDirName, const char *pCacheFileName);
+
+	// Scan() in steps, so that the main loop is not blocked for long
+	bool ScanStart (const char *pDirName, const char *pCacheFileName); // false if not found
+	bool ScanStep (void);			// reads one directory, returns true when done
+
+	unsigned GetFileCount (void) const;
+	const TFile &GetFile (unsigned nIndex) const;
+
+	void Clear (void);			// frees the memory after use
+
+private:
+	struct TDir
+	{
+		std::string Path;		// relative to the voice directory, "" for itself
+		u32 nEntries;			// files and subdirectories
+		u32 nTotalSize;			// of the files
+		u32 nHash;			// sum of FNV-1a hashes of the names, sizes and times
+		unsigned nFirstFile;
+		unsigned nFileCount;
+	};
+
+	struct TPendingDir
+	{
+		std::string Path;
+		unsigned nSubDirCount;		// nesting level
+	};
+
+	void ScanDir (const std::string &rPath, unsigned nSubDirCount);
+	static void GetDirSignature (DIR *pDirectory, TDir *pDir);
+
+	bool ReadCache (const char *pFileName);
+	void WriteCache (const char *pFileName);
+
+private:
+	std::string m_DirName;
+	std::string m_CacheFileName;
+
+	std::vector<TPendingDir> m_PendingDirs;	// stack, the next directory is at the end
+
+	std::vector<TDir> m_Dirs;
+	std::vector<TFile> m_Files;
+
+	std::vector<TDir> m_CachedDirs;
+	std::vector<TFile> m_CachedFiles;
+
+	unsigned m_nDirsScanned;		// directories, which had to be read
+};
+
+#endif
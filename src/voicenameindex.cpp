@@ -0,0 +1,208 @@
+//
+// voicenameindex.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "voicenameindex.h"
+#include <string.h>
+#include <assert.h>
+
+CVoiceNameIndex::CVoiceNameIndex (void)
+{
+}
+
+void CVoiceNameIndex::Clear (void)
+{
+	m_Entries.clear ();
+}
+
+void CVoiceNameIndex::AddBank (unsigned nBankID, const u8 *pPackedVoices)
+{
+	assert (pPackedVoices);
+
+	RemoveBank (nBankID);
+
+	// all voices are added, so that a bank always has VoicesPerBank entries
+	TEntry Entries[VoicesPerBank];
+	for (unsigned i = 0; i < VoicesPerBank; i++)
+	{
+		const u8 *pName = pPackedVoices + i*SizePackedVoice + NameOffset;
+		for (unsigned j = 0; j < NameLength; j++)
+		{
+			char chChar = (char) pName[j];
+			Entries[i].Name[j] = chChar >= ' ' && chChar <= '~' ? chChar : ' ';
+		}
+
+		Entries[i].nBankID = nBankID;
+		Entries[i].nVoiceID = i;
+		Entries[i].nCharMask = GetCharMask (Entries[i].Name, NameLength);
+	}
+
+	// banks are mostly added in ascending order, so this appends usually
+	unsigned nPos = LowerBound (nBankID);
+	m_Entries.insert (m_Entries.begin () + nPos, Entries, Entries + VoicesPerBank);
+}
+
+void CVoiceNameIndex::RemoveBank (unsigned nBankID)
+{
+	unsigned nPos = LowerBound (nBankID);
+	if (   nPos < m_Entries.size ()
+	    && m_Entries[nPos].nBankID == nBankID)
+	{
+		assert (nPos + VoicesPerBank <= m_Entries.size ());
+		m_Entries.erase (m_Entries.begin () + nPos, m_Entries.begin () + nPos + VoicesPerBank);
+	}
+}
+
+bool CVoiceNameIndex::HasBank (unsigned nBankID) const
+{
+	unsigned nPos = LowerBound (nBankID);
+
+	return    nPos < m_Entries.size ()
+	       && m_Entries[nPos].nBankID == nBankID;
+}
+
+unsigned CVoiceNameIndex::GetBankCount (void) const
+{
+	return m_Entries.size () / VoicesPerBank;
+}
+
+unsigned CVoiceNameIndex::Find (const char *pQuery, bool bPrefix,
+				TMatch *pMatches, unsigned nMaxMatches) const
+{
+	assert (pQuery);
+	assert (pMatches);
+
+	unsigned nLength = strlen (pQuery);
+	while (   nLength > 0
+	       && pQuery[nLength-1] == ' ')
+	{
+		nLength--;
+	}
+
+	if (   nLength == 0
+	    || nLength > NameLength)
+	{
+		return 0;
+	}
+
+	char Query[NameLength];
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		Query[i] = Fold (pQuery[i]);
+	}
+
+	u64 nQueryMask = GetCharMask (Query, nLength);
+	unsigned nLastPos = bPrefix ? 0 : NameLength - nLength;
+
+	unsigned nMatches = 0;
+	for (const TEntry &rEntry : m_Entries)
+	{
+		// skip names, which do not contain all characters of the query
+		if ((rEntry.nCharMask & nQueryMask) != nQueryMask)
+		{
+			continue;
+		}
+
+		bool bFound = false;
+		for (unsigned nPos = 0; nPos <= nLastPos && !bFound; nPos++)
+		{
+			unsigned i;
+			for (i = 0; i < nLength; i++)
+			{
+				if (Fold (rEntry.Name[nPos+i]) != Query[i])
+				{
+					break;
+				}
+			}
+
+			bFound = i == nLength;
+		}
+
+		if (!bFound)
+		{
+			continue;
+		}
+
+		TMatch *pMatch = &pMatches[nMatches];
+		pMatch->nBankID = rEntry.nBankID;
+		pMatch->nVoiceID = rEntry.nVoiceID;
+		memcpy (pMatch->Name, rEntry.Name, NameLength);
+		pMatch->Name[NameLength] = '\0';
+
+		if (++nMatches == nMaxMatches)
+		{
+			break;
+		}
+	}
+
+	return nMatches;
+}
+
+unsigned CVoiceNameIndex::LowerBound (unsigned nBankID) const
+{
+	unsigned nLow = 0;
+	unsigned nHigh = m_Entries.size ();
+	while (nLow < nHigh)
+	{
+		unsigned nMid = (nLow + nHigh) / 2;
+		if (m_Entries[nMid].nBankID < nBankID)
+		{
+			nLow = nMid+1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	return nLow;
+}
+
+char CVoiceNameIndex::Fold (char chChar)
+{
+	return chChar >= 'a' && chChar <= 'z' ? chChar - 'a' + 'A' : chChar;
+}
+
+// one bit per letter and digit, the other characters share the remaining bits
+u64 CVoiceNameIndex::GetCharMask (const char *pName, unsigned nLength)
+{
+	u64 nMask = 0;
+
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		char chChar = Fold (pName[i]);
+
+		unsigned nBit;
+		if (chChar >= 'A' && chChar <= 'Z')
+		{
+			nBit = chChar - 'A';
+		}
+		else if (chChar >= '0' && chChar <= '9')
+		{
+			nBit = 26 + chChar - '0';
+		}
+		else
+		{
+			nBit = 36 + (u8) chChar % 28;
+		}
+
+		nMask |= (u64) 1 << nBit;
+	}
+
+	return nMask;
+}
@@ -0,0 +1,80 @@
+//
+// voicenameindex.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _voicenameindex_h
+#define _voicenameindex_h
+
+#include <circle/types.h>
+#include <vector>
+
+// Names of the voices of all banks, which have been read so far, for searching
+// voices by name. The names are taken from the packed bank data directly. To
+// keep the search fast, each entry has a bitmap of the characters in the name,
+// so that most names can be skipped without comparing them.
+class CVoiceNameIndex
+{
+public:
+	static const unsigned VoicesPerBank = 32;
+	static const unsigned SizePackedVoice = 128;
+	static const unsigned NameOffset = 118;		// in the packed voice
+	static const unsigned NameLength = 10;
+
+	struct TMatch
+	{
+		u16 nBankID;
+		u8 nVoiceID;
+		char Name[NameLength+1];
+	};
+
+public:
+	CVoiceNameIndex (void);
+
+	void Clear (void);
+
+	// pPackedVoices: VoicesPerBank voices in packed format, replaces known names
+	void AddBank (unsigned nBankID, const u8 *pPackedVoices);
+	void RemoveBank (unsigned nBankID);
+	bool HasBank (unsigned nBankID) const;
+
+	unsigned GetBankCount (void) const;
+
+	// Case insensitive search for names, which start with (bPrefix) or contain
+	// pQuery. Trailing blanks of pQuery are ignored. Matches are returned in
+	// bank and voice order, the number of matches is returned.
+	unsigned Find (const char *pQuery, bool bPrefix, TMatch *pMatches, unsigned nMaxMatches) const;
+
+private:
+	struct TEntry
+	{
+		char Name[NameLength];		// blank padded
+		u16 nBankID;
+		u8 nVoiceID;
+		u64 nCharMask;
+	};
+
+	unsigned LowerBound (unsigned nBankID) const;
+
+	static char Fold (char chChar);
+	static u64 GetCharMask (const char *pName, unsigned nLength);
+
+private:
+	std::vector<TEntry> m_Entries;		// sorted by bank ID and voice ID
+};
+
+#endif
@@ -0,0 +1,272 @@
+//
+// voicepack.cpp
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "voicepack.h"
+#include <circle/logger.h>
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+LOGMODULE ("voicepack");
+
+CVoicePack::CVoicePack (void)
+:	m_bFileOpen (false),
+	m_pBuffer (nullptr)
+{
+}
+
+CVoicePack::~CVoicePack (void)
+{
+	Close ();
+}
+
+bool CVoicePack::Open (const char *pFileName, const char *pDirName)
+{
+	assert (pFileName);
+	assert (pDirName);
+
+	Close ();
+
+	if (f_open (&m_File, pFileName, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return false;
+	}
+	m_bFileOpen = true;
+
+	UINT nBytesRead;
+	if (   f_read (&m_File, &m_Header, sizeof m_Header, &nBytesRead) != FR_OK
+	    || nBytesRead != sizeof m_Header
+	    || m_Header.nMagic != Magic
+	    || m_Header.nVersion != Version
+	    || m_Header.nHeaderSize != sizeof m_Header
+	    || m_Header.nBanks > 16384
+	    || m_Header.nNamesOffset != sizeof m_Header + m_Header.nBanks * sizeof (TIndexEntry)
+	    || m_Header.nBankDataOffset != m_Header.nNamesOffset + m_Header.nNamesSize
+	    || f_size (&m_File) != m_Header.nBankDataOffset + (FSIZE_t) m_Header.nBanks * BankSize)
+	{
+		LOGWARN ("%s: Invalid format", pFileName);
+
+		Close ();
+
+		return false;
+	}
+
+	u32 nFiles = 0;
+	u32 nHash = 0;
+	if (   !ScanDirectory (pDirName, "", 0, &nFiles, &nHash)
+	    || nFiles != m_Header.nSyxFiles
+	    || nHash != m_Header.nFilesHash)
+	{
+		LOGNOTE ("%s is out of date, rebuild it with packsysex.py", pFileName);
+
+		Close ();
+
+		return false;
+	}
+
+	// index and names follow the header, read them in one go
+	unsigned nSize = m_Header.nBankDataOffset - sizeof m_Header;
+	m_pBuffer = new u8[nSize+1];
+	assert (m_pBuffer);
+
+	if (   f_read (&m_File, m_pBuffer, nSize, &nBytesRead) != FR_OK
+	    || nBytesRead != nSize)
+	{
+		LOGWARN ("%s: Read error", pFileName);
+
+		Close ();
+
+		return false;
+	}
+
+	m_pBuffer[nSize] = '\0';		// terminate the last name in any case
+
+	for (unsigned i = 0; i < m_Header.nBanks; i++)
+	{
+		if (GetBankOffset (i) == 0)
+		{
+			LOGWARN ("%s: Invalid index", pFileName);
+
+			Close ();
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void CVoicePack::Close (void)
+{
+	if (m_bFileOpen)
+	{
+		f_close (&m_File);
+
+		m_bFileOpen = false;
+	}
+
+	delete [] m_pBuffer;
+	m_pBuffer = nullptr;
+}
+
+bool CVoicePack::IsOpen (void) const
+{
+	return m_bFileOpen && m_pBuffer;
+}
+
+unsigned CVoicePack::GetBankCount (void) const
+{
+	assert (IsOpen ());
+
+	return m_Header.nBanks;
+}
+
+unsigned CVoicePack::GetBankID (unsigned nIndex) const
+{
+	assert (IsOpen ());
+	assert (nIndex < m_Header.nBanks);
+
+	const TIndexEntry *pIndex = reinterpret_cast<const TIndexEntry *> (m_pBuffer);
+
+	return pIndex[nIndex].nBankID;
+}
+
+const char *CVoicePack::GetBankFileName (unsigned nIndex) const
+{
+	assert (IsOpen ());
+	assert (nIndex < m_Header.nBanks);
+
+	const TIndexEntry *pIndex = reinterpret_cast<const TIndexEntry *> (m_pBuffer);
+
+	u32 nOffset = pIndex[nIndex].nNameOffset;
+	if (nOffset >= m_Header.nNamesSize)
+	{
+		return "";
+	}
+
+	return reinterpret_cast<const char *> (m_pBuffer) + m_Header.nNamesOffset - sizeof m_Header
+	       + nOffset;
+}
+
+u32 CVoicePack::GetBankOffset (unsigned nIndex) const
+{
+	assert (IsOpen ());
+	assert (nIndex < m_Header.nBanks);
+
+	// only valid, if the index is sorted by bank ID without duplicates
+	const TIndexEntry *pIndex = reinterpret_cast<const TIndexEntry *> (m_pBuffer);
+	if (   pIndex[nIndex].nBankID > 16383
+	    || (nIndex > 0 && pIndex[nIndex].nBankID <= pIndex[nIndex-1].nBankID))
+	{
+		return 0;
+	}
+
+	return m_Header.nBankDataOffset + nIndex * BankSize;
+}
+
+bool CVoicePack::ReadBank (u32 nOffset, void *pBuffer)
+{
+	assert (pBuffer);
+
+	if (!IsOpen ())
+	{
+		return false;
+	}
+
+	UINT nBytesRead;
+	return    f_lseek (&m_File, nOffset) == FR_OK
+	       && f_read (&m_File, pBuffer, BankSize, &nBytesRead) == FR_OK
+	       && nBytesRead == BankSize;
+}
+
+// Counts the .syx files and hashes their directory entries without opening them,
+// which is much cheaper than reading all bank files.
+bool CVoicePack::ScanDirectory (const char *pDirName, const char *pRelDirName, unsigned nSubDirCount,
+				u32 *pFiles, u32 *pHash)
+{
+	DIR Directory;
+	if (f_opendir (&Directory, pDirName) != FR_OK)
+	{
+		return false;
+	}
+
+	FILINFO FileInfo;
+	while (   f_readdir (&Directory, &FileInfo) == FR_OK
+	       && FileInfo.fname[0])
+	{
+		if (FileInfo.fattrib & AM_DIR)
+		{
+			if (nSubDirCount < MaxSubDirs)
+			{
+				std::string DirName (pDirName);
+				DirName += "/";
+				DirName += FileInfo.fname;
+
+				std::string RelDirName (pRelDirName);
+				RelDirName += FileInfo.fname;
+				RelDirName += "/";
+
+				ScanDirectory (DirName.c_str (), RelDirName.c_str (), nSubDirCount+1,
+					       pFiles, pHash);
+			}
+
+			continue;
+		}
+
+		size_t nLen = strlen (FileInfo.fname);
+		if (   nLen >= 4
+		    && strcasecmp (&FileInfo.fname[nLen-4], ".syx") == 0)
+		{
+			(*pFiles)++;
+			*pHash += HashFile (pRelDirName, FileInfo.fname, (u32) FileInfo.fsize,
+					    FileInfo.fdate, FileInfo.ftime);
+		}
+	}
+
+	f_closedir (&Directory);
+
+	return true;
+}
+
+// FNV-1a, must match packsysex.py
+u32 CVoicePack::HashFile (const char *pRelDirName, const char *pName,
+			  u32 nSize, u16 usDate, u16 usTime)
+{
+	u32 nHash = 2166136261U;
+
+	for (const char *p = pRelDirName; *p; p++)
+	{
+		nHash = (nHash ^ (u8) *p) * 16777619U;
+	}
+
+	for (const char *p = pName; *p; p++)
+	{
+		nHash = (nHash ^ (u8) *p) * 16777619U;
+	}
+
+	u8 Entry[8] = {(u8) nSize, (u8) (nSize >> 8), (u8) (nSize >> 16), (u8) (nSize >> 24),
+		       (u8) usDate, (u8) (usDate >> 8), (u8) usTime, (u8) (usTime >> 8)};
+	for (unsigned i = 0; i < sizeof Entry; i++)
+	{
+		nHash = (nHash ^ Entry[i]) * 16777619U;
+	}
+
+	return nHash;
+}
@@ -0,0 +1,104 @@
+//
+// voicepack.h
+//
+// MiniDexed - Dexed FM synthesizer for bare metal Raspberry Pi
+// Copyright (C) 2022  The MiniDexed Team
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _voicepack_h
+#define _voicepack_h
+
+#include <circle/types.h>
+#include <circle/macros.h>
+#include <fatfs/ff.h>
+#include <stddef.h>
+
+// Packed voice library, which is built from a directory of .syx files on the
+// host with packsysex.py. All numbers are little endian:
+//
+//	THeader
+//	TIndexEntry[nBanks]	sorted by bank ID
+//	names			'\0' terminated file names relative to the directory
+//	bank data		nBanks * BankSize bytes (complete bank bulk dumps)
+//
+// Header, index and names are read at once, the banks on demand. The pack is
+// only used, if the .syx files in the directory still match the ones it has
+// been built from (same number of files and same file names, sizes and
+// modification times). Copying the files without keeping their times makes
+// the pack out of date, which is safe.
+class CVoicePack
+{
+public:
+	static const u32 Magic = 0x4C56444D;		// "MDVL"
+	static const u16 Version = 2;
+	static const unsigned BankSize = 4104;
+	static const unsigned MaxSubDirs = 3;		// same as CSysExFileLoader
+
+	struct THeader
+	{
+		u32 nMagic;
+		u16 nVersion;
+		u16 nHeaderSize;
+		u32 nBanks;
+		u32 nSyxFiles;			// .syx files in the directory tree
+		u32 nFilesHash;			// sum of FNV-1a hashes of their names, sizes and times
+		u32 nNamesOffset;
+		u32 nNamesSize;
+		u32 nBankDataOffset;
+	}
+	PACKED;
+
+	struct TIndexEntry
+	{
+		u16 nBankID;			// 0 .. 16383
+		u16 nReserved;
+		u32 nNameOffset;		// relative to nNamesOffset
+	}
+	PACKED;
+
+public:
+	CVoicePack (void);
+	~CVoicePack (void);
+
+	// pDirName: directory, from which the pack has been built ("SD:/sysex/voice")
+	bool Open (const char *pFileName, const char *pDirName);
+	void Close (void);
+
+	bool IsOpen (void) const;
+
+	unsigned GetBankCount (void) const;
+	unsigned GetBankID (unsigned nIndex) const;
+	const char *GetBankFileName (unsigned nIndex) const;
+	u32 GetBankOffset (unsigned nIndex) const;	// file offset of the bank data
+
+	bool ReadBank (u32 nOffset, void *pBuffer);	// reads BankSize bytes
+
+private:
+	bool ScanDirectory (const char *pDirName, const char *pRelDirName, unsigned nSubDirCount,
+			    u32 *pFiles, u32 *pHash);
+
+	// the size and the FAT date and time are hashed little endian after the name
+	static u32 HashFile (const char *pRelDirName, const char *pName,
+			     u32 nSize, u16 usDate, u16 usTime);
+
+private:
+	FIL m_File;
+	bool m_bFileOpen;
+
+	THeader m_Header;
+	u8 *m_pBuffer;				// index and names
+};
+
+#endif